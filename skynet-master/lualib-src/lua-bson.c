@@ -16,6 +16,8 @@
 #define MAX_NUMBER 1024
 // avoid circular reference while encodeing
 #define MAX_DEPTH 128
+// the smaller sub documents are decoded at once in lazy mode, it's cheaper than a proxy
+#define LAZY_MIN_SIZE 256
 
 #define BSON_REAL 1
 #define BSON_STRING 2
@@ -236,9 +238,20 @@ write_string(struct bson *b, lua_State *L, const char *key, size_t sz) {
 	const char *src = key;
 	size_t n = sz;
 	while(n > 0) {
-		int c = utf8_copy(src, dst, n);
-		if (c == 0) {
-			luaL_error(L, "Invalid utf8 string");
+		int c;
+		uint64_t v;
+		if (n >= 8 && (memcpy(&v, src, 8), (v & 0x8080808080808080ULL) == 0)) {
+			// 8 ascii chars
+			memcpy(dst, &v, 8);
+			c = 8;
+		} else if ((uint8_t)*src < 0x80) {
+			*dst = *src;
+			c = 1;
+		} else {
+			c = utf8_copy(src, dst, n);
+			if (c == 0) {
+				luaL_error(L, "Invalid utf8 string");
+			}
 		}
 		src += c;
 		dst += c;
@@ -329,7 +342,9 @@ append_one(struct bson *bs, lua_State *L, const char *key, size_t sz, int depth)
 		break;
 	case LUA_TLIGHTUSERDATA:
 	case LUA_TUSERDATA: {
-		append_key(bs, L, BSON_DOCUMENT, key, sz);
+		// the result of encode_batch is an array
+		int type = luaL_testudata(L, -1, "bson_array") ? BSON_ARRAY : BSON_DOCUMENT;
+		append_key(bs, L, type, key, sz);
 		int32_t * doc = (int32_t*)lua_touserdata(L,-1);
 		int32_t sz = *doc;
 		bson_reserve(bs,sz);
@@ -437,7 +452,17 @@ bson_numstr( char *str, unsigned int i ) {
 		memcpy( str, bson_numstrs[i], 4 );
 		return bson_numstr_len[i];
 	} else {
-		return sprintf( str,"%u", i );
+		char tmp[16];
+		int n = 0;
+		int j;
+		do {
+			tmp[n++] = '0' + i % 10;
+			i /= 10;
+		} while (i);
+		for (j=0;j<n;j++) {
+			str[j] = tmp[n-j-1];
+		}
+		return n;
 	}
 }
 
@@ -599,18 +624,59 @@ make_object(lua_State *L, int type, const void * ptr, size_t len) {
 	luaL_pushresult(&b);
 }
 
+// For lazy decoding, the sub documents (LAZY_MIN_SIZE at least) are decoded into empty proxy tables on the first access.
+// The proxy is mapped to the document userdata (ephemeron table src) and the offset (table pos).
+struct bson_lazy {
+	const uint8_t * base;
+	int source;	// the document userdata
+	int src;
+	int pos;
+	int meta;	// the metatable of proxy
+};
+
 static void
-unpack_dict(lua_State *L, struct bson_reader *br, bool array) {
-	luaL_checkstack(L, 16, NULL);	// reserve enough stack space to unpack table
+read_document(lua_State *L, struct bson_reader *br, struct bson_reader *t) {
 	int sz = read_int32(L, br);
 	const void * bytes = read_bytes(L, br, sz-5);
-	struct bson_reader t = { (const uint8_t*)bytes, sz-5 };
+	t->ptr = (const uint8_t*)bytes;
+	t->size = sz-5;
 	int end = read_byte(L, br);
 	if (end != '\0') {
 		luaL_error(L, "Invalid document end");
 	}
+}
 
+static void
+lazy_proxy(lua_State *L, struct bson_reader *br, bool array, struct bson_lazy *lazy) {
+	struct bson_reader t;
+	lua_Integer pos = br->ptr - lazy->base;
+	read_document(L, br, &t);
 	lua_newtable(L);
+	lua_pushvalue(L, -1);
+	lua_pushvalue(L, lazy->source);
+	lua_rawset(L, lazy->src);
+	lua_pushvalue(L, -1);
+	lua_pushinteger(L, pos << 1 | array);
+	lua_rawset(L, lazy->pos);
+	lua_pushvalue(L, lazy->meta);
+	lua_setmetatable(L, -2);
+}
+
+static void unpack_fields(lua_State *L, struct bson_reader *br, bool array, struct bson_lazy *lazy);
+
+static void
+unpack_dict(lua_State *L, struct bson_reader *br, bool array, struct bson_lazy *lazy) {
+	struct bson_reader t;
+	read_document(L, br, &t);
+	lua_newtable(L);
+	unpack_fields(L, &t, array, lazy);
+}
+
+// unpack the fields into the table on the top
+static void
+unpack_fields(lua_State *L, struct bson_reader *br, bool array, struct bson_lazy *lazy) {
+	luaL_checkstack(L, 16, NULL);	// reserve enough stack space to unpack table
+	struct bson_reader t = *br;
 
 	for (;;) {
 		if (t.size == 0)
@@ -640,10 +706,12 @@ unpack_dict(lua_State *L, struct bson_reader *br, bool array) {
 			break;
 		}
 		case BSON_DOCUMENT:
-			unpack_dict(L, &t, false);
-			break;
 		case BSON_ARRAY:
-			unpack_dict(L, &t, true);
+			if (lazy && t.size >= 4 && get_length(t.ptr) >= LAZY_MIN_SIZE) {
+				lazy_proxy(L, &t, bt == BSON_ARRAY, lazy);
+			} else {
+				unpack_dict(L, &t, bt == BSON_ARRAY, lazy);
+			}
 			break;
 		case BSON_BINARY: {
 			int sz = read_int32(L, &t);
@@ -922,11 +990,153 @@ ldecode(lua_State *L) {
 	int32_t len = get_length(b);
 	struct bson_reader br = { b , len };
 
-	unpack_dict(L, &br, false);
+	unpack_dict(L, &br, false, NULL);
+
+	return 1;
+}
+
+// upvalues of the lazy functions : src, pos, meta
+static void
+lazy_load(lua_State *L, int t) {
+	lua_pushvalue(L, t);
+	if (lua_rawget(L, lua_upvalueindex(2)) != LUA_TNUMBER) {
+		// loaded
+		lua_pop(L, 1);
+		return;
+	}
+	lua_Integer pos = lua_tointeger(L, -1);
+	lua_pop(L, 1);
+	lua_pushvalue(L, t);
+	lua_rawget(L, lua_upvalueindex(1));
+	int source = lua_gettop(L);
+	lua_pushvalue(L, t);
+	lua_pushnil(L);
+	lua_rawset(L, lua_upvalueindex(1));
+	lua_pushvalue(L, t);
+	lua_pushnil(L);
+	lua_rawset(L, lua_upvalueindex(2));
+	lua_pushnil(L);
+	lua_setmetatable(L, t);
+
+	struct bson_lazy lazy = {
+		(const uint8_t *)lua_touserdata(L, source),
+		source,
+		lua_upvalueindex(1),
+		lua_upvalueindex(2),
+		lua_upvalueindex(3),
+	};
+	size_t offset = pos >> 1;
+	struct bson_reader br = { lazy.base + offset, (int)(lua_rawlen(L, source) - offset) };
+	struct bson_reader fields;
+	read_document(L, &br, &fields);
+	lua_pushvalue(L, t);
+	unpack_fields(L, &fields, pos & 1, &lazy);
+	lua_settop(L, source - 1);
+}
+
+static int
+lazy_index(lua_State *L) {
+	lazy_load(L, 1);
+	lua_settop(L, 2);
+	lua_rawget(L, 1);
+	return 1;
+}
+
+static int
+lazy_newindex(lua_State *L) {
+	lazy_load(L, 1);
+	lua_settop(L, 3);
+	lua_rawset(L, 1);
+	return 0;
+}
+
+static int
+lazy_len(lua_State *L) {
+	lazy_load(L, 1);
+	lua_pushinteger(L, lua_rawlen(L, 1));
+	return 1;
+}
+
+static int
+lazy_next(lua_State *L) {
+	luaL_checktype(L, 1, LUA_TTABLE);
+	lua_settop(L, 2);
+	if (lua_next(L, 1)) {
+		return 2;
+	}
+	lua_pushnil(L);
+	return 1;
+}
+
+static int
+lazy_pairs(lua_State *L) {
+	lazy_load(L, 1);
+	lua_pushcfunction(L, lazy_next);
+	lua_pushvalue(L, 1);
+	lua_pushnil(L);
+	return 3;
+}
+
+static int
+ldecode_lazy(lua_State *L) {
+	const uint8_t * data = (const uint8_t *)lua_touserdata(L,1);
+	if (data == NULL) {
+		return 0;
+	}
+	int32_t len = get_length(data);
+	lua_settop(L, 1);
+	if (lua_type(L, 1) == LUA_TLIGHTUSERDATA) {
+		// copy it, the proxies should keep the document
+		void * ud = lua_newuserdatauv(L, len, 0);
+		memcpy(ud, data, len);
+		data = (const uint8_t *)ud;
+	} else if (lua_rawlen(L, 1) < len) {
+		return luaL_error(L, "Invalid bson block (%d:%d)", (int)lua_rawlen(L, 1), len);
+	}
+	struct bson_lazy lazy = {
+		data,
+		lua_gettop(L),
+		lua_upvalueindex(1),
+		lua_upvalueindex(2),
+		lua_upvalueindex(3),
+	};
+	struct bson_reader br = { data , len };
+	unpack_dict(L, &br, false, &lazy);
 
 	return 1;
 }
 
+static void
+lazy_closure(lua_State *L) {
+	lua_newtable(L);	// src : proxy -> document
+	lua_newtable(L);
+	lua_pushliteral(L, "k");
+	lua_setfield(L, -2, "__mode");
+	lua_pushvalue(L, -1);
+	lua_setmetatable(L, -3);
+	lua_newtable(L);	// pos : proxy -> offset << 1 | array
+	lua_pushvalue(L, -2);
+	lua_setmetatable(L, -2);
+	lua_replace(L, -2);
+	lua_newtable(L);	// meta
+	luaL_Reg l[] = {
+		{ "__index", lazy_index },
+		{ "__newindex", lazy_newindex },
+		{ "__len", lazy_len },
+		{ "__pairs", lazy_pairs },
+		{ NULL, NULL },
+	};
+	int i;
+	for (i=0;l[i].name;i++) {
+		lua_pushvalue(L, -3);
+		lua_pushvalue(L, -3);
+		lua_pushvalue(L, -3);
+		lua_pushcclosure(L, l[i].func, 3);
+		lua_setfield(L, -2, l[i].name);
+	}
+	lua_pushcclosure(L, ldecode_lazy, 3);
+}
+
 static void
 bson_meta(lua_State *L) {
 	if (luaL_newmetatable(L, "bson")) {
@@ -1019,6 +1229,98 @@ lencode_order(lua_State *L) {
 	return 1;
 }
 
+// increase the decimal number in key, return the new length
+static inline int
+next_index(char *key, int len) {
+	int i = len - 1;
+	while (i >= 0 && key[i] == '9') {
+		key[i] = '0';
+		--i;
+	}
+	if (i < 0) {
+		memmove(key+1, key, len+1);
+		key[0] = '1';
+		return len+1;
+	}
+	++key[i];
+	return len;
+}
+
+/*
+	table documents (lua table or bson object)
+	return bson_array
+
+	Encode the documents into an array with one buffer (upvalue 1) reused among calls,
+	the index keys are increased in place.
+ */
+static int
+lencode_batch(lua_State *L) {
+	luaL_checktype(L, 1, LUA_TTABLE);
+	struct bson *b = (struct bson *)lua_touserdata(L, lua_upvalueindex(1));
+	lua_settop(L, 1);
+	luaL_checkstack(L, 16, NULL);
+	b->size = 0;
+	int length = reserve_length(b);
+	char key[32] = "0";
+	int klen = 1;
+	lua_Integer i, n = luaL_len(L, 1);
+	for (i=1;i<=n;i++) {
+		int t = lua_geti(L, 1, i);
+		switch (t) {
+		case LUA_TTABLE:
+			write_byte(b, BSON_DOCUMENT);
+			bson_reserve(b, klen + 1);
+			memcpy(b->ptr + b->size, key, klen + 1);
+			b->size += klen + 1;
+			if (luaL_getmetafield(L, -1, "__pairs") != LUA_TNIL) {
+				pack_meta_dict(L, b, 1);
+			} else {
+				pack_simple_dict(L, b, 1);
+			}
+			break;
+		case LUA_TUSERDATA:
+		case LUA_TLIGHTUSERDATA:
+			append_one(b, L, key, klen, 0);
+			break;
+		default:
+			return luaL_error(L, "Invalid document %d : %s", (int)i, lua_typename(L, t));
+		}
+		lua_pop(L, 1);
+		klen = next_index(key, klen);
+	}
+	write_byte(b,0);
+	write_length(b, b->size - length, length);
+	void * ud = lua_newuserdatauv(L, b->size, 0);
+	memcpy(ud, b->ptr, b->size);
+	if (luaL_newmetatable(L, "bson_array")) {
+		lua_pushcfunction(L, ltostring);
+		lua_setfield(L, -2, "__tostring");
+		lua_pushcfunction(L, llen);
+		lua_setfield(L, -2, "__len");
+	}
+	lua_setmetatable(L, -2);
+	return 1;
+}
+
+static int
+lbatch_gc(lua_State *L) {
+	struct bson *b = (struct bson *)lua_touserdata(L, 1);
+	bson_destroy(b);
+	bson_create(b);
+	return 0;
+}
+
+static void
+batch_closure(lua_State *L) {
+	struct bson *b = (struct bson *)lua_newuserdatauv(L, sizeof(*b), 0);
+	bson_create(b);
+	lua_newtable(L);
+	lua_pushcfunction(L, lbatch_gc);
+	lua_setfield(L, -2, "__gc");
+	lua_setmetatable(L, -2);
+	lua_pushcclosure(L, lencode_batch, 1);
+}
+
 static int
 ldate(lua_State *L) {
 	int d = luaL_checkinteger(L,1);
@@ -1356,6 +1658,10 @@ luaopen_bson(lua_State *L) {
 
 	typeclosure(L);
 	lua_setfield(L,-2,"type");
+	batch_closure(L);
+	lua_setfield(L,-2,"encode_batch");
+	lazy_closure(L);
+	lua_setfield(L,-2,"decode_lazy");
 	char null[] = { 0, BSON_NULL };
 	lua_pushlstring(L, null, sizeof(null));
 	lua_setfield(L,-2,"null");
@@ -21,6 +21,10 @@
 
 #define TEMP_LENGTH 0x8200
 #define MULTI_PART 0x8000
+// The payload size of each part of large message, the parts are framed into one buffer.
+#define STREAM_PART 0xff00
+#define STREAM_HEADER 7
+#define CLUSTER_BUFFER "CLUSTERBUFFER"
 
 static void
 fill_uint32(uint8_t * buf, uint32_t n) {
@@ -143,29 +147,43 @@ packreq_string(lua_State *L, int session, void * msg, uint32_t sz, int is_push)
 	}
 }
 
-static void
-packreq_multi(lua_State *L, int session, void * msg, uint32_t sz) {
-	uint8_t buf[TEMP_LENGTH];
-	int part = (sz - 1) / MULTI_PART + 1;
-	int i;
-	char *ptr = msg;
-	for (i=0;i<part;i++) {
+static inline uint32_t
+stream_size(uint32_t sz) {
+	uint32_t part = (sz - 1) / STREAM_PART + 1;
+	return sz + part * STREAM_HEADER;
+}
+
+/*
+	Frame all the parts of a large message into one buffer, the buffer is sent by one socket write.
+	is_response == 0 : multi req part
+	is_response == 1 : response multi part (3 : multi part, 4 : multi end)
+ */
+static uint8_t *
+pack_multi(lua_State *L, uint8_t *buf, uint32_t session, const char * ptr, uint32_t sz, int is_response) {
+	while (sz > 0) {
 		uint32_t s;
-		if (sz > MULTI_PART) {
-			s = MULTI_PART;
-			buf[2] = 2;
+		uint8_t type;
+		if (sz > STREAM_PART) {
+			s = STREAM_PART;
+			type = is_response ? 3 : 2;
 		} else {
 			s = sz;
-			buf[2] = 3;	// the last multi part
+			type = is_response ? 4 : 3;	// the last multi part
 		}
 		fill_header(L, buf, s+5);
-		fill_uint32(buf+3, (uint32_t)session);
-		memcpy(buf+7, ptr, s);
-		lua_pushlstring(L, (const char *)buf, s+7);
-		lua_rawseti(L, -2, i+1);
-		sz -= s;
+		if (is_response) {
+			fill_uint32(buf+2, session);
+			buf[6] = type;
+		} else {
+			buf[2] = type;
+			fill_uint32(buf+3, session);
+		}
+		memcpy(buf+STREAM_HEADER, ptr, s);
+		buf += s + STREAM_HEADER;
 		ptr += s;
+		sz -= s;
 	}
+	return buf;
 }
 
 static int
@@ -193,10 +211,14 @@ packrequest(lua_State *L, int is_push) {
 	}
 	lua_pushinteger(L, new_session);
 	if (multipak) {
-		lua_createtable(L, multipak, 0);
-		packreq_multi(L, session, msg, sz);
+		// the parts follows the request, as lightuserdata/size ; See socketchannel.lua channel:request
+		uint32_t stream_sz = stream_size(sz);
+		uint8_t * stream = skynet_malloc(stream_sz);
+		pack_multi(L, stream, (uint32_t)session, msg, sz, 0);
 		skynet_free(msg);
-		return 3;
+		lua_pushlightuserdata(L, stream);
+		lua_pushinteger(L, stream_sz);
+		return 4;
 	} else {
 		skynet_free(msg);
 		return 2;
@@ -299,7 +321,9 @@ unpackmreq_part(lua_State *L, const uint8_t * buf, int sz) {
 	uint32_t session = unpack_uint32(buf+1);
 	lua_pushboolean(L, 0);	// no address
 	lua_pushinteger(L, session);
-	return_buffer(L, (const char *)buf+5, sz-5);
+	// the part is not copied, it points into the message, and should be appended before yield
+	lua_pushlightuserdata(L, (void *)(buf+5));
+	lua_pushinteger(L, sz-5);
 	lua_pushboolean(L, padding);
 
 	return 5;
@@ -406,6 +430,8 @@ lunpackrequest(lua_State *L) {
 		type = 1, msg
 		type = 2, DWORD size
 		type = 3/4, msg
+
+	The large response is returned as lightuserdata/size, all the packages are framed in it.
  */
 /*
 	int session
@@ -437,39 +463,19 @@ lpackresponse(lua_State *L) {
 		}
 	} else {
 		if (sz > MULTI_PART) {
-			// return 
-			int part = (sz - 1) / MULTI_PART + 1;
-			lua_createtable(L, part+1, 0);
-			uint8_t buf[TEMP_LENGTH];
+			uint32_t stream_sz = 11 + stream_size(sz);
+			uint8_t * stream = skynet_malloc(stream_sz);
 
 			// multi part begin
-			fill_header(L, buf, 9);
-			fill_uint32(buf+2, session);
-			buf[6] = 2;
-			fill_uint32(buf+7, (uint32_t)sz);
-			lua_pushlstring(L, (const char *)buf, 11);
-			lua_rawseti(L, -2, 1);
-
-			char * ptr = msg;
-			int i;
-			for (i=0;i<part;i++) {
-				int s;
-				if (sz > MULTI_PART) {
-					s = MULTI_PART;
-					buf[6] = 3;
-				} else {
-					s = sz;
-					buf[6] = 4;
-				}
-				fill_header(L, buf, s+5);
-				fill_uint32(buf+2, session);
-				memcpy(buf+7,ptr,s);
-				lua_pushlstring(L, (const char *)buf, s+7);
-				lua_rawseti(L, -2, i+2);
-				sz -= s;
-				ptr += s;
-			}
-			return 1;
+			fill_header(L, stream, 9);
+			fill_uint32(stream+2, session);
+			stream[6] = 2;
+			fill_uint32(stream+7, (uint32_t)sz);
+			pack_multi(L, stream + 11, session, msg, sz, 1);
+
+			lua_pushlightuserdata(L, stream);
+			lua_pushinteger(L, stream_sz);
+			return 2;
 		}
 	}
 
@@ -484,13 +490,124 @@ lpackresponse(lua_State *L) {
 	return 1;
 }
 
+/*
+	The buffer to assemble a large message, preallocated by the size in the multi part header.
+ */
+struct cluster_buffer {
+	char * ptr;
+	uint32_t size;
+	uint32_t offset;
+};
+
+static int
+lbuffer_gc(lua_State *L) {
+	struct cluster_buffer * b = lua_touserdata(L, 1);
+	skynet_free(b->ptr);
+	b->ptr = NULL;
+	return 0;
+}
+
+static struct cluster_buffer *
+new_buffer(lua_State *L, uint32_t size) {
+	struct cluster_buffer * b = lua_newuserdatauv(L, sizeof(*b), 0);
+	b->ptr = NULL;
+	b->size = size;
+	b->offset = 0;
+	if (luaL_newmetatable(L, CLUSTER_BUFFER)) {
+		lua_pushcfunction(L, lbuffer_gc);
+		lua_setfield(L, -2, "__gc");
+	}
+	lua_setmetatable(L, -2);
+	b->ptr = skynet_malloc(size == 0 ? 1 : size);
+	return b;
+}
+
+static int
+append_buffer(struct cluster_buffer *b, const void * msg, size_t sz) {
+	if (b->ptr == NULL || sz > b->size - b->offset)
+		return 1;
+	memcpy(b->ptr + b->offset, msg, sz);
+	b->offset += sz;
+	return 0;
+}
+
+/*
+	integer size
+	return userdata buffer
+ */
+static int
+lbuffer(lua_State *L) {
+	lua_Integer size = luaL_checkinteger(L, 1);
+	if (size < 0 || size > UINT32_MAX)
+		return luaL_error(L, "Invalid buffer size %d", (int)size);
+	new_buffer(L, (uint32_t)size);
+	return 1;
+}
+
 /*
 	string packed response
+	table large (optional)
 	return integer session
 		boolean ok
 		string msg
 		boolean padding
+
+	If large is given, the multi parts are assembled into the buffer large[session], which is
+	created by the caller at multi begin (msg is the size of whole response). The buffer is returned
+	as msg at the end of multi part (padding is nil). large[session] may be a string instead, the
+	reason of the dropped response, then the parts are skipped and the response fails at the end.
  */
+static int
+unpackresponse_large(lua_State *L, const char *buf, size_t sz, uint32_t session) {
+	struct cluster_buffer * b = NULL;
+	switch(buf[4]) {
+	case 3:	// multi part
+	case 4:	// multi end
+		switch (lua_rawgeti(L, 2, session)) {
+		case LUA_TUSERDATA:
+			b = luaL_checkudata(L, -1, CLUSTER_BUFFER);
+			if (append_buffer(b, buf+5, sz-5)) {
+				b = NULL;
+				lua_pushliteral(L, "invalid large response");
+				lua_rawseti(L, 2, session);
+			}
+			break;
+		case LUA_TSTRING:
+			break;
+		default:
+			return 0;
+		}
+		lua_pushinteger(L, (lua_Integer)session);
+		if (buf[4] == 3) {
+			lua_pushboolean(L, 1);
+			lua_pushnil(L);
+			lua_pushboolean(L, 1);
+			return 4;
+		}
+		if (b == NULL) {
+			lua_rawgeti(L, 2, session);
+			lua_pushnil(L);
+			lua_rawseti(L, 2, session);
+			lua_pushboolean(L, 0);
+			lua_insert(L, -2);
+			return 3;
+		}
+		lua_pushnil(L);
+		lua_rawseti(L, 2, session);
+		if (b->offset != b->size) {
+			lua_pushboolean(L, 0);
+			lua_pushliteral(L, "incomplete large response");
+			return 3;
+		}
+		lua_pushboolean(L, 1);
+		lua_pushvalue(L, -3);
+		return 3;
+	default:
+		// multi begin returns the size, see below
+		return -1;
+	}
+}
+
 static int
 lunpackresponse(lua_State *L) {
 	size_t sz;
@@ -499,6 +616,11 @@ lunpackresponse(lua_State *L) {
 		return 0;
 	}
 	uint32_t session = unpack_uint32((const uint8_t *)buf);
+	if (lua_istable(L, 2)) {
+		int r = unpackresponse_large(L, buf, sz, session);
+		if (r >= 0)
+			return r;
+	}
 	lua_pushinteger(L, (lua_Integer)session);
 	switch(buf[4]) {
 	case 0:	// error
@@ -530,14 +652,25 @@ lunpackresponse(lua_State *L) {
 }
 
 /*
-	table
+	table/buffer
 	pointer
 	sz
 
-	push (pointer/sz) as string into table, and free pointer
+	push (pointer/sz) as string into table, or copy it into the buffer.
+	The pointer is not freed, it's the multi part returned by unpackrequest.
+	For buffer, return false if it overflows.
  */
 static int
 lappend(lua_State *L) {
+	struct cluster_buffer * b = luaL_testudata(L, 1, CLUSTER_BUFFER);
+	if (b) {
+		void * buffer = lua_touserdata(L, 2);
+		if (buffer == NULL)
+			return luaL_error(L, "Need lightuserdata");
+		lua_Integer sz = luaL_checkinteger(L, 3);
+		lua_pushboolean(L, sz >= 0 && append_buffer(b, buffer, (size_t)sz) == 0);
+		return 1;
+	}
 	luaL_checktype(L, 1, LUA_TTABLE);
 	int n = lua_rawlen(L, 1);
 	if (lua_isnil(L, 2)) {
@@ -550,13 +683,27 @@ lappend(lua_State *L) {
 		return luaL_error(L, "Need lightuserdata");
 	int sz = luaL_checkinteger(L, 3);
 	lua_pushlstring(L, (const char *)buffer, sz);
-	skynet_free((void *)buffer);
 	lua_seti(L, 1, n+1);
 	return 0;
 }
 
+/*
+	table/buffer
+	return lightuserdata, sz
+
+	The ownership of the buffer is moved to the caller.
+ */
 static int
 lconcat(lua_State *L) {
+	struct cluster_buffer * b = luaL_testudata(L, 1, CLUSTER_BUFFER);
+	if (b) {
+		if (b->ptr == NULL || b->offset != b->size)
+			return 0;
+		lua_pushlightuserdata(L, b->ptr);
+		lua_pushinteger(L, b->size);
+		b->ptr = NULL;
+		return 2;
+	}
 	if (!lua_istable(L,1))
 		return 0;
 	if (lua_geti(L,1,1) != LUA_TNUMBER)
@@ -624,6 +771,7 @@ luaopen_skynet_cluster_core(lua_State *L) {
 		{ "unpackrequest", lunpackrequest },
 		{ "packresponse", lpackresponse },
 		{ "unpackresponse", lunpackresponse },
+		{ "buffer", lbuffer },
 		{ "append", lappend },
 		{ "concat", lconcat },
 		{ "isname", lisname },
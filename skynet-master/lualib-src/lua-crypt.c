@@ -9,6 +9,11 @@
 #include <stdlib.h>
 #include <unistd.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define CRYPT_SSE2
+#endif
+
 #define PADDING_MODE_ISO7816_4 0
 #define PADDING_MODE_PKCS7 1
 #define PADDING_MODE_COUNT 2
@@ -550,6 +555,80 @@ lhashkey(lua_State *L) {
 	return 1;
 }
 
+#ifdef CRYPT_SSE2
+
+// 0-15 to '0'-'9','a'-'f'
+static inline __m128i
+hex_char(__m128i n) {
+	__m128i alpha = _mm_cmpgt_epi8(n, _mm_set1_epi8(9));
+	n = _mm_add_epi8(n, _mm_set1_epi8('0'));
+	return _mm_add_epi8(n, _mm_and_si128(alpha, _mm_set1_epi8('a' - '0' - 10)));
+}
+
+// encode 16 bytes each time, return the bytes encoded
+static size_t
+tohex_bulk(const uint8_t *text, char *buffer, size_t sz) {
+	const __m128i mask = _mm_set1_epi8(0x0f);
+	size_t i;
+	for (i=0;i+16<=sz;i+=16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(text+i));
+		__m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), mask);
+		__m128i lo = _mm_and_si128(v, mask);
+		_mm_storeu_si128((__m128i *)(buffer+i*2), hex_char(_mm_unpacklo_epi8(hi, lo)));
+		_mm_storeu_si128((__m128i *)(buffer+i*2+16), hex_char(_mm_unpackhi_epi8(hi, lo)));
+	}
+	return i;
+}
+
+// 16 chars to 16 values (0-15), return 0 if there is a char not in '0'-'9','a'-'f'
+static inline int
+hex_value(__m128i c, __m128i *v) {
+	__m128i d = _mm_sub_epi8(c, _mm_set1_epi8('0'));
+	__m128i a = _mm_sub_epi8(c, _mm_set1_epi8('a'));
+	__m128i digit = _mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8(9)), d);
+	__m128i alpha = _mm_cmpeq_epi8(_mm_min_epu8(a, _mm_set1_epi8(5)), a);
+	if (_mm_movemask_epi8(_mm_or_si128(digit, alpha)) != 0xffff)
+		return 0;
+	a = _mm_add_epi8(a, _mm_set1_epi8(10));
+	*v = _mm_or_si128(_mm_and_si128(digit, d), _mm_and_si128(alpha, a));
+	return 1;
+}
+
+// the high nibble is in the low byte of each 16bit lane
+static inline __m128i
+hex_pair(__m128i v) {
+	__m128i hi = _mm_slli_epi16(_mm_and_si128(v, _mm_set1_epi16(0xff)), 4);
+	return _mm_or_si128(hi, _mm_srli_epi16(v, 8));
+}
+
+// decode 32 chars each time, stop at the first invalid block, return the chars decoded
+static size_t
+fromhex_bulk(const char *text, uint8_t *buffer, size_t sz) {
+	size_t i;
+	for (i=0;i+32<=sz;i+=32) {
+		__m128i a, b;
+		if (!hex_value(_mm_loadu_si128((const __m128i *)(text+i)), &a) ||
+			!hex_value(_mm_loadu_si128((const __m128i *)(text+i+16)), &b))
+			break;
+		_mm_storeu_si128((__m128i *)(buffer+i/2), _mm_packus_epi16(hex_pair(a), hex_pair(b)));
+	}
+	return i;
+}
+
+#else
+
+static inline size_t
+tohex_bulk(const uint8_t *text, char *buffer, size_t sz) {
+	return 0;
+}
+
+static inline size_t
+fromhex_bulk(const char *text, uint8_t *buffer, size_t sz) {
+	return 0;
+}
+
+#endif
+
 static int
 ltohex(lua_State *L) {
 	static char hex[] = "0123456789abcdef";
@@ -560,8 +639,8 @@ ltohex(lua_State *L) {
 	if (sz > SMALL_CHUNK/2) {
 		buffer = (char*)lua_newuserdatauv(L, sz * 2, 0);
 	}
-	int i;
-	for (i=0;i<sz;i++) {
+	int i = (int)tohex_bulk(text, buffer, sz);
+	for (;i<sz;i++) {
 		buffer[i*2] = hex[text[i] >> 4];
 		buffer[i*2+1] = hex[text[i] & 0xf];
 	}
@@ -583,8 +662,8 @@ lfromhex(lua_State *L) {
 	if (sz > SMALL_CHUNK*2) {
 		buffer = (char*)lua_newuserdatauv(L, sz / 2, 0);
 	}
-	int i;
-	for (i=0;i<sz;i+=2) {
+	int i = (int)fromhex_bulk(text, (uint8_t *)buffer, sz);
+	for (;i<sz;i+=2) {
 		uint8_t hi,low;
 		HEX(hi, text[i]);
 		HEX(low, text[i+1]);
@@ -792,6 +871,22 @@ lhmac_hash(lua_State *L) {
 // The biggest 64bit prime
 #define P 0xffffffffffffffc5ull
 
+#if defined(__SIZEOF_INT128__)
+
+// P = 2^64 - 59, so hi * 2^64 + lo = hi * 59 + lo (mod P)
+static inline uint64_t
+mul_mod_p(uint64_t a, uint64_t b) {
+	unsigned __int128 x = (unsigned __int128)a * b;
+	x = (unsigned __int128)(uint64_t)(x >> 64) * 59 + (uint64_t)x;	// < 2^71
+	x = (unsigned __int128)(uint64_t)(x >> 64) * 59 + (uint64_t)x;	// < 2^64 + 128 * 59
+	uint64_t m = (uint64_t)x + (uint64_t)(x >> 64) * 59;
+	if (m >= P)
+		m -= P;
+	return m;
+}
+
+#else
+
 static inline uint64_t
 mul_mod_p(uint64_t a, uint64_t b) {
 	uint64_t m = 0;
@@ -814,6 +909,8 @@ mul_mod_p(uint64_t a, uint64_t b) {
 	return m;
 }
 
+#endif
+
 static inline uint64_t
 pow_mod_p(uint64_t a, uint64_t b) {
 	if (b==1) {
@@ -887,6 +984,70 @@ ldhexchange(lua_State *L) {
 	return 1;
 }
 
+static uint64_t
+batch_key(lua_State *L, int tbl, int i, const char * what, int nonzero) {
+	size_t sz = 0;
+	lua_geti(L, tbl, i);
+	const uint8_t *x = (const uint8_t *)lua_tolstring(L, -1, &sz);
+	if (x == NULL || sz != 8) {
+		luaL_error(L, "Invalid %s [%d]", what, i);
+	}
+	uint64_t r = (uint64_t)(x[0] | x[1]<<8 | x[2]<<16 | (uint32_t)x[3]<<24) |
+		(uint64_t)(x[4] | x[5]<<8 | x[6]<<16 | (uint32_t)x[7]<<24) << 32;
+	lua_pop(L, 1);
+	if (nonzero && r == 0) {
+		luaL_error(L, "Invalid %s [%d] : Can't be 0", what, i);
+	}
+	return r;
+}
+
+/*
+	table clientkeys, table serverkeys [, table challenges]
+	return table exchanges, table secrets [, table hmacs]
+
+	The server side of the handshake (see snax/loginserver) for many clients in one call :
+	exchanges[i] = dhexchange(serverkeys[i])
+	secrets[i] = dhsecret(clientkeys[i], serverkeys[i])
+	hmacs[i] = hmac64(challenges[i], secrets[i])
+ */
+static int
+lhandshake_batch(lua_State *L) {
+	luaL_checktype(L, 1, LUA_TTABLE);
+	luaL_checktype(L, 2, LUA_TTABLE);
+	int challenge = !lua_isnoneornil(L, 3);
+	if (challenge) {
+		luaL_checktype(L, 3, LUA_TTABLE);
+	}
+	lua_settop(L, 3);
+	int n = (int)luaL_len(L, 1);
+	if (luaL_len(L, 2) != n || (challenge && luaL_len(L, 3) != n)) {
+		return luaL_error(L, "The number of keys mismatch");
+	}
+	lua_createtable(L, n, 0);	// 4 exchanges
+	lua_createtable(L, n, 0);	// 5 secrets
+	lua_createtable(L, challenge ? n : 0, 0);	// 6 hmacs
+	int i;
+	for (i=1;i<=n;i++) {
+		uint64_t clientkey = batch_key(L, 1, i, "clientkey", 1);
+		uint64_t serverkey = batch_key(L, 2, i, "serverkey", 1);
+		push64(L, powmodp(G, serverkey));
+		lua_rawseti(L, 4, i);
+		uint64_t secret = powmodp(clientkey, serverkey);
+		push64(L, secret);
+		lua_rawseti(L, 5, i);
+		if (challenge) {
+			uint64_t c = batch_key(L, 3, i, "challenge", 0);
+			uint32_t x[2] = { (uint32_t)c, (uint32_t)(c >> 32) };
+			uint32_t y[2] = { (uint32_t)secret, (uint32_t)(secret >> 32) };
+			uint32_t result[2];
+			hmac(x, y, result);
+			pushqword(L, result);
+			lua_rawseti(L, 6, i);
+		}
+	}
+	return challenge ? 3 : 2;
+}
+
 // base64
 
 static int
@@ -1019,10 +1180,33 @@ lxor_str(lua_State *L) {
 	if (len2 == 0) {
 		return luaL_error(L, "Can't xor empty string");
 	}
+	// repeat s2 to len2 + 16 bytes, so we can xor 16 bytes at any offset of s2
+	char tmp[SMALL_CHUNK];
+	char * key = tmp;
+	if (len1 >= 16) {
+		if (len2 + 16 > SMALL_CHUNK) {
+			key = (char *)lua_newuserdatauv(L, len2 + 16, 0);
+		}
+		memcpy(key, s2, len2);
+		size_t j;
+		for (j=len2;j<len2+16;j++) {
+			key[j] = key[j-len2];
+		}
+	}
 	luaL_Buffer b;
 	char * buffer = luaL_buffinitsize(L, &b, len1);
-	int i;
-	for (i=0;i<len1;i++) {
+	size_t i;
+	size_t off = 0;
+	for (i=0;i+16<=len1;i+=16) {
+		uint64_t x[2], k[2];
+		memcpy(x, s1+i, 16);
+		memcpy(k, key+off, 16);
+		x[0] ^= k[0];
+		x[1] ^= k[1];
+		memcpy(buffer+i, x, 16);
+		off = (off + 16) % len2;
+	}
+	for (;i<len1;i++) {
 		buffer[i] = s1[i] ^ s2[i % len2];
 	}
 	luaL_addsize(&b, len1);
@@ -1055,6 +1239,7 @@ luaopen_skynet_crypt(lua_State *L) {
 		{ "hmac64_md5", lhmac64_md5 },
 		{ "dhexchange", ldhexchange },
 		{ "dhsecret", ldhsecret },
+		{ "handshake_batch", lhandshake_batch },
 		{ "base64encode", lb64encode },
 		{ "base64decode", lb64decode },
 		{ "sha1", lsha1 },
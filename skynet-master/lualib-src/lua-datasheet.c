@@ -1,6 +1,16 @@
 #include <lua.h>
 #include <lauxlib.h>
 #include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 #define NODECACHE "_ctable"
 #define PROXYCACHE "_proxy"
@@ -16,6 +26,16 @@
 
 #define INVALID_OFFSET 0xffffffff
 
+// datasheet file (see tools/mkdatasheet.lua) : header + document
+#define FILE_MAGIC "SKYSHEET"
+#define FILE_VERSION 1
+#define FILE_HEADER 16
+
+struct mapfile {
+	void * ptr;
+	size_t sz;
+};
+
 struct proxy {
 	const char * data;
 	int index;
@@ -354,6 +374,127 @@ lstringpointer(lua_State *L) {
 	return 1;
 }
 
+#ifdef _WIN32
+
+static void *
+mapfile(const char *filename, size_t *sz) {
+	FILE *f = fopen(filename, "rb");
+	if (f == NULL)
+		return NULL;
+	fseek(f, 0, SEEK_END);
+	long n = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	void * ptr = NULL;
+	if (n > 0) {
+		ptr = malloc(n);
+		if (fread(ptr, 1, n, f) != n) {
+			free(ptr);
+			ptr = NULL;
+		}
+	}
+	fclose(f);
+	*sz = n;
+	return ptr;
+}
+
+static void
+unmapfile(void *ptr, size_t sz) {
+	free(ptr);
+}
+
+#else
+
+static void *
+mapfile(const char *filename, size_t *sz) {
+	int fd = open(filename, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		close(fd);
+		return NULL;
+	}
+	// read only and shared, so the processes on the same host share the page cache
+	void * ptr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (ptr == MAP_FAILED)
+		return NULL;
+	*sz = st.st_size;
+	return ptr;
+}
+
+static void
+unmapfile(void *ptr, size_t sz) {
+	munmap(ptr, sz);
+}
+
+#endif
+
+static int
+lunmap(lua_State *L) {
+	struct mapfile * m = lua_touserdata(L, 1);
+	if (m->ptr) {
+		unmapfile(m->ptr, m->sz);
+		m->ptr = NULL;
+	}
+	return 0;
+}
+
+static struct mapfile *
+checkmap(lua_State *L, int index) {
+	struct mapfile * m = luaL_checkudata(L, index, FILE_MAGIC);
+	if (m->ptr == NULL)
+		luaL_error(L, "Datasheet file is closed");
+	return m;
+}
+
+// mapfile(filename) returns a file object, the mapping is released by gc
+static int
+lmapfile(lua_State *L) {
+	const char * filename = luaL_checkstring(L, 1);
+	struct mapfile * m = lua_newuserdatauv(L, sizeof(*m), 0);
+	m->ptr = NULL;
+	m->sz = 0;
+	if (luaL_newmetatable(L, FILE_MAGIC)) {
+		lua_pushcfunction(L, lunmap);
+		lua_setfield(L, -2, "__gc");
+	}
+	lua_setmetatable(L, -2);
+	size_t sz = 0;
+	void * ptr = mapfile(filename, &sz);
+	if (ptr == NULL)
+		return luaL_error(L, "Can't map datasheet file %s", filename);
+	m->ptr = ptr;
+	m->sz = sz;
+	const uint8_t * h = ptr;
+	if (sz < FILE_HEADER + 8 || memcmp(h, FILE_MAGIC, 8) != 0)
+		return luaL_error(L, "Invalid datasheet file %s", filename);
+	uint32_t version = getuint32(h + 8);
+	uint32_t docsz = getuint32(h + 12);
+	if (version != FILE_VERSION || docsz != sz - FILE_HEADER)
+		return luaL_error(L, "Invalid datasheet file %s (version = %d, size = %d)", filename, (int)version, (int)docsz);
+	const struct document * doc = (const struct document *)(h + FILE_HEADER);
+	if (getuint32(&doc->strtbl) > docsz || 8 + (size_t)getuint32(&doc->n) * 4 > docsz)
+		return luaL_error(L, "Invalid datasheet file %s (corrupted)", filename);
+	return 1;
+}
+
+// the document pointer for datasheet service, like stringpointer
+static int
+lmappointer(lua_State *L) {
+	struct mapfile * m = checkmap(L, 1);
+	lua_pushlightuserdata(L, (char *)m->ptr + FILE_HEADER);
+	return 1;
+}
+
+// copy the document into a string, builder.update needs it to make diff
+static int
+lmapstring(lua_State *L) {
+	struct mapfile * m = checkmap(L, 1);
+	lua_pushlstring(L, (const char *)m->ptr + FILE_HEADER, m->sz - FILE_HEADER);
+	return 1;
+}
+
 LUAMOD_API int
 luaopen_skynet_datasheet_core(lua_State *L) {
 	luaL_checkversion(L);
@@ -368,5 +509,11 @@ luaopen_skynet_datasheet_core(lua_State *L) {
 	luaL_setfuncs(L, l, 1);
 	lua_pushcfunction(L, lstringpointer);
 	lua_setfield(L, -2, "stringpointer");
+	lua_pushcfunction(L, lmapfile);
+	lua_setfield(L, -2, "mapfile");
+	lua_pushcfunction(L, lmappointer);
+	lua_setfield(L, -2, "mappointer");
+	lua_pushcfunction(L, lmapstring);
+	lua_setfield(L, -2, "mapstring");
 	return 1;
 }
@@ -92,6 +92,61 @@ lprofactive(lua_State *L) {
 	return 1;
 }
 
+/*
+	integer n (default 10)
+
+	return { { handle, mem, rate } ... } sorted by mem in use, rate is allocated bytes per second since last query
+ */
+static int
+ltop(lua_State *L) {
+	int n = luaL_optinteger(L, 1, 10);
+	if (n <= 0) {
+		lua_newtable(L);
+		return 1;
+	}
+	struct malloc_top * top = lua_newuserdatauv(L, n * sizeof(*top), 0);
+	n = malloc_memory_top(top, n);
+	lua_createtable(L, n, 0);
+	int i;
+	for (i=0;i<n;i++) {
+		lua_createtable(L, 3, 0);
+		lua_pushinteger(L, top[i].handle);
+		lua_rawseti(L, -2, 1);
+		lua_pushinteger(L, (lua_Integer)top[i].mem);
+		lua_rawseti(L, -2, 2);
+		lua_pushnumber(L, top[i].rate);
+		lua_rawseti(L, -2, 3);
+		lua_rawseti(L, -2, i+1);
+	}
+	return 1;
+}
+
+/*
+	integer interval (optional, 0 turns off)
+
+	return current interval
+ */
+static int
+lheapsample(lua_State *L) {
+	if (!lua_isnoneornil(L, 1)) {
+		lua_Integer interval = luaL_checkinteger(L, 1);
+		malloc_heap_sample(interval > 0 ? (size_t)interval : 0);
+	}
+	lua_pushinteger(L, (lua_Integer)malloc_heap_sample_interval());
+	return 1;
+}
+
+static int
+lheapprof(lua_State *L) {
+	const char * filename = luaL_checkstring(L, 1);
+	int n = malloc_heap_dump(filename);
+	if (n < 0) {
+		return luaL_error(L, "Can't dump heap samples to %s", filename);
+	}
+	lua_pushinteger(L, n);
+	return 1;
+}
+
 LUAMOD_API int
 luaopen_skynet_memory(lua_State *L) {
 	luaL_checkversion(L);
@@ -105,6 +160,9 @@ luaopen_skynet_memory(lua_State *L) {
 		{ "dump", ldump },
 		{ "info", dump_mem_lua },
 		{ "current", lcurrent },
+		{ "top", ltop },
+		{ "heapsample", lheapsample },
+		{ "heapprof", lheapprof },
 		{ "dumpheap", ldumpheap },
 		{ "profactive", lprofactive },
 		{ NULL, NULL },
@@ -28,10 +28,47 @@
 	Each package is uint16 + data , uint16 (serialized in big-endian) is the number of bytes comprising the data .
  */
 
+/*
+	filterview returns the packages as views (userdata NETPACK_VIEW) instead of malloced buffers.
+	A view points into a block, which is the socket buffer itself when the whole package is in one read,
+	or a pooled buffer for the package across reads. So the package is never copied in the first case.
+	The block is freed (or back to the pool) when all the views on it are released (by gc, close or release).
+ */
+
+#define VIEW_METATABLE "NETPACK_VIEW"
+// pooled buffer size classes : 256 << (cls-1) , class 0 is the block header of a socket buffer
+#define POOL_CLASSES 10
+#define POOL_KEEP 16
+
+struct pool;
+
+struct block {
+	int ref;
+	int cls;
+	struct pool * pool;
+	uint8_t * data;
+	struct block * next;
+};
+
+struct pool {
+	int ref;	// the queue and the living blocks
+	int closed;
+	int n[POOL_CLASSES];
+	struct block * free[POOL_CLASSES];
+};
+
+// The layout of the first two fields is shared with sproto (see getbuffer in lsproto.c)
+struct view {
+	const uint8_t * ptr;
+	size_t sz;
+	struct block * block;
+};
+
 struct netpack {
 	int id;
 	int size;
 	void * buffer;
+	struct block * block;	// NULL for malloced buffer
 };
 
 struct uncomplete {
@@ -45,14 +82,111 @@ struct queue {
 	int cap;
 	int head;
 	int tail;
+	struct pool * pool;	// for filterview
 	struct uncomplete * hash[HASHSIZE];
 	struct netpack queue[QUEUESIZE];
 };
 
+static struct pool *
+pool_new(void) {
+	struct pool * p = skynet_malloc(sizeof(*p));
+	memset(p, 0, sizeof(*p));
+	p->ref = 1;
+	return p;
+}
+
+static void
+pool_clear(struct pool *p) {
+	int i;
+	for (i=0;i<POOL_CLASSES;i++) {
+		struct block * b = p->free[i];
+		while (b) {
+			struct block * next = b->next;
+			skynet_free(b);
+			b = next;
+		}
+		p->free[i] = NULL;
+		p->n[i] = 0;
+	}
+}
+
+static void
+pool_release(struct pool *p) {
+	if (--p->ref == 0) {
+		pool_clear(p);
+		skynet_free(p);
+	}
+}
+
+static struct block *
+block_alloc(struct pool *p, int cls) {
+	struct block * b = p->free[cls];
+	if (b) {
+		p->free[cls] = b->next;
+		--p->n[cls];
+	} else {
+		size_t cap = cls == 0 ? 0 : (size_t)256 << (cls - 1);
+		b = skynet_malloc(sizeof(*b) + cap);
+		b->cls = cls;
+		b->data = cls == 0 ? NULL : (uint8_t *)(b+1);
+	}
+	b->ref = 1;
+	b->pool = p;
+	b->next = NULL;
+	++p->ref;
+	return b;
+}
+
+// a pooled buffer for the package of size
+static struct block *
+block_new(struct pool *p, int size) {
+	int cls = 1;
+	while (((size_t)256 << (cls - 1)) < size) {
+		++cls;
+	}
+	return block_alloc(p, cls);
+}
+
+// the socket buffer (malloced in socket_server.c) is freed with the block
+static struct block *
+block_socket(struct pool *p, uint8_t *buffer) {
+	struct block * b = block_alloc(p, 0);
+	b->data = buffer;
+	return b;
+}
+
+static void
+block_release(struct block *b) {
+	if (--b->ref > 0)
+		return;
+	struct pool * p = b->pool;
+	if (b->cls == 0) {
+		skynet_free(b->data);
+		b->data = NULL;
+	}
+	if (!p->closed && p->n[b->cls] < POOL_KEEP) {
+		b->next = p->free[b->cls];
+		p->free[b->cls] = b;
+		++p->n[b->cls];
+	} else {
+		skynet_free(b);
+	}
+	pool_release(p);
+}
+
+static void
+free_pack(struct netpack *np) {
+	if (np->block) {
+		block_release(np->block);
+	} else {
+		skynet_free(np->buffer);
+	}
+}
+
 static void
 clear_list(struct uncomplete * uc) {
 	while (uc) {
-		skynet_free(uc->pack.buffer);
+		free_pack(&uc->pack);
 		void * tmp = uc;
 		uc = uc->next;
 		skynet_free(tmp);
@@ -75,9 +209,16 @@ lclear(lua_State *L) {
 	}
 	for (i=q->head;i<q->tail;i++) {
 		struct netpack *np = &q->queue[i % q->cap];
-		skynet_free(np->buffer);
+		free_pack(np);
 	}
 	q->head = q->tail = 0;
+	if (q->pool) {
+		// the living views still hold the pool
+		q->pool->closed = 1;
+		pool_clear(q->pool);
+		pool_release(q->pool);
+		q->pool = NULL;
+	}
 
 	return 0;
 }
@@ -122,6 +263,7 @@ get_queue(lua_State *L) {
 		q->cap = QUEUESIZE;
 		q->head = 0;
 		q->tail = 0;
+		q->pool = NULL;
 		int i;
 		for (i=0;i<HASHSIZE;i++) {
 			q->hash[i] = NULL;
@@ -137,6 +279,8 @@ expand_queue(lua_State *L, struct queue *q) {
 	nq->cap = q->cap + QUEUESIZE;
 	nq->head = 0;
 	nq->tail = q->cap;
+	nq->pool = q->pool;
+	q->pool = NULL;
 	memcpy(nq->hash, q->hash, sizeof(nq->hash));
 	memset(q->hash, 0, sizeof(q->hash));
 	int i;
@@ -148,12 +292,18 @@ expand_queue(lua_State *L, struct queue *q) {
 	lua_replace(L,1);
 }
 
+// clone : the buffer is in the socket buffer, share the block (sb) or make a copy if sb is NULL
+// or else, move the buffer (and its block) into the queue
 static void
-push_data(lua_State *L, int fd, void *buffer, int size, int clone) {
+push_data(lua_State *L, int fd, void *buffer, int size, int clone, struct block *sb) {
 	if (clone) {
-		void * tmp = skynet_malloc(size);
-		memcpy(tmp, buffer, size);
-		buffer = tmp;
+		if (sb) {
+			++sb->ref;
+		} else {
+			void * tmp = skynet_malloc(size);
+			memcpy(tmp, buffer, size);
+			buffer = tmp;
+		}
 	}
 	struct queue *q = get_queue(L);
 	struct netpack *np = &q->queue[q->tail];
@@ -162,6 +312,7 @@ push_data(lua_State *L, int fd, void *buffer, int size, int clone) {
 	np->id = fd;
 	np->buffer = buffer;
 	np->size = size;
+	np->block = sb;
 	if (q->head == q->tail) {
 		expand_queue(L, q);
 	}
@@ -180,6 +331,37 @@ save_uncomplete(lua_State *L, int fd) {
 	return uc;
 }
 
+static void
+alloc_pack(struct netpack *pack, int size, struct pool *pool) {
+	pack->size = size;
+	if (pool) {
+		pack->block = block_new(pool, size);
+		pack->buffer = pack->block->data;
+	} else {
+		pack->buffer = skynet_malloc(size);
+	}
+}
+
+static void
+push_view(lua_State *L, const void *ptr, int size, struct block *b) {
+	struct view * v = lua_newuserdatauv(L, sizeof(*v), 0);
+	v->ptr = (const uint8_t *)ptr;
+	v->sz = size;
+	v->block = b;
+	luaL_setmetatable(L, VIEW_METATABLE);
+}
+
+// lightuserdata (ownership to lua) or view
+static void
+push_pack(lua_State *L, void *buffer, int size, struct block *b) {
+	if (b) {
+		push_view(L, buffer, size, b);
+	} else {
+		lua_pushlightuserdata(L, buffer);
+	}
+	lua_pushinteger(L, size);
+}
+
 static inline int
 read_size(uint8_t * buffer) {
 	int r = (int)buffer[0] << 8 | (int)buffer[1];
@@ -187,7 +369,7 @@ read_size(uint8_t * buffer) {
 }
 
 static void
-push_more(lua_State *L, int fd, uint8_t *buffer, int size) {
+push_more(lua_State *L, int fd, uint8_t *buffer, int size, struct pool *pool, struct block *sb) {
 	if (size == 1) {
 		struct uncomplete * uc = save_uncomplete(L, fd);
 		uc->read = -1;
@@ -201,17 +383,16 @@ push_more(lua_State *L, int fd, uint8_t *buffer, int size) {
 	if (size < pack_size) {
 		struct uncomplete * uc = save_uncomplete(L, fd);
 		uc->read = size;
-		uc->pack.size = pack_size;
-		uc->pack.buffer = skynet_malloc(pack_size);
+		alloc_pack(&uc->pack, pack_size, pool);
 		memcpy(uc->pack.buffer, buffer, size);
 		return;
 	}
-	push_data(L, fd, buffer, pack_size, 1);
+	push_data(L, fd, buffer, pack_size, 1, sb);
 
 	buffer += pack_size;
 	size -= pack_size;
 	if (size > 0) {
-		push_more(L, fd, buffer, size);
+		push_more(L, fd, buffer, size, pool, sb);
 	}
 }
 
@@ -220,13 +401,14 @@ close_uncomplete(lua_State *L, int fd) {
 	struct queue *q = lua_touserdata(L,1);
 	struct uncomplete * uc = find_uncomplete(q, fd);
 	if (uc) {
-		skynet_free(uc->pack.buffer);
+		free_pack(&uc->pack);
 		skynet_free(uc);
 	}
 }
 
+// pool and sb (the block of socket buffer) are NULL if not in view mode
 static int
-filter_data_(lua_State *L, int fd, uint8_t * buffer, int size) {
+filter_data_(lua_State *L, int fd, uint8_t * buffer, int size, struct pool *pool, struct block *sb) {
 	struct queue *q = lua_touserdata(L,1);
 	struct uncomplete * uc = find_uncomplete(q, fd);
 	if (uc) {
@@ -238,8 +420,7 @@ filter_data_(lua_State *L, int fd, uint8_t * buffer, int size) {
 			pack_size |= uc->header << 8 ;
 			++buffer;
 			--size;
-			uc->pack.size = pack_size;
-			uc->pack.buffer = skynet_malloc(pack_size);
+			alloc_pack(&uc->pack, pack_size, pool);
 			uc->read = 0;
 		}
 		int need = uc->pack.size - uc->read;
@@ -257,15 +438,14 @@ filter_data_(lua_State *L, int fd, uint8_t * buffer, int size) {
 		if (size == 0) {
 			lua_pushvalue(L, lua_upvalueindex(TYPE_DATA));
 			lua_pushinteger(L, fd);
-			lua_pushlightuserdata(L, uc->pack.buffer);
-			lua_pushinteger(L, uc->pack.size);
+			push_pack(L, uc->pack.buffer, uc->pack.size, uc->pack.block);
 			skynet_free(uc);
 			return 5;
 		}
 		// more data
-		push_data(L, fd, uc->pack.buffer, uc->pack.size, 0);
+		push_data(L, fd, uc->pack.buffer, uc->pack.size, 0, uc->pack.block);
 		skynet_free(uc);
-		push_more(L, fd, buffer, size);
+		push_more(L, fd, buffer, size, pool, sb);
 		lua_pushvalue(L, lua_upvalueindex(TYPE_MORE));
 		return 2;
 	} else {
@@ -282,8 +462,7 @@ filter_data_(lua_State *L, int fd, uint8_t * buffer, int size) {
 		if (size < pack_size) {
 			struct uncomplete * uc = save_uncomplete(L, fd);
 			uc->read = size;
-			uc->pack.size = pack_size;
-			uc->pack.buffer = skynet_malloc(pack_size);
+			alloc_pack(&uc->pack, pack_size, pool);
 			memcpy(uc->pack.buffer, buffer, size);
 			return 1;
 		}
@@ -291,28 +470,46 @@ filter_data_(lua_State *L, int fd, uint8_t * buffer, int size) {
 			// just one package
 			lua_pushvalue(L, lua_upvalueindex(TYPE_DATA));
 			lua_pushinteger(L, fd);
-			void * result = skynet_malloc(pack_size);
-			memcpy(result, buffer, size);
-			lua_pushlightuserdata(L, result);
-			lua_pushinteger(L, size);
+			if (sb) {
+				++sb->ref;
+				push_view(L, buffer, size, sb);
+				lua_pushinteger(L, size);
+			} else {
+				void * result = skynet_malloc(pack_size);
+				memcpy(result, buffer, size);
+				lua_pushlightuserdata(L, result);
+				lua_pushinteger(L, size);
+			}
 			return 5;
 		}
 		// more data
-		push_data(L, fd, buffer, pack_size, 1);
+		push_data(L, fd, buffer, pack_size, 1, sb);
 		buffer += pack_size;
 		size -= pack_size;
-		push_more(L, fd, buffer, size);
+		push_more(L, fd, buffer, size, pool, sb);
 		lua_pushvalue(L, lua_upvalueindex(TYPE_MORE));
 		return 2;
 	}
 }
 
 static inline int
-filter_data(lua_State *L, int fd, uint8_t * buffer, int size) {
-	int ret = filter_data_(L, fd, buffer, size);
-	// buffer is the data of socket message, it malloc at socket_server.c : function forward_message .
-	// it should be free before return,
-	skynet_free(buffer);
+filter_data(lua_State *L, int fd, uint8_t * buffer, int size, int view) {
+	if (!view) {
+		int ret = filter_data_(L, fd, buffer, size, NULL, NULL);
+		// buffer is the data of socket message, it malloc at socket_server.c : function forward_message .
+		// it should be free before return,
+		skynet_free(buffer);
+		return ret;
+	}
+	struct queue *q = get_queue(L);
+	if (q->pool == NULL) {
+		q->pool = pool_new();
+	}
+	struct pool * pool = q->pool;
+	// the views of the packages in this buffer share it, it will be freed when all of them are released.
+	struct block * sb = block_socket(pool, buffer);
+	int ret = filter_data_(L, fd, buffer, size, pool, sb);
+	block_release(sb);
 	return ret;
 }
 
@@ -333,10 +530,10 @@ pushstring(lua_State *L, const char * msg, int size) {
 		userdata queue
 		integer type
 		integer fd
-		string msg | lightuserdata/integer
+		string msg | lightuserdata/integer | view/integer (filterview)
  */
 static int
-lfilter(lua_State *L) {
+filter(lua_State *L, int view) {
 	struct skynet_socket_message *message = lua_touserdata(L,2);
 	int size = luaL_checkinteger(L,3);
 	char * buffer = message->buffer;
@@ -353,7 +550,7 @@ lfilter(lua_State *L) {
 	case SKYNET_SOCKET_TYPE_DATA:
 		// ignore listen id (message->id)
 		assert(size == -1);	// never padding string
-		return filter_data(L, message->id, (uint8_t *)buffer, message->ud);
+		return filter_data(L, message->id, (uint8_t *)buffer, message->ud, view);
 	case SKYNET_SOCKET_TYPE_CONNECT:
 		lua_pushvalue(L, lua_upvalueindex(TYPE_INIT));
 		lua_pushinteger(L, message->id);
@@ -390,11 +587,21 @@ lfilter(lua_State *L) {
 	}
 }
 
+static int
+lfilter(lua_State *L) {
+	return filter(L, 0);
+}
+
+static int
+lfilterview(lua_State *L) {
+	return filter(L, 1);
+}
+
 /*
 	userdata queue
 	return
 		integer fd
-		lightuserdata msg
+		lightuserdata msg | view
 		integer size
  */
 static int
@@ -407,8 +614,7 @@ lpop(lua_State *L) {
 		q->head = 0;
 	}
 	lua_pushinteger(L, np->id);
-	lua_pushlightuserdata(L, np->buffer);
-	lua_pushinteger(L, np->size);
+	push_pack(L, np->buffer, np->size, np->block);
 
 	return 3;
 }
@@ -419,10 +625,23 @@ lpop(lua_State *L) {
 	lightuserdata/integer
  */
 
+static struct view *
+checkview(lua_State *L, int index) {
+	struct view * v = luaL_checkudata(L, index, VIEW_METATABLE);
+	if (v->block == NULL) {
+		luaL_error(L, "The view is released");
+	}
+	return v;
+}
+
 static const char *
 tolstring(lua_State *L, size_t *sz, int index) {
 	const char * ptr;
-	if (lua_isuserdata(L,index)) {
+	if (luaL_testudata(L, index, VIEW_METATABLE)) {
+		struct view * v = checkview(L, index);
+		ptr = (const char *)v->ptr;
+		*sz = v->sz;
+	} else if (lua_isuserdata(L,index)) {
 		ptr = (const char *)lua_touserdata(L,index);
 		*sz = (size_t)luaL_checkinteger(L, index+1);
 	} else {
@@ -457,6 +676,12 @@ lpack(lua_State *L) {
 
 static int
 ltostring(lua_State *L) {
+	if (luaL_testudata(L, 1, VIEW_METATABLE)) {
+		// the view is not released
+		struct view * v = checkview(L, 1);
+		lua_pushlstring(L, (const char *)v->ptr, v->sz);
+		return 1;
+	}
 	void * ptr = lua_touserdata(L, 1);
 	int size = luaL_checkinteger(L, 2);
 	if (ptr == NULL) {
@@ -468,6 +693,46 @@ ltostring(lua_State *L) {
 	return 1;
 }
 
+static int
+lrelease(lua_State *L) {
+	struct view * v = luaL_checkudata(L, 1, VIEW_METATABLE);
+	if (v->block) {
+		block_release(v->block);
+		v->block = NULL;
+		v->ptr = NULL;
+		v->sz = 0;
+	}
+	return 0;
+}
+
+static int
+lview_len(lua_State *L) {
+	struct view * v = luaL_checkudata(L, 1, VIEW_METATABLE);
+	lua_pushinteger(L, v->sz);
+	return 1;
+}
+
+static void
+view_metatable(lua_State *L) {
+	if (luaL_newmetatable(L, VIEW_METATABLE)) {
+		luaL_Reg l[] = {
+			{ "__gc", lrelease },
+			{ "__close", lrelease },
+			{ "__len", lview_len },
+			{ NULL, NULL },
+		};
+		luaL_setfuncs(L, l, 0);
+		luaL_Reg m[] = {
+			{ "release", lrelease },
+			{ "tostring", ltostring },
+			{ NULL, NULL },
+		};
+		luaL_newlib(L, m);
+		lua_setfield(L, -2, "__index");
+	}
+	lua_pop(L, 1);
+}
+
 LUAMOD_API int
 luaopen_skynet_netpack(lua_State *L) {
 	luaL_checkversion(L);
@@ -476,8 +741,10 @@ luaopen_skynet_netpack(lua_State *L) {
 		{ "pack", lpack },
 		{ "clear", lclear },
 		{ "tostring", ltostring },
+		{ "release", lrelease },
 		{ NULL, NULL },
 	};
+	view_metatable(L);
 	luaL_newlib(L,l);
 
 	// the order is same with macros : TYPE_* (defined top)
@@ -489,8 +756,15 @@ luaopen_skynet_netpack(lua_State *L) {
 	lua_pushliteral(L, "warning");
 	lua_pushliteral(L, "init");
 
+	int i;
+	for (i=0;i<7;i++) {
+		lua_pushvalue(L, -7);
+	}
 	lua_pushcclosure(L, lfilter, 7);
-	lua_setfield(L, -2, "filter");
+	lua_setfield(L, -9, "filter");
+
+	lua_pushcclosure(L, lfilterview, 7);
+	lua_setfield(L, -2, "filterview");
 
 	return 1;
 }
@@ -38,9 +38,13 @@ struct node {
 	uint8_t nocolliding;	// 0 means colliding slot
 };
 
+// The new version of a conf object reuses the unchanged tables of the old version (see lnewconf),
+// so a table may be shared by many versions, and its strings live in the lua_State of the version which creates it.
+// The lua_State is closed when all of its tables are deleted.
+
 struct state {
-	int dirty;
 	ATOM_INT ref;
+	int tables;	// the count of tables using this lua_State
 	struct table * root;
 };
 
@@ -51,12 +55,16 @@ struct table {
 	union value * array;
 	struct node * hash;
 	lua_State * L;
+	int ref;	// referenced by parent tables (of different versions)
+	int dirty;	// replaced in newer version
 };
 
 struct context {
 	lua_State * L;
 	struct table * tbl;
+	struct table * old;	// the same table in old version, or NULL
 	int string_index;
+	int tables;
 };
 
 struct ctrl {
@@ -120,9 +128,106 @@ stringindex(struct context *ctx, const char * str, size_t sz) {
 }
 
 static int convtable(lua_State *L);
+static struct node * lookup_key(struct table *tbl, uint32_t keyhash, int key, int keytype, const char *str, size_t sz);
+
+// find the table value of the same key in old version
+static struct table *
+find_old(struct context *ctx, lua_State *L, int keyindex, int arraykey) {
+	struct table * old = ctx->old;
+	if (old == NULL)
+		return NULL;
+	struct node * n;
+	if (keyindex == 0 || lua_type(L, keyindex) == LUA_TNUMBER) {
+		int key = keyindex == 0 ? arraykey : (int)lua_tointeger(L, keyindex);
+		if (key > 0 && key <= old->sizearray) {
+			if (old->arraytype[key-1] == VALUETYPE_TABLE)
+				return old->array[key-1].tbl;
+			return NULL;
+		}
+		n = lookup_key(old, (uint32_t)key, key, KEYTYPE_INTEGER, NULL, 0);
+	} else {
+		size_t sz = 0;
+		const char * str = lua_tolstring(L, keyindex, &sz);
+		n = lookup_key(old, calchash(str, sz), 0, KEYTYPE_STRING, str, sz);
+	}
+	if (n && n->valuetype == VALUETYPE_TABLE)
+		return n->v.tbl;
+	return NULL;
+}
+
+static int equaltable(lua_State *L, int index, struct table *tbl);
+
+static int
+equalvalue(lua_State *L, int index, struct table *tbl, uint8_t vt, union value *v) {
+	switch(lua_type(L, index)) {
+	case LUA_TNUMBER:
+		if (lua_isinteger(L, index)) {
+			return vt == VALUETYPE_INTEGER && v->d == lua_tointeger(L, index);
+		} else {
+			return vt == VALUETYPE_REAL && v->n == lua_tonumber(L, index);
+		}
+	case LUA_TSTRING: {
+		if (vt != VALUETYPE_STRING)
+			return 0;
+		size_t sz1 = 0, sz2 = 0;
+		const char * str1 = lua_tolstring(L, index, &sz1);
+		const char * str2 = lua_tolstring(tbl->L, v->string, &sz2);
+		return sz1 == sz2 && memcmp(str1, str2, sz1) == 0;
+	}
+	case LUA_TBOOLEAN:
+		return vt == VALUETYPE_BOOLEAN && v->boolean == lua_toboolean(L, index);
+	case LUA_TTABLE:
+		return vt == VALUETYPE_TABLE && equaltable(L, index, v->tbl);
+	default:
+		return 0;
+	}
+}
 
+// compare the lua table with the table of old version
+static int
+equaltable(lua_State *L, int index, struct table *tbl) {
+	index = lua_absindex(L, index);
+	if (lua_rawlen(L, index) != tbl->sizearray)
+		return 0;
+	luaL_checkstack(L, 3, NULL);
+	int i;
+	int n = tbl->sizehash;
+	for (i=0;i<tbl->sizearray;i++) {
+		if (tbl->arraytype[i] != VALUETYPE_NIL)
+			++n;
+	}
+	lua_pushnil(L);
+	while (lua_next(L, index) != 0) {
+		int eq = 0;
+		if (--n >= 0) {
+			int kt = lua_type(L, -2);
+			if (kt == LUA_TNUMBER && lua_isinteger(L, -2)) {
+				lua_Integer key = lua_tointeger(L, -2);
+				if (key > 0 && key <= tbl->sizearray) {
+					eq = equalvalue(L, -1, tbl, tbl->arraytype[key-1], &tbl->array[key-1]);
+				} else {
+					struct node * node = lookup_key(tbl, (uint32_t)key, (int)key, KEYTYPE_INTEGER, NULL, 0);
+					eq = node && equalvalue(L, -1, tbl, node->valuetype, &node->v);
+				}
+			} else if (kt == LUA_TSTRING) {
+				size_t sz = 0;
+				const char * str = lua_tolstring(L, -2, &sz);
+				struct node * node = lookup_key(tbl, calchash(str, sz), 0, KEYTYPE_STRING, str, sz);
+				eq = node && equalvalue(L, -1, tbl, node->valuetype, &node->v);
+			}
+		}
+		if (!eq) {
+			lua_pop(L, 2);
+			return 0;
+		}
+		lua_pop(L, 1);
+	}
+	return n == 0;
+}
+
+// keyindex is the absolute index of the key, or 0 for the array part (arraykey)
 static void
-setvalue(struct context * ctx, lua_State *L, int index, struct node *n) {
+setvalue(struct context * ctx, lua_State *L, int index, struct node *n, int keyindex, int arraykey) {
 	int vt = lua_type(L, index);
 	switch(vt) {
 	case LUA_TNIL:
@@ -149,7 +254,16 @@ setvalue(struct context * ctx, lua_State *L, int index, struct node *n) {
 		n->valuetype = VALUETYPE_BOOLEAN;
 		break;
 	case LUA_TTABLE: {
+		struct table *old = find_old(ctx, L, keyindex, arraykey);
+		if (old && equaltable(L, index, old)) {
+			// reuse the table of old version
+			++old->ref;
+			n->v.tbl = old;
+			n->valuetype = VALUETYPE_TABLE;
+			break;
+		}
 		struct table *tbl = ctx->tbl;
+		struct table *parent_old = ctx->old;
 		ctx->tbl = (struct table *)malloc(sizeof(struct table));
 		if (ctx->tbl == NULL) {
 			ctx->tbl = tbl;
@@ -157,6 +271,7 @@ setvalue(struct context * ctx, lua_State *L, int index, struct node *n) {
 			// never get here
 		}
 		memset(ctx->tbl, 0, sizeof(struct table));
+		ctx->old = old;
 		int absidx = lua_absindex(L, index);
 
 		lua_pushcfunction(L, convtable);
@@ -169,6 +284,7 @@ setvalue(struct context * ctx, lua_State *L, int index, struct node *n) {
 		n->valuetype = VALUETYPE_TABLE;
 
 		ctx->tbl = tbl;
+		ctx->old = parent_old;
 
 		break;
 	}
@@ -181,7 +297,7 @@ setvalue(struct context * ctx, lua_State *L, int index, struct node *n) {
 static void
 setarray(struct context *ctx, lua_State *L, int index, int key) {
 	struct node n;
-	setvalue(ctx, L, index, &n);
+	setvalue(ctx, L, index, &n, 0, key);
 	struct table *tbl = ctx->tbl;
 	--key;	// base 0
 	tbl->arraytype[key] = n.valuetype;
@@ -227,7 +343,7 @@ fillnocolliding(lua_State *L, struct context *ctx) {
 				n->keyhash = keyhash;
 				n->next = -1;
 				n->nocolliding = 1;
-				setvalue(ctx, L, -1, n);	// set n->v , n->valuetype
+				setvalue(ctx, L, -1, n, lua_absindex(L, -2), 0);	// set n->v , n->valuetype
 			}
 		}
 		lua_pop(L,1);
@@ -265,7 +381,7 @@ fillcolliding(lua_State *L, struct context *ctx) {
 				n->keytype = keytype;
 				n->keyhash = keyhash;
 				n->nocolliding = 0;
-				setvalue(ctx, L, -1, n);	// set n->v , n->valuetype
+				setvalue(ctx, L, -1, n, lua_absindex(L, -2), 0);	// set n->v , n->valuetype
 			}
 		}
 		lua_pop(L,1);
@@ -281,6 +397,8 @@ convtable(lua_State *L) {
 	struct table *tbl = ctx->tbl;
 
 	tbl->L = ctx->L;
+	tbl->ref = 1;
+	++ctx->tables;
 
 	int sizearray = lua_rawlen(L, 1);
 	if (sizearray) {
@@ -326,23 +444,33 @@ memerror:
 	return luaL_error(L, "memory error");
 }
 
+// partial is the lua_State of a conf object failed to create, its tables are freed directly
 static void
-delete_tbl(struct table *tbl) {
+delete_tbl(struct table *tbl, lua_State *partial) {
+	if (tbl->L != partial && --tbl->ref > 0)
+		return;
 	int i;
 	for (i=0;i<tbl->sizearray;i++) {
 		if (tbl->arraytype[i] == VALUETYPE_TABLE) {
-			delete_tbl(tbl->array[i].tbl);
+			delete_tbl(tbl->array[i].tbl, partial);
 		}
 	}
 	for (i=0;i<tbl->sizehash;i++) {
 		if (tbl->hash[i].valuetype == VALUETYPE_TABLE) {
-			delete_tbl(tbl->hash[i].v.tbl);
+			delete_tbl(tbl->hash[i].v.tbl, partial);
 		}
 	}
+	lua_State *L = tbl->L;
 	free(tbl->arraytype);
 	free(tbl->array);
 	free(tbl->hash);
 	free(tbl);
+	if (L && L != partial) {
+		struct state * s = lua_touserdata(L, 1);
+		if (--s->tables == 0) {
+			lua_close(L);
+		}
+	}
 }
 
 static int
@@ -383,8 +511,8 @@ convert_stringmap(struct context *ctx, struct table *tbl) {
 	lua_settop(L, ctx->string_index + 1);
 	lua_pushvalue(L, 1);
 	struct state * s = lua_newuserdatauv(L, sizeof(*s), 1);
-	s->dirty = 0;
 	ATOM_INIT(&s->ref , 0);
+	s->tables = ctx->tables;
 	s->root = tbl;
 	lua_replace(L, 1);
 	lua_replace(L, -2);
@@ -403,15 +531,23 @@ convert_stringmap(struct context *ctx, struct table *tbl) {
 	lua_gc(L, LUA_GCCOLLECT, 0);
 }
 
+// new(table [, old]) : the unchanged sub tables of old version are shared
 static int
 lnewconf(lua_State *L) {
 	int ret;
 	struct context ctx;
 	struct table * tbl = NULL;
 	luaL_checktype(L,1,LUA_TTABLE);
+	ctx.old = NULL;
+	if (!lua_isnoneornil(L, 2)) {
+		luaL_checktype(L, 2, LUA_TLIGHTUSERDATA);
+		ctx.old = lua_touserdata(L, 2);
+	}
+	lua_settop(L, 1);
 	ctx.L = luaL_newstate();
 	ctx.tbl = NULL;
-	ctx.string_index = 1;	// 1 reserved for dirty flag
+	ctx.tables = 0;
+	ctx.string_index = 1;	// 1 reserved for state
 	if (ctx.L == NULL) {
 		lua_pushliteral(L, "memory error");
 		goto error;
@@ -446,12 +582,12 @@ lnewconf(lua_State *L) {
 
 	return 1;
 error:
+	if (tbl) {
+		delete_tbl(tbl, ctx.L);
+	}
 	if (ctx.L) {
 		lua_close(ctx.L);
 	}
-	if (tbl) {
-		delete_tbl(tbl);
-	}
 	lua_error(L);
 	return -1;
 }
@@ -468,8 +604,7 @@ get_table(lua_State *L, int index) {
 static int
 ldeleteconf(lua_State *L) {
 	struct table *tbl = get_table(L,1);
-	lua_close(tbl->L);
-	delete_tbl(tbl);
+	delete_tbl(tbl, NULL);
 	return 0;
 }
 
@@ -693,20 +828,63 @@ lboxconf(lua_State *L) {
 	return 1;
 }
 
+// mark the tables of old version which are not shared by the new version
+static void
+markdirty(struct table *old, struct table *new) {
+	if (old == new)
+		return;
+	old->dirty = 1;
+	int i;
+	for (i=0;i<old->sizearray;i++) {
+		if (old->arraytype[i] == VALUETYPE_TABLE) {
+			struct table * child = NULL;
+			if (new && i < new->sizearray && new->arraytype[i] == VALUETYPE_TABLE) {
+				child = new->array[i].tbl;
+			}
+			markdirty(old->array[i].tbl, child);
+		}
+	}
+	for (i=0;i<old->sizehash;i++) {
+		struct node * n = &old->hash[i];
+		if (n->valuetype == VALUETYPE_TABLE) {
+			struct node * nn = NULL;
+			if (new) {
+				if (n->keytype == KEYTYPE_INTEGER) {
+					if (n->key > 0 && n->key <= new->sizearray) {
+						if (new->arraytype[n->key-1] == VALUETYPE_TABLE) {
+							markdirty(n->v.tbl, new->array[n->key-1].tbl);
+							continue;
+						}
+					} else {
+						nn = lookup_key(new, n->keyhash, n->key, KEYTYPE_INTEGER, NULL, 0);
+					}
+				} else {
+					size_t sz = 0;
+					const char * str = lua_tolstring(old->L, n->key, &sz);
+					nn = lookup_key(new, n->keyhash, 0, KEYTYPE_STRING, str, sz);
+				}
+			}
+			markdirty(n->v.tbl, (nn && nn->valuetype == VALUETYPE_TABLE) ? nn->v.tbl : NULL);
+		}
+	}
+}
+
+// markdirty(old [, new])
 static int
 lmarkdirty(lua_State *L) {
 	struct table *tbl = get_table(L,1);
-	struct state * s = lua_touserdata(tbl->L, 1);
-	s->dirty = 1;
+	struct table *new = NULL;
+	if (!lua_isnoneornil(L, 2)) {
+		new = get_table(L, 2);
+	}
+	markdirty(tbl, new);
 	return 0;
 }
 
 static int
 lisdirty(lua_State *L) {
 	struct table *tbl = get_table(L,1);
-	struct state * s = lua_touserdata(tbl->L, 1);
-	int d = s->dirty;
-	lua_pushboolean(L, d);
+	lua_pushboolean(L, tbl->dirty);
 	
 	return 1;
 }
@@ -134,6 +134,7 @@ lcallback(lua_State *L) {
 	lua_setfield(L, LUA_REGISTRYINDEX, "callback_context");
 	lua_xmove(L, cb_ctx->L, 1);
 
+	skynet_callback_reserve(context, forward);
 	skynet_callback(context, cb_ctx, (forward)?(_forward_pre):(_cb_pre));
 	return 0;
 }
@@ -415,6 +416,46 @@ ltrash(lua_State *L) {
 	return 0;
 }
 
+/*
+	string message
+	 lightuserdata message_ptr (would be freed)
+	 integer len
+
+	return lightuserdata shared_payload, integer len
+ */
+static int
+lshare(lua_State *L) {
+	void * payload;
+	size_t sz;
+	int t = lua_type(L,1);
+	switch (t) {
+	case LUA_TSTRING: {
+		const char * str = lua_tolstring(L, 1, &sz);
+		payload = skynet_shared_new(str, sz);
+		break;
+	}
+	case LUA_TLIGHTUSERDATA: {
+		void * msg = lua_touserdata(L,1);
+		sz = luaL_checkinteger(L,2);
+		payload = skynet_shared_new(msg, sz);
+		skynet_free(msg);
+		break;
+	}
+	default:
+		return luaL_error(L, "skynet.share invalid param %s", lua_typename(L,t));
+	}
+	lua_pushlightuserdata(L, payload);
+	lua_pushinteger(L, sz);
+	return 2;
+}
+
+static int
+lunshare(lua_State *L) {
+	luaL_checktype(L, 1, LUA_TLIGHTUSERDATA);
+	skynet_shared_release(lua_touserdata(L,1));
+	return 0;
+}
+
 static int
 lnow(lua_State *L) {
 	uint64_t ti = skynet_now();
@@ -520,6 +561,8 @@ luaopen_skynet_core(lua_State *L) {
 		{ "unpack", luaseri_unpack },
 		{ "packstring", lpackstring },
 		{ "trash" , ltrash },
+		{ "share", lshare },
+		{ "unshare", lunshare },
 		{ "now", lnow },
 		{ "hpc", lhpc },	// getHPCounter
 		{ NULL, NULL },
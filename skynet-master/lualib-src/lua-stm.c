@@ -11,10 +11,15 @@
 #include "skynet_malloc.h"
 #include "atomic.h"
 
+// The writer bumps the version after each update, so a reader polls the version first,
+// and only takes the lock and the reference of copy when it changes.
+// The readers never write the shared cache line when nothing changes.
+
 struct stm_object {
 	struct rwlock lock;
 	ATOM_INT reference;
 	struct stm_copy * copy;
+	ATOM_SIZET version;
 };
 
 struct stm_copy {
@@ -40,6 +45,7 @@ stm_new(void * msg, int32_t sz) {
 	rwlock_init(&obj->lock);
 	ATOM_INIT(&obj->reference , 1);
 	obj->copy = stm_newcopy(msg, sz);
+	ATOM_INIT(&obj->version, 0);
 
 	return obj;
 }
@@ -63,6 +69,7 @@ stm_release(struct stm_object *obj) {
 	obj->copy = NULL;
 	if (ATOM_FDEC(&obj->reference) > 1) {
 		// stm object grab by readers, reset the copy to NULL.
+		ATOM_FINC(&obj->version);
 		rwlock_wunlock(&obj->lock);
 		return;
 	}
@@ -109,6 +116,7 @@ stm_update(struct stm_object *obj, void *msg, int32_t sz) {
 	rwlock_wlock(&obj->lock);
 	struct stm_copy *oldcopy = obj->copy;
 	obj->copy = copy;
+	ATOM_FINC(&obj->version);
 	rwlock_wunlock(&obj->lock);
 
 	stm_releasecopy(oldcopy);
@@ -178,6 +186,7 @@ lupdate(lua_State *L) {
 struct boxreader {
 	struct stm_object *obj;
 	struct stm_copy *lastcopy;
+	size_t lastversion;
 };
 
 static int
@@ -185,6 +194,8 @@ lnewreader(lua_State *L) {
 	struct boxreader * box = lua_newuserdatauv(L, sizeof(*box), 0);
 	box->obj = lua_touserdata(L, 1);
 	box->lastcopy = NULL;
+	// the first read always fetches the copy
+	box->lastversion = ATOM_LOAD(&box->obj->version) - 1;
 	lua_pushvalue(L, lua_upvalueindex(1));
 	lua_setmetatable(L, -2);
 
@@ -207,6 +218,15 @@ lread(lua_State *L) {
 	struct boxreader * box = lua_touserdata(L, 1);
 	luaL_checktype(L, 2, LUA_TFUNCTION);
 
+	size_t version = ATOM_LOAD(&box->obj->version);
+	if (version == box->lastversion) {
+		// fast path, not update
+		lua_pushboolean(L, 0);
+		return 1;
+	}
+	// a newer copy may be fetched here, and the next read goes the slow path again
+	box->lastversion = version;
+
 	struct stm_copy * copy = stm_copy(box->obj);
 	if (copy == box->lastcopy) {
 		// not update
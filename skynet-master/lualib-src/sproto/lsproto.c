@@ -608,12 +608,29 @@ decode(const struct sproto_arg *args) {
 	return 0;
 }
 
+// The same layout as struct view in lua-netpack.c
+#define NETPACK_VIEW "NETPACK_VIEW"
+
+struct netpack_view {
+	const void * ptr;
+	size_t sz;
+};
+
 static const void *
 getbuffer(lua_State *L, int index, size_t *sz) {
 	const void * buffer = NULL;
 	int t = lua_type(L, index);
 	if (t == LUA_TSTRING) {
 		buffer = lua_tolstring(L, index, sz);
+	} else if (t == LUA_TUSERDATA && luaL_testudata(L, index, NETPACK_VIEW)) {
+		// the package view of skynet.netpack (filterview), the size is in the view
+		const struct netpack_view * v = (const struct netpack_view *)lua_touserdata(L, index);
+		if (v->ptr == NULL) {
+			luaL_argerror(L, index, "The view is released");
+			return NULL;
+		}
+		buffer = v->ptr;
+		*sz = v->sz;
 	} else {
 		if (t != LUA_TUSERDATA && t != LUA_TLIGHTUSERDATA) {
 			luaL_argerror(L, index, "Need a string or userdata");
@@ -663,6 +680,849 @@ ldecode(lua_State *L) {
 	return 2;
 }
 
+/*
+	The compiled types : the fields of each sproto_type are flattened into a plan,
+	the field names are interned in a lua table (the uservalue of the plan),
+	and the lua tables are read and written from C directly, without sproto_callback.
+	The integer arrays are encoded and decoded in bulk.
+	The output is the same as sproto_encode/sproto_decode.
+ */
+
+#define SIZEOF_LENGTH 4
+#define SIZEOF_HEADER 2
+#define SIZEOF_FIELD 2
+#define SIZEOF_INT64 ((int)sizeof(uint64_t))
+#define SIZEOF_INT32 ((int)sizeof(uint32_t))
+
+struct cfield {
+	const char * name;
+	int tag;
+	int type;	// without SPROTO_TARRAY
+	int array;
+	int extra;
+	int key;	// main index tag, -1 for none
+	int map;
+	int name_index;	// index in the name table
+	int key_index;	// name index of the main index field in subtype
+	int sub;	// type index of subtype, -1 for none
+};
+
+struct ctype {
+	const char * name;
+	int n;
+	int maxn;
+	int base;	// the tags are continuous from base, or -1
+	struct cfield * f;
+};
+
+struct cproto {
+	struct sproto * sp;
+	int type_n;
+	struct ctype * t;
+};
+
+struct cenv {
+	lua_State *L;
+	struct cproto *P;
+	int names;
+	int deep;
+};
+
+static inline void
+put_dword(uint8_t *p, uint32_t v) {
+	p[0] = v & 0xff;
+	p[1] = (v >> 8) & 0xff;
+	p[2] = (v >> 16) & 0xff;
+	p[3] = (v >> 24) & 0xff;
+}
+
+static inline void
+put_qword(uint8_t *p, uint64_t v) {
+	put_dword(p, (uint32_t)v);
+	put_dword(p + 4, (uint32_t)(v >> 32));
+}
+
+static inline uint32_t
+get_dword(const uint8_t *p) {
+	return p[0] | p[1]<<8 | p[2]<<16 | (uint32_t)p[3]<<24;
+}
+
+static inline uint64_t
+get_qword(const uint8_t *p) {
+	return (uint64_t)get_dword(p) | (uint64_t)get_dword(p + 4) << 32;
+}
+
+static inline uint64_t
+expand_dword(uint32_t v) {
+	uint64_t value = v;
+	if (value & 0x80000000) {
+		value |= (uint64_t)~0 << 32;
+	}
+	return value;
+}
+
+/*
+	lightuserdata sproto
+	return userdata compiled sproto
+ */
+static int
+lcompile(lua_State *L) {
+	struct sproto * sp = lua_touserdata(L, 1);
+	if (sp == NULL) {
+		return luaL_argerror(L, 1, "Need a sproto object");
+	}
+	int type_n = sproto_typecount(sp);
+	int field_n = 0;
+	int i, j;
+	for (i=0;i<type_n;i++) {
+		field_n += sproto_fieldcount(sproto_typeat(sp, i));
+	}
+	struct cproto * P = lua_newuserdata(L, sizeof(struct cproto) + type_n * sizeof(struct ctype) + field_n * sizeof(struct cfield));
+	P->sp = sp;
+	P->type_n = type_n;
+	P->t = (struct ctype *)(P + 1);
+	struct cfield * cf = (struct cfield *)(P->t + type_n);
+	lua_createtable(L, field_n, 0);
+	int name_index = 0;
+	for (i=0;i<type_n;i++) {
+		struct sproto_type * st = sproto_typeat(sp, i);
+		struct ctype * t = &P->t[i];
+		t->name = sproto_name(st);
+		t->n = sproto_fieldcount(st);
+		t->maxn = t->n;
+		t->f = cf;
+		int last = -1;
+		for (j=0;j<t->n;j++) {
+			struct sproto_field sf;
+			struct cfield * f = &t->f[j];
+			sproto_field(st, j, &sf);
+			f->name = sf.name;
+			f->tag = sf.tag;
+			f->type = sf.type & ~SPROTO_TARRAY;
+			f->array = (sf.type & SPROTO_TARRAY) != 0;
+			f->extra = sf.extra;
+			f->key = f->array ? sf.key : -1;
+			f->map = sf.map > 0;
+			f->name_index = ++name_index;
+			f->key_index = 0;
+			f->sub = sf.st ? sproto_typeindex(sp, sf.st) : -1;
+			lua_pushstring(L, sf.name);
+			lua_rawseti(L, -2, name_index);
+			if (f->tag > last + 1) {
+				++t->maxn;
+			}
+			last = f->tag;
+		}
+		t->base = -1;
+		if (t->n > 0 && t->f[t->n-1].tag - t->f[0].tag + 1 == t->n) {
+			t->base = t->f[0].tag;
+		}
+		cf += t->n;
+	}
+	// resolve the main index field in subtype
+	for (i=0;i<type_n;i++) {
+		struct ctype * t = &P->t[i];
+		for (j=0;j<t->n;j++) {
+			struct cfield * f = &t->f[j];
+			if (f->key >= 0 && f->sub >= 0) {
+				struct ctype * sub = &P->t[f->sub];
+				int k;
+				for (k=0;k<sub->n;k++) {
+					if (sub->f[k].tag == f->key) {
+						f->key_index = sub->f[k].name_index;
+						break;
+					}
+				}
+			}
+		}
+	}
+	lua_setuservalue(L, -2);
+	return 1;
+}
+
+static const struct cfield *
+cfindtag(const struct ctype *t, int tag) {
+	if (t->base >= 0) {
+		tag -= t->base;
+		if (tag < 0 || tag >= t->n)
+			return NULL;
+		return &t->f[tag];
+	}
+	int begin = 0, end = t->n;
+	while (begin < end) {
+		int mid = (begin+end)/2;
+		const struct cfield *f = &t->f[mid];
+		if (f->tag == tag)
+			return f;
+		if (tag > f->tag) {
+			begin = mid + 1;
+		} else {
+			end = mid;
+		}
+	}
+	return NULL;
+}
+
+static inline void
+push_name(struct cenv *E, int name_index) {
+	lua_rawgeti(E->L, E->names, name_index);
+}
+
+static int64_t
+check_integer(struct cenv *E, const struct ctype *t, const struct cfield *f, int index) {
+	lua_State *L = E->L;
+	if (f->extra) {
+		// It's decimal.
+		lua_Number vn = lua_tonumber(L, -1);
+		return (int64_t)(round(vn * f->extra));
+	}
+	int isnum;
+	int64_t v = tointegerx(L, -1, &isnum);
+	if (!isnum) {
+		luaL_error(L, "%s.%s[%d] is not an integer (Is a %s)",
+			t->name, f->name, index, lua_typename(L, lua_type(L, -1)));
+	}
+	return v;
+}
+
+static int
+check_boolean(struct cenv *E, const struct ctype *t, const struct cfield *f, int index) {
+	lua_State *L = E->L;
+	int isbool;
+	int v = tobooleanx(L, -1, &isbool);
+	if (!isbool) {
+		luaL_error(L, "%s.%s[%d] is not a boolean (Is a %s)",
+			t->name, f->name, index, lua_typename(L, lua_type(L, -1)));
+	}
+	return v;
+}
+
+static int cencode_struct(struct cenv *E, const struct ctype *t, int tbl, uint8_t *buffer, int size);
+
+// encode the object (string or struct) on the top with length prefix, and pop it
+static int
+cencode_object(struct cenv *E, const struct ctype *t, const struct cfield *f, int index, uint8_t *data, int size) {
+	lua_State *L = E->L;
+	int sz;
+	if (size < SIZEOF_LENGTH)
+		return -1;
+	if (f->type == SPROTO_TSTRING) {
+		size_t len = 0;
+		int isstring;
+		int type = lua_type(L, -1);
+		const char * str = tolstringx(L, -1, &len, &isstring);
+		if (!isstring) {
+			return luaL_error(L, "%s.%s[%d] is not a string (Is a %s)",
+				t->name, f->name, index, lua_typename(L, type));
+		}
+		if (len > size - SIZEOF_LENGTH)
+			return -1;
+		memcpy(data + SIZEOF_LENGTH, str, len);
+		sz = (int)len;
+	} else {
+		sz = cencode_struct(E, &E->P->t[f->sub], lua_gettop(L), data + SIZEOF_LENGTH, size - SIZEOF_LENGTH);
+		if (sz < 0)
+			return -1;
+	}
+	lua_pop(L, 1);
+	put_dword(data, sz);
+	return sz + SIZEOF_LENGTH;
+}
+
+// the array is on the top, return the size of array part (without length prefix)
+static int
+cencode_intarray(struct cenv *E, const struct ctype *t, const struct cfield *f, int array, uint8_t *buffer, int size) {
+	lua_State *L = E->L;
+	int intlen = f->type == SPROTO_TDOUBLE ? SIZEOF_INT64 : SIZEOF_INT32;
+	int n = 0;
+	uint8_t * ptr = buffer + 1;
+	for (;;) {
+		if (lua_geti(L, array, n+1) == LUA_TNIL) {
+			lua_pop(L, 1);
+			break;
+		}
+		// write 64bit first
+		if (size < 1 + (n+1) * SIZEOF_INT64) {
+			lua_pop(L, 1);
+			return -1;
+		}
+		uint64_t v;
+		if (f->type == SPROTO_TDOUBLE) {
+			double d = (double)lua_tonumber(L, -1);
+			memcpy(&v, &d, sizeof(v));
+		} else {
+			int64_t i = check_integer(E, t, f, n+1);
+			int64_t vh = i >> 31;
+			if (vh != 0 && vh != -1) {
+				intlen = SIZEOF_INT64;
+			}
+			v = (uint64_t)i;
+		}
+		lua_pop(L, 1);
+		put_qword(ptr + n * SIZEOF_INT64, v);
+		++n;
+	}
+	if (n == 0)
+		return 0;
+	if (intlen == SIZEOF_INT32) {
+		// all the integers are 32bit, the low dword is first
+		int i;
+		for (i=1;i<n;i++) {
+			memmove(ptr + i * SIZEOF_INT32, ptr + i * SIZEOF_INT64, SIZEOF_INT32);
+		}
+	}
+	buffer[0] = (uint8_t)intlen;
+	return 1 + n * intlen;
+}
+
+// pairs(array) for the arrays with main index, push the iterator (function, state, key)
+static void
+cpairs(struct cenv *E, const struct ctype *t, const struct cfield *f, int array) {
+	lua_State *L = E->L;
+	if (luaL_getmetafield(L, array, "__pairs")) {
+		lua_pushvalue(L, array);
+		lua_call(L, 1, 3);
+	} else {
+		lua_pushnil(L);	// use lua_next
+		lua_pushnil(L);
+		lua_pushnil(L);
+	}
+}
+
+static int
+cnext(struct cenv *E, int array, int iter) {
+	lua_State *L = E->L;
+	if (lua_isnil(L, iter)) {
+		lua_pushvalue(L, iter + 2);
+		return lua_next(L, array);
+	}
+	lua_pushvalue(L, iter);
+	lua_pushvalue(L, iter + 1);
+	lua_pushvalue(L, iter + 2);
+	lua_call(L, 2, 2);
+	if (lua_isnil(L, -2)) {
+		lua_pop(L, 2);
+		return 0;
+	}
+	return 1;
+}
+
+// encode the array on the top with length prefix, and pop it
+static int
+cencode_array(struct cenv *E, const struct ctype *t, const struct cfield *f, uint8_t *data, int size) {
+	lua_State *L = E->L;
+	int array = lua_gettop(L);
+	int sz = 0;
+	if (size < SIZEOF_LENGTH)
+		return -1;
+	uint8_t * buffer = data + SIZEOF_LENGTH;
+	size -= SIZEOF_LENGTH;
+	if (!lua_istable(L, array)) {
+		if (luaL_getmetafield(L, array, "__pairs")) {
+			lua_pop(L, 1);
+		} else {
+			return luaL_error(L, "%s.%s(%d) should be a table or an userdata with metamethods (Is a %s)",
+				t->name, f->name, 1, lua_typename(L, lua_type(L, array)));
+		}
+	}
+	switch (f->type) {
+	case SPROTO_TINTEGER:
+	case SPROTO_TDOUBLE:
+		sz = cencode_intarray(E, t, f, array, buffer, size);
+		if (sz < 0)
+			return -1;
+		break;
+	case SPROTO_TBOOLEAN: {
+		int i;
+		for (i=1;;i++) {
+			if (lua_geti(L, array, i) == LUA_TNIL) {
+				lua_pop(L, 1);
+				break;
+			}
+			int v = check_boolean(E, t, f, i);
+			lua_pop(L, 1);
+			if (sz >= size)
+				return -1;
+			buffer[sz++] = v ? 1 : 0;
+		}
+		break;
+	}
+	default:
+		if (f->key >= 0) {
+			const struct ctype * st = &E->P->t[f->sub];
+			int entry = 0;
+			if (f->map) {
+				lua_createtable(L, 0, 2); // key/value entry
+				entry = lua_gettop(L);
+			}
+			cpairs(E, t, f, array);
+			int iter = lua_gettop(L) - 2;
+			while (cnext(E, array, iter)) {
+				// key value
+				lua_pushvalue(L, -2);
+				lua_replace(L, iter + 2);
+				if (entry) {
+					push_name(E, st->f[1].name_index);
+					lua_insert(L, -2);
+					lua_rawset(L, entry);
+					push_name(E, st->f[0].name_index);
+					lua_insert(L, -2);
+					lua_rawset(L, entry);
+					lua_pushvalue(L, entry);
+				} else {
+					lua_remove(L, -2);
+				}
+				int r = cencode_object(E, t, f, 0, buffer + sz, size - sz);
+				if (r < 0)
+					return -1;
+				sz += r;
+			}
+		} else {
+			int i;
+			for (i=1;;i++) {
+				if (lua_geti(L, array, i) == LUA_TNIL) {
+					lua_pop(L, 1);
+					break;
+				}
+				int r = cencode_object(E, t, f, i, buffer + sz, size - sz);
+				if (r < 0)
+					return -1;
+				sz += r;
+			}
+		}
+		break;
+	}
+	lua_settop(L, array - 1);
+	put_dword(data, sz);
+	return sz + SIZEOF_LENGTH;
+}
+
+// encode the field value on the top and pop it, *value is set if it can be encoded in the field part
+static int
+cencode_field(struct cenv *E, const struct ctype *t, const struct cfield *f, uint8_t *data, int size, int *value) {
+	lua_State *L = E->L;
+	switch (f->type) {
+	case SPROTO_TINTEGER: {
+		int64_t v = check_integer(E, t, f, 0);
+		lua_pop(L, 1);
+		int64_t vh = v >> 31;
+		if (vh == 0 || vh == -1) {
+			uint32_t u = (uint32_t)v;
+			if (u < 0x7fff) {
+				*value = (u+1) * 2;
+				return 0;
+			}
+			if (size < SIZEOF_LENGTH + SIZEOF_INT32)
+				return -1;
+			put_dword(data, SIZEOF_INT32);
+			put_dword(data + SIZEOF_LENGTH, u);
+			return SIZEOF_LENGTH + SIZEOF_INT32;
+		}
+		if (size < SIZEOF_LENGTH + SIZEOF_INT64)
+			return -1;
+		put_dword(data, SIZEOF_INT64);
+		put_qword(data + SIZEOF_LENGTH, (uint64_t)v);
+		return SIZEOF_LENGTH + SIZEOF_INT64;
+	}
+	case SPROTO_TDOUBLE: {
+		double d = (double)lua_tonumber(L, -1);
+		uint64_t v;
+		lua_pop(L, 1);
+		memcpy(&v, &d, sizeof(v));
+		if (size < SIZEOF_LENGTH + SIZEOF_INT64)
+			return -1;
+		put_dword(data, SIZEOF_INT64);
+		put_qword(data + SIZEOF_LENGTH, v);
+		return SIZEOF_LENGTH + SIZEOF_INT64;
+	}
+	case SPROTO_TBOOLEAN: {
+		int v = check_boolean(E, t, f, 0);
+		lua_pop(L, 1);
+		*value = v ? 4 : 2;
+		return 0;
+	}
+	case SPROTO_TSTRING:
+	case SPROTO_TSTRUCT:
+		return cencode_object(E, t, f, 0, data, size);
+	default:
+		return luaL_error(L, "Invalid field type %d", f->type);
+	}
+}
+
+static int
+cencode_struct(struct cenv *E, const struct ctype *t, int tbl, uint8_t *buffer, int size) {
+	lua_State *L = E->L;
+	int header_sz = SIZEOF_HEADER + t->maxn * SIZEOF_FIELD;
+	uint8_t * header = buffer;
+	uint8_t * data;
+	int index = 0;
+	int lasttag = -1;
+	int datasz;
+	int i;
+	if (size < header_sz)
+		return -1;
+	if (E->deep >= ENCODE_DEEPLEVEL)
+		return luaL_error(L, "The table is too deep");
+	luaL_checkstack(L, 12, NULL);
+	++E->deep;
+	data = header + header_sz;
+	size -= header_sz;
+	for (i=0;i<t->n;i++) {
+		const struct cfield *f = &t->f[i];
+		int value = 0;
+		int sz;
+		push_name(E, f->name_index);
+		if (lua_gettable(L, tbl) == LUA_TNIL) {
+			lua_pop(L, 1);
+			continue;
+		}
+		if (f->array) {
+			sz = cencode_array(E, t, f, data, size);
+		} else {
+			sz = cencode_field(E, t, f, data, size, &value);
+		}
+		if (sz < 0)
+			return -1;
+		uint8_t * record;
+		int tag;
+		data += sz;
+		size -= sz;
+		record = header + SIZEOF_HEADER + SIZEOF_FIELD * index;
+		tag = f->tag - lasttag - 1;
+		if (tag > 0) {
+			// skip tag
+			tag = (tag - 1) * 2 + 1;
+			if (tag > 0xffff)
+				return -1;
+			record[0] = tag & 0xff;
+			record[1] = (tag >> 8) & 0xff;
+			++index;
+			record += SIZEOF_FIELD;
+		}
+		++index;
+		record[0] = value & 0xff;
+		record[1] = (value >> 8) & 0xff;
+		lasttag = f->tag;
+	}
+	--E->deep;
+	header[0] = index & 0xff;
+	header[1] = (index >> 8) & 0xff;
+
+	datasz = data - (header + header_sz);
+	data = header + header_sz;
+	if (index != t->maxn) {
+		memmove(header + SIZEOF_HEADER + index * SIZEOF_FIELD, data, datasz);
+	}
+	return SIZEOF_HEADER + index * SIZEOF_FIELD + datasz;
+}
+
+static struct cproto *
+compiled_type(lua_State *L, struct sproto_type *st, int *type_index) {
+	struct cproto * P = lua_touserdata(L, 1);
+	if (P == NULL || st == NULL)
+		return NULL;
+	*type_index = sproto_typeindex(P->sp, st);
+	if (*type_index < 0)
+		return NULL;
+	return P;
+}
+
+/*
+	userdata compiled sproto (or nil)
+	lightuserdata sproto_type
+	table source
+
+	return string
+	If the type is not compiled, it's the same as encode.
+ */
+static int
+lcencode(lua_State *L) {
+	int type_index;
+	struct cproto * P = compiled_type(L, lua_touserdata(L, 2), &type_index);
+	if (P == NULL) {
+		lua_remove(L, 1);
+		return lencode(L);
+	}
+	void * buffer = lua_touserdata(L, lua_upvalueindex(1));
+	int sz = lua_tointeger(L, lua_upvalueindex(2));
+	struct cenv E;
+	E.L = L;
+	E.P = P;
+	lua_settop(L, 3);
+	lua_getuservalue(L, 1);
+	E.names = 4;
+	for (;;) {
+		E.deep = 0;
+		lua_settop(L, 4);
+		int r = cencode_struct(&E, &P->t[type_index], 3, buffer, sz);
+		if (r<0) {
+			buffer = expand_buffer(L, sz, sz + 1);
+			sz = lua_tointeger(L, lua_upvalueindex(2));
+		} else {
+			lua_pushlstring(L, buffer, r);
+			return 1;
+		}
+	}
+}
+
+static int cdecode_struct(struct cenv *E, const struct ctype *t, const uint8_t *stream, int size, int result);
+
+// decode the object (string or struct) and push it
+static int
+cdecode_object(struct cenv *E, const struct cfield *f, const uint8_t *stream, int sz) {
+	lua_State *L = E->L;
+	if (f->type == SPROTO_TSTRING) {
+		lua_pushlstring(L, (const char *)stream, sz);
+		return 0;
+	}
+	lua_newtable(L);
+	int r = cdecode_struct(E, &E->P->t[f->sub], stream, sz, lua_gettop(L));
+	if (r != sz)
+		return -1;
+	return 0;
+}
+
+static inline void
+push_integer(lua_State *L, const struct cfield *f, uint64_t v) {
+	if (f->type == SPROTO_TDOUBLE) {
+		double d;
+		memcpy(&d, &v, sizeof(d));
+		lua_pushnumber(L, d);
+	} else if (f->extra) {
+		lua_Number vn = (lua_Number)(int64_t)v;
+		lua_pushnumber(L, vn / f->extra);
+	} else {
+		lua_pushinteger(L, (int64_t)v);
+	}
+}
+
+// the array in stream with length prefix, push the array table
+static int
+cdecode_array(struct cenv *E, const struct cfield *f, const uint8_t *stream) {
+	lua_State *L = E->L;
+	uint32_t sz = get_dword(stream);
+	int i;
+	stream += SIZEOF_LENGTH;
+	switch (f->type) {
+	case SPROTO_TINTEGER:
+	case SPROTO_TDOUBLE: {
+		if (sz <= 1) {
+			// An empty array (may be with a len prefix)
+			lua_newtable(L);
+			return 0;
+		}
+		int len = *stream++;
+		--sz;
+		if (len != SIZEOF_INT32 && len != SIZEOF_INT64)
+			return -1;
+		if (sz % len != 0)
+			return -1;
+		int n = sz / len;
+		lua_createtable(L, n, 0);
+		for (i=0;i<n;i++) {
+			uint64_t v;
+			if (len == SIZEOF_INT32) {
+				v = expand_dword(get_dword(stream + i * SIZEOF_INT32));
+			} else {
+				v = get_qword(stream + i * SIZEOF_INT64);
+			}
+			push_integer(L, f, v);
+			lua_rawseti(L, -2, i+1);
+		}
+		return 0;
+	}
+	case SPROTO_TBOOLEAN:
+		lua_createtable(L, sz, 0);
+		for (i=0;i<sz;i++) {
+			lua_pushboolean(L, stream[i]);
+			lua_rawseti(L, -2, i+1);
+		}
+		return 0;
+	case SPROTO_TSTRING:
+	case SPROTO_TSTRUCT:
+		break;
+	default:
+		return -1;
+	}
+	lua_newtable(L);
+	int array = lua_gettop(L);
+	const struct ctype * st = f->sub >= 0 ? &E->P->t[f->sub] : NULL;
+	int index = 1;
+	while (sz > 0) {
+		uint32_t hsz;
+		if (sz < SIZEOF_LENGTH)
+			return -1;
+		hsz = get_dword(stream);
+		stream += SIZEOF_LENGTH;
+		sz -= SIZEOF_LENGTH;
+		if (hsz > sz)
+			return -1;
+		if (cdecode_object(E, f, stream, hsz))
+			return -1;
+		if (f->key >= 0) {
+			int obj = lua_gettop(L);
+			if (f->map) {
+				push_name(E, st->f[0].name_index);
+				if (lua_gettable(L, obj) == LUA_TNIL) {
+					return luaL_error(L, "Can't find key field in [%s]", f->name);
+				}
+				push_name(E, st->f[1].name_index);
+				if (lua_gettable(L, obj) == LUA_TNIL) {
+					return luaL_error(L, "Can't find value field in [%s]", f->name);
+				}
+			} else {
+				if (f->key_index == 0 || (push_name(E, f->key_index), lua_gettable(L, obj)) == LUA_TNIL) {
+					return luaL_error(L, "Can't find main index (tag=%d) in [%s]", f->key, f->name);
+				}
+				lua_pushvalue(L, obj);
+			}
+			lua_settable(L, array);
+			lua_settop(L, array);
+		} else {
+			lua_rawseti(L, array, index);
+		}
+		sz -= hsz;
+		stream += hsz;
+		++index;
+	}
+	return 0;
+}
+
+static int
+cdecode_struct(struct cenv *E, const struct ctype *t, const uint8_t *stream, int size, int result) {
+	lua_State *L = E->L;
+	int total = size;
+	const uint8_t * datastream;
+	int fn;
+	int i;
+	int tag;
+	if (size < SIZEOF_HEADER)
+		return -1;
+	if (E->deep >= ENCODE_DEEPLEVEL)
+		return luaL_error(L, "The table is too deep");
+	luaL_checkstack(L, 12, NULL);
+	fn = stream[0] | stream[1] << 8;
+	stream += SIZEOF_HEADER;
+	size -= SIZEOF_HEADER;
+	if (size < fn * SIZEOF_FIELD)
+		return -1;
+	datastream = stream + fn * SIZEOF_FIELD;
+	size -= fn * SIZEOF_FIELD;
+	++E->deep;
+
+	tag = -1;
+	for (i=0;i<fn;i++) {
+		const uint8_t * currentdata;
+		const struct cfield * f;
+		int value = stream[i * SIZEOF_FIELD] | stream[i * SIZEOF_FIELD + 1] << 8;
+		++ tag;
+		if (value & 1) {
+			tag += value/2;
+			continue;
+		}
+		value = value/2 - 1;
+		currentdata = datastream;
+		if (value < 0) {
+			uint32_t sz;
+			if (size < SIZEOF_LENGTH)
+				return -1;
+			sz = get_dword(datastream);
+			if (size < sz + SIZEOF_LENGTH)
+				return -1;
+			datastream += sz+SIZEOF_LENGTH;
+			size -= sz+SIZEOF_LENGTH;
+		}
+		f = cfindtag(t, tag);
+		if (f == NULL)
+			continue;
+		push_name(E, f->name_index);
+		if (value >= 0) {
+			if (f->array)
+				return -1;
+			if (f->type == SPROTO_TINTEGER) {
+				push_integer(L, f, (uint64_t)value);
+			} else if (f->type == SPROTO_TBOOLEAN) {
+				lua_pushboolean(L, value);
+			} else {
+				return -1;
+			}
+		} else if (f->array) {
+			if (cdecode_array(E, f, currentdata))
+				return -1;
+		} else {
+			uint32_t sz = get_dword(currentdata);
+			currentdata += SIZEOF_LENGTH;
+			switch (f->type) {
+			case SPROTO_TINTEGER:
+			case SPROTO_TDOUBLE:
+				if (sz == SIZEOF_INT32) {
+					push_integer(L, f, expand_dword(get_dword(currentdata)));
+				} else if (sz == SIZEOF_INT64) {
+					push_integer(L, f, get_qword(currentdata));
+				} else {
+					return -1;
+				}
+				break;
+			case SPROTO_TBOOLEAN:
+				return -1;
+			default:
+				if (cdecode_object(E, f, currentdata, sz))
+					return -1;
+				break;
+			}
+		}
+		lua_settable(L, result);
+		lua_settop(L, result);
+	}
+	--E->deep;
+	return total - size;
+}
+
+/*
+	userdata compiled sproto (or nil)
+	lightuserdata sproto_type
+	string source	/  (lightuserdata , integer)
+	return table, sz(decoded bytes)
+	If the type is not compiled, it's the same as decode.
+ */
+static int
+lcdecode(lua_State *L) {
+	int type_index;
+	struct sproto_type * st = lua_touserdata(L, 2);
+	if (st == NULL) {
+		// return nil
+		return 0;
+	}
+	struct cproto * P = compiled_type(L, st, &type_index);
+	if (P == NULL) {
+		lua_remove(L, 1);
+		return ldecode(L);
+	}
+	size_t sz = 0;
+	const void * buffer = getbuffer(L, 3, &sz);
+	int top = lua_gettop(L);
+	struct cenv E;
+	E.L = L;
+	E.P = P;
+	E.deep = 0;
+	// the name table should be under the result table
+	lua_getuservalue(L, 1);
+	E.names = top + 1;
+	if (lua_istable(L, top)) {
+		lua_pushvalue(L, top);
+	} else {
+		lua_newtable(L);
+	}
+	int result = top + 2;
+	int r = cdecode_struct(&E, &P->t[type_index], buffer, (int)sz, result);
+	if (r < 0) {
+		return luaL_error(L, "decode error");
+	}
+	lua_settop(L, result);
+	lua_pushinteger(L, r);
+	return 2;
+}
+
 static int
 ldumpproto(lua_State *L) {
 	struct sproto * sp = lua_touserdata(L, 1);
@@ -719,6 +1579,20 @@ lunpack(lua_State *L) {
 	return 1;
 }
 
+/*
+	[boolean enable]
+	return boolean (SIMD pack/unpack is used)
+ */
+static int
+lsimd(lua_State *L) {
+	int enable = -1;
+	if (!lua_isnoneornil(L, 1)) {
+		enable = lua_toboolean(L, 1);
+	}
+	lua_pushboolean(L, sproto_simd(enable));
+	return 1;
+}
+
 static void
 pushfunction_withbuffer(lua_State *L, const char * name, lua_CFunction func) {
 	lua_newuserdata(L, ENCODE_BUFFERSIZE);
@@ -906,9 +1780,15 @@ luaopen_sproto_core(lua_State *L) {
 		{ "loadproto", lloadproto },
 		{ "saveproto", lsaveproto },
 		{ "default", ldefault },
+		{ "simd", lsimd },
 		{ NULL, NULL },
 	};
 	luaL_newlib(L,l);
+	lua_pushcfunction(L, lcompile);
+	lua_setfield(L, -2, "compile");
+	lua_pushcfunction(L, lcdecode);
+	lua_setfield(L, -2, "cdecode");
+	pushfunction_withbuffer(L, "cencode", lcencode);
 	pushfunction_withbuffer(L, "encode", lencode);
 	pushfunction_withbuffer(L, "pack", lpack);
 	pushfunction_withbuffer(L, "unpack", lunpack);
@@ -643,6 +643,42 @@ sproto_name(struct sproto_type * st) {
 	return st->name;
 }
 
+int
+sproto_typecount(const struct sproto *sp) {
+	return sp->type_n;
+}
+
+struct sproto_type *
+sproto_typeat(const struct sproto *sp, int index) {
+	if (index < 0 || index >= sp->type_n)
+		return NULL;
+	return &sp->type[index];
+}
+
+int
+sproto_typeindex(const struct sproto *sp, const struct sproto_type *st) {
+	if (st < sp->type || st >= sp->type + sp->type_n)
+		return -1;
+	return (int)(st - sp->type);
+}
+
+int
+sproto_fieldcount(const struct sproto_type *st) {
+	return st->n;
+}
+
+void
+sproto_field(const struct sproto_type *st, int index, struct sproto_field *sf) {
+	const struct field *f = &st->f[index];
+	sf->name = f->name;
+	sf->tag = f->tag;
+	sf->type = f->type;
+	sf->st = f->st;
+	sf->key = f->key;
+	sf->map = f->map;
+	sf->extra = f->extra;
+}
+
 static struct field *
 findtag(const struct sproto_type *st, int tag) {
 	int begin, end;
@@ -1327,8 +1363,97 @@ write_ff(const uint8_t * src, const uint8_t * src_end, uint8_t * des, int n) {
 	}
 }
 
+// The SSSE3 version builds the header of a 8 bytes group with a vector compare,
+// and compacts/expands the group with a shuffle table, 1 step per group instead of 8.
+// It is selected at runtime by CPUID, and the output is the same as the scalar version.
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && !defined(SPROTO_NOSIMD)
+
+#define SPROTO_SIMD
+#include <tmmintrin.h>
+
+#define SIMD_TARGET __attribute__((target("ssse3")))
+// pack_impl/unpack_impl should be inlined into pack_simd/unpack_simd, so they can use SSSE3 too
+#define PACK_INLINE inline __attribute__((always_inline))
+
+static int simd_support = 0;
+static int simd_enable = 0;
+static uint8_t simd_popcount[256];
+// for each header, the index of nonzero bytes (pack) or the position of each byte in the packed group (unpack)
+static uint8_t simd_pack[256][8];
+static uint8_t simd_unpack[256][8];
+
+__attribute__((constructor)) static void
+simd_init(void) {
+	int h,i;
+	__builtin_cpu_init();
+	if (!__builtin_cpu_supports("ssse3"))
+		return;
+	for (h=0;h<256;h++) {
+		int n = 0;
+		memset(simd_pack[h], 0x80, 8);
+		for (i=0;i<8;i++) {
+			if (h & (1<<i)) {
+				simd_pack[h][n] = i;
+				simd_unpack[h][i] = n;
+				++n;
+			} else {
+				simd_unpack[h][i] = 0x80;	// pshufb writes 0
+			}
+		}
+		simd_popcount[h] = n;
+	}
+	simd_support = 1;
+	simd_enable = 1;
+}
+
+// The same as pack_seg, but the buffer must have 9 bytes at least.
+SIMD_TARGET static inline int
+pack_seg_simd(const uint8_t *src, uint8_t * buffer, int n) {
+	__m128i v = _mm_loadl_epi64((const __m128i *)src);
+	int header = ~_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128())) & 0xff;
+	int notzero = simd_popcount[header];
+	if (notzero >= 6) {
+		// 6 or 7 in a FF run is stored as FF, write_ff will copy it later
+		if (n > 0)
+			return 8;
+		if (notzero == 8)
+			return 10;
+	}
+	*buffer = header;
+	v = _mm_shuffle_epi8(v, _mm_loadl_epi64((const __m128i *)simd_pack[header]));
+	_mm_storel_epi64((__m128i *)(buffer+1), v);
+	return notzero + 1;
+}
+
+SIMD_TARGET static inline int
+unpack_seg_simd(const uint8_t *src, uint8_t * buffer, int header) {
+	__m128i v = _mm_loadl_epi64((const __m128i *)src);
+	v = _mm_shuffle_epi8(v, _mm_loadl_epi64((const __m128i *)simd_unpack[header]));
+	_mm_storel_epi64((__m128i *)buffer, v);
+	return simd_popcount[header];
+}
+
+#else
+
+#define PACK_INLINE inline
+
+#endif
+
 int
-sproto_pack(const void * srcv, int srcsz, void * bufferv, int bufsz) {
+sproto_simd(int enable) {
+#ifdef SPROTO_SIMD
+	if (enable >= 0) {
+		simd_enable = enable && simd_support;
+	}
+	return simd_enable;
+#else
+	return 0;
+#endif
+}
+
+static PACK_INLINE int
+pack_impl(const void * srcv, int srcsz, void * bufferv, int bufsz, int simd) {
 	uint8_t tmp[8];
 	int i;
 	const uint8_t * ff_srcstart = NULL;
@@ -1349,6 +1474,11 @@ sproto_pack(const void * srcv, int srcsz, void * bufferv, int bufsz) {
 			}
 			src = tmp;
 		}
+#ifdef SPROTO_SIMD
+		if (simd && bufsz >= 9) {
+			n = pack_seg_simd(src, buffer, ff_n);
+		} else
+#endif
 		n = pack_seg(src, buffer, bufsz, ff_n);
 		bufsz -= n;
 		if (n == 10) {
@@ -1382,8 +1512,8 @@ sproto_pack(const void * srcv, int srcsz, void * bufferv, int bufsz) {
 	return size;
 }
 
-int
-sproto_unpack(const void * srcv, int srcsz, void * bufferv, int bufsz) {
+static PACK_INLINE int
+unpack_impl(const void * srcv, int srcsz, void * bufferv, int bufsz, int simd) {
 	const uint8_t * src = srcv;
 	uint8_t * buffer = bufferv;
 	int size = 0;
@@ -1408,6 +1538,15 @@ sproto_unpack(const void * srcv, int srcsz, void * bufferv, int bufsz) {
 			buffer += n;
 			src += n;
 			size += n;
+#ifdef SPROTO_SIMD
+		} else if (simd && srcsz >= 8 && bufsz >= 8) {
+			int n = unpack_seg_simd(src, buffer, header);
+			src += n;
+			srcsz -= n;
+			buffer += 8;
+			bufsz -= 8;
+			size += 8;
+#endif
 		} else {
 			int i;
 			for (i=0;i<8;i++) {
@@ -1435,3 +1574,35 @@ sproto_unpack(const void * srcv, int srcsz, void * bufferv, int bufsz) {
 	}
 	return size;
 }
+
+#ifdef SPROTO_SIMD
+
+SIMD_TARGET static int
+pack_simd(const void * srcv, int srcsz, void * bufferv, int bufsz) {
+	return pack_impl(srcv, srcsz, bufferv, bufsz, 1);
+}
+
+SIMD_TARGET static int
+unpack_simd(const void * srcv, int srcsz, void * bufferv, int bufsz) {
+	return unpack_impl(srcv, srcsz, bufferv, bufsz, 1);
+}
+
+#endif
+
+int
+sproto_pack(const void * srcv, int srcsz, void * bufferv, int bufsz) {
+#ifdef SPROTO_SIMD
+	if (simd_enable)
+		return pack_simd(srcv, srcsz, bufferv, bufsz);
+#endif
+	return pack_impl(srcv, srcsz, bufferv, bufsz, 0);
+}
+
+int
+sproto_unpack(const void * srcv, int srcsz, void * bufferv, int bufsz) {
+#ifdef SPROTO_SIMD
+	if (simd_enable)
+		return unpack_simd(srcv, srcsz, bufferv, bufsz);
+#endif
+	return unpack_impl(srcv, srcsz, bufferv, bufsz, 0);
+}
@@ -40,6 +40,8 @@ struct sproto_type * sproto_type(const struct sproto *, const char * type_name);
 
 int sproto_pack(const void * src, int srcsz, void * buffer, int bufsz);
 int sproto_unpack(const void * src, int srcsz, void * buffer, int bufsz);
+// enable 1 : pack/unpack with SIMD if the cpu supports, 0 : scalar only, -1 : query. return 1 if SIMD is used
+int sproto_simd(int enable);
 
 struct sproto_arg {
 	void *ud;
@@ -67,4 +69,22 @@ int sproto_encode(const struct sproto_type *, void * buffer, int size, sproto_ca
 void sproto_dump(struct sproto *);
 const char * sproto_name(struct sproto_type *);
 
+// for compiling the types, see lsproto.c
+struct sproto_field {
+	const char * name;
+	int tag;
+	int type;	// with SPROTO_TARRAY
+	struct sproto_type * st;
+	int key;
+	int map;
+	int extra;
+};
+
+int sproto_typecount(const struct sproto *);
+struct sproto_type * sproto_typeat(const struct sproto *, int index);
+// -1 if the type is not in the sproto
+int sproto_typeindex(const struct sproto *, const struct sproto_type *);
+int sproto_fieldcount(const struct sproto_type *);
+void sproto_field(const struct sproto_type *, int index, struct sproto_field *);
+
 #endif
@@ -680,8 +680,16 @@ function skynet.exit()
 	coroutine_yield "QUIT"
 end
 
+-- the env value never changes once set, so cache it
+local env_cache = {}
+
 function skynet.getenv(key)
-	return (c.command("GETENV",key))
+	local v = env_cache[key]
+	if v == nil then
+		v = c.command("GETENV",key)
+		env_cache[key] = v
+	end
+	return v
 end
 
 function skynet.setenv(key, value)
@@ -699,6 +707,20 @@ function skynet.rawsend(addr, typename, msg, sz)
 	return c.send(addr, p.id, 0 , msg, sz)
 end
 
+local PTYPE_TAG_SHARED = 0x40000	-- read skynet.h
+
+-- Pack the message once and send the same payload to a list of services,
+-- local receivers share it by reference instead of each getting a copy.
+function skynet.sendshared(addrs, typename, ...)
+	local p = proto[typename]
+	local msg, sz = c.share(p.pack(...))
+	local id = p.id | PTYPE_TAG_SHARED
+	for i = 1, #addrs do
+		c.send(addrs[i], id, 0, msg, sz)
+	end
+	c.unshare(msg)
+end
+
 skynet.genid = assert(c.genid)
 
 skynet.redirect = function(dest,source,typename,...)
@@ -45,14 +45,32 @@ function builder.new(name, v)
 	monitor(pointer)
 end
 
+-- load a datasheet file built by tools/mkdatasheet.lua, the document is mapped read only
+-- and shared with the other processes on the same host.
+-- Replace the file by rename (as mkdatasheet.lua does), rewriting a mapped file in place crashes (SIGBUS).
+function builder.load(name, filename)
+	assert(dataset[name] == nil)
+	local file = core.mapfile(filename)
+	local pointer = core.mappointer(file)
+	skynet.call(address, "lua", "update", name, pointer)
+	cache[file] = pointer
+	dataset[name] = file
+	monitor(pointer)
+end
+
 function builder.update(name, v)
 	local lastversion = assert(dataset[name])
+	local lastkey = lastversion
+	if type(lastversion) ~= "string" then
+		-- loaded from file
+		lastversion = core.mapstring(lastversion)
+	end
 	local newversion = dumpsheet(v)
 	local diff = unique_string(dump.diff(lastversion, newversion))
 	local pointer = core.stringpointer(diff)
 	skynet.call(address, "lua", "update", name, pointer)
 	cache[diff] = pointer
-	local lp = assert(cache[lastversion])
+	local lp = assert(cache[lastkey])
 	skynet.send(address, "lua", "release", lp)
 	dataset[name] = diff
 	monitor(pointer)
@@ -14,6 +14,8 @@ local table = table
 local bson_encode =	bson.encode
 local bson_encode_order	= bson.encode_order
 local bson_decode =	bson.decode
+local bson_decode_lazy = bson.decode_lazy
+local bson_encode_batch = bson.encode_batch
 local bson_int64 = bson.int64
 local empty_bson = bson_encode {}
 
@@ -385,7 +387,7 @@ function mongo_db:auth(user, pass)
 	return auth_func(self, user, pass)
 end
 
-function mongo_db:runCommand(cmd,cmd_v,...)
+local function run_command(self, decode, cmd, cmd_v, ...)
 	local conn = self.connection
 	local request_id = conn:genId()
 	local sock = conn.__sock
@@ -401,7 +403,11 @@ function mongo_db:runCommand(cmd,cmd_v,...)
 	-- we must hold	req	(req.data),	because	req.document is	a lightuserdata, it's a	pointer	to the string (req.data)
 	local req =	sock:request(pack, request_id)
 	local doc =	req.document
-	return bson_decode(doc)
+	return decode(doc)
+end
+
+function mongo_db:runCommand(...)
+	return run_command(self, bson_decode, ...)
 end
 
 --- send command without response
@@ -452,15 +458,15 @@ function mongo_collection:raw_safe_insert(doc)
 	return werror(r)
 end
 
+-- the documents are encoded into one array by bson.encode_batch
 function mongo_collection:batch_insert(docs)
 	for	i=1,#docs do
 		if docs[i]._id == nil then
 			docs[i]._id	= bson.objectid()
 		end
-		docs[i]	= bson_encode(docs[i])
 	end
 
-	self.database:send_command("insert", self.name, "documents", docs)
+	self.database:send_command("insert", self.name, "documents", bson_encode_batch(docs))
 end
 
 mongo_collection.insert_many = mongo_collection.batch_insert
@@ -470,10 +476,9 @@ function mongo_collection:safe_batch_insert(docs)
 		if docs[i]._id == nil then
 			docs[i]._id = bson.objectid()
 		end
-		docs[i] = bson_encode(docs[i])
 	end
 
-	local r = self.database:runCommand("insert", self.name, "documents", docs)
+	local r = self.database:runCommand("insert", self.name, "documents", bson_encode_batch(docs))
 	return werror(r)
 end
 
@@ -627,6 +632,12 @@ function mongo_cursor:maxTimeMS(ms)
 	return self
 end
 
+-- The documents are decoded lazily (bson.decode_lazy), the sub documents are decoded on the first access.
+function mongo_cursor:lazy()
+	self.__lazy = true
+	return self
+end
+
 local opt_func = {}
 
 local function opt_define(name)
@@ -804,14 +815,15 @@ function mongo_cursor:hasNext()
 		local response
 
 		local database = self.__collection.database
+		local decode = self.__lazy and bson_decode_lazy or bson_decode
 		if self.__data == nil then
 			local name = self.__collection.name
-			response = database:runCommand("find", name, "filter", self.__query, "sort", self.__sort,
+			response = run_command(database, decode, "find", name, "filter", self.__query, "sort", self.__sort,
 				"projection", self.__projection, add_opt(self, "skip", "limit", "hint", "maxTimeMS"))
 		else
 			if self.__cursor  and self.__cursor > 0 then
 				local name = self.__collection.name
-				response = database:runCommand("getMore", bson_int64(self.__cursor), "collection", name)
+				response = run_command(database, decode, "getMore", bson_int64(self.__cursor), "collection", name)
 			else
 				-- no more
 				self.__document	= nil
@@ -931,15 +943,16 @@ function aggregate_cursor:hasNext()
 		local ret
 		local name = self.__collection.name
 		local database = self.__collection.database
+		local decode = self.__lazy and bson_decode_lazy or bson_decode
 		if self.__data == nil then
 			if self.__options then
-				ret = database:runCommand("aggregate", name, "pipeline", format_pipeline(self, true), table.unpack(self.__options))
+				ret = run_command(database, decode, "aggregate", name, "pipeline", format_pipeline(self, true), table.unpack(self.__options))
 			else
-				ret = database:runCommand("aggregate", name, "pipeline", format_pipeline(self, true), "cursor", empty_bson)
+				ret = run_command(database, decode, "aggregate", name, "pipeline", format_pipeline(self, true), "cursor", empty_bson)
 			end
 		else
 			if self.__cursor  and self.__cursor > 0 then
-				ret = database:runCommand("getMore", bson_int64(self.__cursor), "collection", name)
+				ret = run_command(database, decode, "getMore", bson_int64(self.__cursor), "collection", name)
 			else
 				-- no more
 				self.__document	= nil
@@ -987,6 +1000,7 @@ aggregate_cursor.skip = mongo_cursor.skip
 aggregate_cursor.limit = mongo_cursor.limit
 aggregate_cursor.next = mongo_cursor.next
 aggregate_cursor.close = mongo_cursor.close
+aggregate_cursor.lazy = mongo_cursor.lazy
 
 --[[
 支持插件式扩展模式
@@ -44,6 +44,24 @@ local function init(skynet, export)
 			skynet.ret(skynet.pack(stat))
 		end
 
+		-- percentiles in microsec, need profile on (and MQ_TIMESTAMP for wait)
+		function dbgcmd.LATENCY()
+			local function summary(what)
+				local count = skynet.stat(what .. ":count")
+				if count == 0 then
+					return
+				end
+				return {
+					count = count,
+					p50 = skynet.stat(what .. ":50"),
+					p99 = skynet.stat(what .. ":99"),
+					p999 = skynet.stat(what .. ":99.9"),
+					max = skynet.stat(what .. ":max"),
+				}
+			end
+			skynet.ret(skynet.pack { handle = summary "handle", wait = summary "wait" })
+		end
+
 		function dbgcmd.KILLTASK(threadname)
 			local co = skynet.killthread(threadname)
 			if co then
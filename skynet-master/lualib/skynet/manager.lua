@@ -29,6 +29,24 @@ function skynet.kill(name)
 	c.command("KILL",name)
 end
 
+-- bind the service to a worker group (see worker_group in config), returns the old group
+function skynet.affinity(name, group)
+	local addr = number_address(name)
+	if addr then
+		name = skynet.address(addr)
+	end
+	return c.intcommand("AFFINITY", name .. " " .. group)
+end
+
+-- set the priority class ("high", "normal" or "background") of the service, returns the old one
+function skynet.priority(name, class)
+	local addr = number_address(name)
+	if addr then
+		name = skynet.address(addr)
+	end
+	return c.command("PRIORITY", name .. " " .. class)
+end
+
 function skynet.abort()
 	c.command("ABORT")
 end
@@ -28,15 +28,17 @@ local function findroot(self)
 	return self
 end
 
-local function update(root, cobj, gcobj)
-	root.__obj = cobj
-	root.__gcobj = gcobj
-	local children = root.__cache
+-- The unchanged sub tables are shared by the new version, so only the replaced paths are resolved again.
+local function update(node, cobj)
+	node.__obj = cobj
+	local children = node.__cache
 	if children then
 		for k,v in pairs(children) do
 			local pointer = index(cobj, k)
 			if type(pointer) == "userdata" then
-				update(v, pointer, gcobj)
+				if pointer ~= v.__obj then
+					update(v, pointer)
+				end
 			else
 				children[k] = nil
 			end
@@ -44,6 +46,18 @@ local function update(root, cobj, gcobj)
 	end
 end
 
+local function detached(self)
+	while self.__parent do
+		local parent = self.__parent
+		local children = parent.__cache
+		if children == nil or children[self.__key] ~= self then
+			return true
+		end
+		self = parent
+	end
+	return false
+end
+
 local function genkey(self)
 	local key = tostring(self.__key)
 	while self.__parent do
@@ -56,16 +70,17 @@ end
 local function getcobj(self)
 	local obj = self.__obj
 	if isdirty(obj) then
-		local newobj, newtbl = needupdate(self.__gcobj)
+		local root = findroot(self)
+		local newobj, newtbl = needupdate(root.__gcobj)
 		if newobj then
-			local newgcobj = newtbl.__gcobj
-			local root = findroot(self)
-			update(root, newobj, newgcobj)
-			if obj == self.__obj then
-				error ("The key [" .. genkey(self) .. "] doesn't exist after update")
-			end
-			obj = self.__obj
+			root.__gcobj = newtbl.__gcobj
+			update(root, newobj)
+		end
+		-- the node may be still shared by the current version, and replaced by a newer one not arrived
+		if obj == self.__obj and detached(self) then
+			error ("The key [" .. genkey(self) .. "] doesn't exist after update")
 		end
+		obj = self.__obj
 	end
 	return obj
 end
@@ -89,7 +104,6 @@ function meta:__index(key)
 		end
 		r = setmetatable({
 			__obj = v,
-			__gcobj = self.__gcobj,
 			__parent = self,
 			__key = key,
 		}, meta)
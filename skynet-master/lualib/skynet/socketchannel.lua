@@ -507,21 +507,40 @@ local function sock_err(self)
 	error(socket_error)
 end
 
-function channel:request(request, response, padding)
-	assert(block_connect(self, true))	-- connect once
+function channel:request(request, response, padding, padding_sz)
+	if padding_sz then
+		-- padding is a malloced buffer, free it if connect failed
+		local ok, err = pcall(block_connect, self, true)
+		if not ok then
+			skynet.trash(padding, padding_sz)
+			error(err)
+		end
+	else
+		assert(block_connect(self, true))	-- connect once
+	end
 	local fd = self.__sock[1]
 
 	if padding then
 		-- padding may be a table, to support multi part request
+		-- or a lightuserdata with padding_sz, all the parts are framed in it
 		-- multi part request use low priority socket write
 		-- now socket_lwrite returns as socket_write
 		if not socket_lwrite(fd , request) then
+			if padding_sz then
+				skynet.trash(padding, padding_sz)
+			end
 			sock_err(self)
 		end
-		for _,v in ipairs(padding) do
-			if not socket_lwrite(fd, v) then
+		if padding_sz then
+			if not socket_lwrite(fd, padding, padding_sz) then
 				sock_err(self)
 			end
+		else
+			for _,v in ipairs(padding) do
+				if not socket_lwrite(fd, v) then
+					sock_err(self)
+				end
+			end
 		end
 	else
 		if not socket_write(fd , request) then
@@ -34,6 +34,10 @@ function gateserver.start(handler)
 	assert(handler.message)
 	assert(handler.connect)
 
+	-- handler.view : handler.message(fd, view, sz) gets the package view (see netpack.filterview) instead of
+	-- a malloced pointer. The view is released by gc (or view:release()), don't free or redirect it.
+	local filter = handler.view and netpack.filterview or netpack.filter
+
 	local listen_context = {}
 
 	function CMD.open( source, conf )
@@ -150,7 +154,7 @@ function gateserver.start(handler)
 		name = "socket",
 		id = skynet.PTYPE_SOCKET,	-- PTYPE_SOCKET = 6
 		unpack = function ( msg, sz )
-			return netpack.filter( queue, msg, sz)
+			return filter( queue, msg, sz)
 		end,
 		dispatch = function (_, _, q, type, ...)
 			queue = q
@@ -38,6 +38,12 @@ function sproto.parse(ptext)
 	return sproto.new(pbin)
 end
 
+-- Compile the types to encode/decode the lua tables in C directly, the output is the same.
+function sproto:compile()
+	self.__compiled = core.compile(self.__cobj)
+	return self
+end
+
 function sproto:host( packagename )
 	packagename = packagename or  "package"
 	local obj = {
@@ -69,22 +75,22 @@ end
 
 function sproto:encode(typename, tbl)
 	local st = querytype(self, typename)
-	return core.encode(st, tbl)
+	return core.cencode(self.__compiled, st, tbl)
 end
 
 function sproto:decode(typename, ...)
 	local st = querytype(self, typename)
-	return core.decode(st, ...)
+	return core.cdecode(self.__compiled, st, ...)
 end
 
 function sproto:pencode(typename, tbl)
 	local st = querytype(self, typename)
-	return core.pack(core.encode(st, tbl))
+	return core.pack(core.cencode(self.__compiled, st, tbl))
 end
 
 function sproto:pdecode(typename, ...)
 	local st = querytype(self, typename)
-	return core.decode(st, core.unpack(...))
+	return core.cdecode(self.__compiled, st, core.unpack(...))
 end
 
 local function queryproto(self, pname)
@@ -122,7 +128,7 @@ function sproto:request_encode(protoname, tbl)
 	local p = queryproto(self, protoname)
 	local request = p.request
 	if request then
-		return core.encode(request,tbl) , p.tag
+		return core.cencode(self.__compiled, request, tbl) , p.tag
 	else
 		return "" , p.tag
 	end
@@ -132,7 +138,7 @@ function sproto:response_encode(protoname, tbl)
 	local p = queryproto(self, protoname)
 	local response = p.response
 	if response then
-		return core.encode(response,tbl)
+		return core.cencode(self.__compiled, response, tbl)
 	else
 		return ""
 	end
@@ -142,7 +148,7 @@ function sproto:request_decode(protoname, ...)
 	local p = queryproto(self, protoname)
 	local request = p.request
 	if request then
-		return core.decode(request,...) , p.name
+		return core.cdecode(self.__compiled, request, ...) , p.name
 	else
 		return nil, p.name
 	end
@@ -152,7 +158,7 @@ function sproto:response_decode(protoname, ...)
 	local p = queryproto(self, protoname)
 	local response = p.response
 	if response then
-		return core.decode(response,...)
+		return core.cdecode(self.__compiled, response, ...)
 	end
 end
 
@@ -185,9 +191,10 @@ local function gen_response(self, response, session)
 		header_tmp.type = nil
 		header_tmp.session = session
 		header_tmp.ud = ud
-		local header = core.encode(self.__package, header_tmp)
+		local compiled = self.__proto.__compiled
+		local header = core.cencode(compiled, self.__package, header_tmp)
 		if response then
-			local content = core.encode(response, args)
+			local content = core.cencode(compiled, response, args)
 			return core.pack(header .. content)
 		else
 			return core.pack(header)
@@ -197,17 +204,18 @@ end
 
 function host:dispatch(...)
 	local bin = core.unpack(...)
+	local compiled = self.__proto.__compiled
 	header_tmp.type = nil
 	header_tmp.session = nil
 	header_tmp.ud = nil
-	local header, size = core.decode(self.__package, bin, header_tmp)
+	local header, size = core.cdecode(compiled, self.__package, bin, header_tmp)
 	local content = bin:sub(size + 1)
 	if header.type then
 		-- request
 		local proto = queryproto(self.__proto, header.type)
 		local result
 		if proto.request then
-			result = core.decode(proto.request, content)
+			result = core.cdecode(compiled, proto.request, content)
 		end
 		if header_tmp.session then
 			return "REQUEST", proto.name, result, gen_response(self, proto.response, header_tmp.session), header.ud
@@ -222,7 +230,7 @@ function host:dispatch(...)
 		if response == true then
 			return "RESPONSE", session, nil, header.ud
 		else
-			local result = core.decode(response, content)
+			local result = core.cdecode(compiled, response, content)
 			return "RESPONSE", session, result, header.ud
 		end
 	end
@@ -234,14 +242,14 @@ function host:attach(sp)
 		header_tmp.type = proto.tag
 		header_tmp.session = session
 		header_tmp.ud = ud
-		local header = core.encode(self.__package, header_tmp)
+		local header = core.cencode(self.__proto.__compiled, self.__package, header_tmp)
 
 		if session then
 			self.__session[session] = proto.response or true
 		end
 
 		if proto.request then
-			local content = core.encode(proto.request, args)
+			local content = core.cencode(sp.__compiled, proto.request, args)
 			return core.pack(header ..  content)
 		else
 			return core.pack(header)
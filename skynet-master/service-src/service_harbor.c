@@ -27,6 +27,14 @@
 // 12 is sizeof(struct remote_message_header)
 #define HEADER_COOKIE_LENGTH 12
 
+// The outbound messages to a harbor are coalesced into one buffer, and flushed when the message queue
+// of harbor is empty, or the buffer reaches HARBOR_FLUSH_SIZE, or after HARBOR_FLUSH_TIMEOUT (1/100 sec).
+// The buffer is given to the socket thread at each flush, so it grows from HARBOR_BUFFER_MIN,
+// and a flush of a few messages doesn't take a whole HARBOR_FLUSH_SIZE block.
+#define HARBOR_FLUSH_SIZE (64 * 1024)
+#define HARBOR_BUFFER_MIN 256
+#define HARBOR_FLUSH_TIMEOUT "1"
+
 /*
 	message type (8bits) is in destination high 8bits
 	harbor id (8bits) is also in that place , but remote message doesn't need harbor id.
@@ -76,6 +84,10 @@ struct slave {
 	int read;
 	uint8_t size[4];
 	char * recv_buffer;
+	uint8_t * send_buffer;
+	int send_size;
+	int send_cap;
+	int dirty;
 };
 
 struct harbor {
@@ -83,6 +95,9 @@ struct harbor {
 	int id;
 	uint32_t slave;
 	struct hashmap * map;
+	int flush_timer;
+	int dirty_n;
+	uint8_t dirty[REMOTE_MAX];	// the slaves with send_buffer
 	struct slave s[REMOTE_MAX];
 };
 
@@ -231,6 +246,12 @@ static void
 close_harbor(struct harbor *h, int id) {
 	struct slave *s = &h->s[id];
 	s->status = STATUS_DOWN;
+	if (s->send_buffer) {
+		skynet_free(s->send_buffer);
+		s->send_buffer = NULL;
+		s->send_size = 0;
+		s->send_cap = 0;
+	}
 	if (s->fd) {
 		skynet_socket_close(h->ctx, s->fd);
 		s->fd = 0;
@@ -330,25 +351,79 @@ forward_local_messsage(struct harbor *h, void *msg, int sz) {
 }
 
 static void
-send_remote(struct skynet_context * ctx, int fd, const char * buffer, size_t sz, struct remote_message_header * cookie) {
+flush_remote(struct harbor *h, struct slave *s) {
+	if (s->send_size > 0) {
+		// ignore send error, because if the connection is broken, the mainloop will recv a message.
+		skynet_socket_send(h->ctx, s->fd, s->send_buffer, s->send_size);
+		s->send_buffer = NULL;
+		s->send_size = 0;
+		s->send_cap = 0;
+	}
+}
+
+static void
+flush_all(struct harbor *h) {
+	int i;
+	for (i=0;i<h->dirty_n;i++) {
+		struct slave *s = &h->s[h->dirty[i]];
+		flush_remote(h, s);
+		s->dirty = 0;
+	}
+	h->dirty_n = 0;
+}
+
+// flush at once if no more messages in the queue, or wait for more messages (in HARBOR_FLUSH_TIMEOUT)
+static void
+check_flush(struct harbor *h) {
+	if (h->dirty_n == 0)
+		return;
+	const char * mqlen = skynet_command(h->ctx, "STAT", "mqlen");
+	if (strtol(mqlen, NULL, 10) == 0) {
+		flush_all(h);
+	} else if (!h->flush_timer) {
+		h->flush_timer = 1;
+		skynet_command(h->ctx, "TIMEOUT", HARBOR_FLUSH_TIMEOUT);
+	}
+}
+
+static void
+send_remote(struct harbor *h, int id, const char * buffer, size_t sz, struct remote_message_header * cookie) {
+	struct slave *s = &h->s[id];
 	size_t sz_header = sz+sizeof(*cookie);
 	if (sz_header > UINT32_MAX) {
-		skynet_error(ctx, "remote message from :%08x to :%08x is too large.", cookie->source, cookie->destination);
+		skynet_error(h->ctx, "remote message from :%08x to :%08x is too large.", cookie->source, cookie->destination);
 		return;
 	}
-	uint8_t sendbuf[sz_header+4];
+	size_t need = sz_header + 4;
+	if (s->send_size + need > HARBOR_FLUSH_SIZE) {
+		flush_remote(h, s);
+	}
+	uint8_t * sendbuf;
+	if (need > HARBOR_FLUSH_SIZE) {
+		// large message, send it alone
+		sendbuf = skynet_malloc(need);
+	} else {
+		if (s->send_size + need > s->send_cap) {
+			int cap = s->send_cap ? s->send_cap : HARBOR_BUFFER_MIN;
+			while (cap < s->send_size + need) {
+				cap *= 2;
+			}
+			s->send_buffer = skynet_realloc(s->send_buffer, cap);
+			s->send_cap = cap;
+		}
+		if (!s->dirty) {
+			s->dirty = 1;
+			h->dirty[h->dirty_n++] = id;
+		}
+		sendbuf = s->send_buffer + s->send_size;
+		s->send_size += need;
+	}
 	to_bigendian(sendbuf, (uint32_t)sz_header);
 	memcpy(sendbuf+4, buffer, sz);
 	header_to_message(cookie, sendbuf+4+sz);
-
-	struct socket_sendbuffer tmp;
-	tmp.id = fd;
-	tmp.type = SOCKET_BUFFER_RAWPOINTER;
-	tmp.buffer = sendbuf;
-	tmp.sz = sz_header+4;
-
-	// ignore send error, because if the connection is broken, the mainloop will recv a message.
-	skynet_socket_sendbuffer(ctx, &tmp);
+	if (need > HARBOR_FLUSH_SIZE) {
+		skynet_socket_send(h->ctx, s->fd, sendbuf, need);
+	}
 }
 
 static void
@@ -391,7 +466,7 @@ dispatch_name_queue(struct harbor *h, struct keyvalue * node) {
 	struct harbor_msg * m;
 	while ((m = pop_queue(queue)) != NULL) {
 		m->header.destination |= (handle & HANDLE_MASK);
-		send_remote(context, fd, m->buffer, m->size, &m->header);
+		send_remote(h, harbor_id, m->buffer, m->size, &m->header);
 		skynet_free(m->buffer);
 	}
 }
@@ -399,8 +474,7 @@ dispatch_name_queue(struct harbor *h, struct keyvalue * node) {
 static void
 dispatch_queue(struct harbor *h, int id) {
 	struct slave *s = &h->s[id];
-	int fd = s->fd;
-	assert(fd != 0);
+	assert(s->fd != 0);
 
 	struct harbor_msg_queue *queue = s->queue;
 	if (queue == NULL)
@@ -408,7 +482,7 @@ dispatch_queue(struct harbor *h, int id) {
 
 	struct harbor_msg * m;
 	while ((m = pop_queue(queue)) != NULL) {
-		send_remote(h->ctx, fd, m->buffer, m->size, &m->header);
+		send_remote(h, id, m->buffer, m->size, &m->header);
 		skynet_free(m->buffer);
 	}
 	release_queue(queue);
@@ -556,7 +630,7 @@ remote_send_handle(struct harbor *h, uint32_t source, uint32_t destination, int
 		cookie.source = source;
 		cookie.destination = (destination & HANDLE_MASK) | ((uint32_t)type << HANDLE_REMOTE_SHIFT);
 		cookie.session = (uint32_t)session;
-		send_remote(context, s->fd, msg,sz,&cookie);
+		send_remote(h, harbor_id, msg,sz,&cookie);
 	}
 
 	return 0;
@@ -664,8 +738,8 @@ harbor_id(struct harbor *h, int fd) {
 }
 
 static int
-mainloop(struct skynet_context * context, void * ud, int type, int session, uint32_t source, const void * msg, size_t sz) {
-	struct harbor * h = ud;
+harbor_dispatch(struct harbor * h, int type, int session, uint32_t source, const void * msg, size_t sz) {
+	struct skynet_context * context = h->ctx;
 	switch (type) {
 	case PTYPE_SOCKET: {
 		const struct skynet_socket_message * message = msg;
@@ -704,6 +778,12 @@ mainloop(struct skynet_context * context, void * ud, int type, int session, uint
 		harbor_command(h, msg,sz,session,source);
 		return 0;
 	}
+	case PTYPE_RESPONSE: {
+		// flush timer
+		h->flush_timer = 0;
+		flush_all(h);
+		return 0;
+	}
 	case PTYPE_SYSTEM : {
 		// remote message out
 		const struct remote_message *rmsg = msg;
@@ -728,6 +808,14 @@ mainloop(struct skynet_context * context, void * ud, int type, int session, uint
 	}
 }
 
+static int
+mainloop(struct skynet_context * context, void * ud, int type, int session, uint32_t source, const void * msg, size_t sz) {
+	struct harbor * h = ud;
+	int r = harbor_dispatch(h, type, session, source, msg, sz);
+	check_flush(h);
+	return r;
+}
+
 int
 harbor_init(struct harbor *h, struct skynet_context *ctx, const char * args) {
 	h->ctx = ctx;
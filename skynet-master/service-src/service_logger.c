@@ -1,68 +1,214 @@
 #include "skynet.h"
 
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
 #include <time.h>
 
+// The logger formats the lines into a buffer, and a writer thread writes the buffer in batch,
+// so the logger never stalls on disk. The writer flushes every LOG_FLUSH_INTERVAL ms,
+// or as soon as LOG_FLUSH_SIZE bytes are pending.
+
+#define LOG_FLUSH_INTERVAL 100
+#define LOG_FLUSH_SIZE (64 * 1024)
+// the logger waits for the writer when too many bytes are pending
+#define LOG_BUFFER_MAX (64 * 1024 * 1024)
+
+struct logbuffer {
+	char * buf;
+	size_t sz;
+	size_t cap;
+};
+
 struct logger {
 	FILE * handle;
 	char * filename;
 	uint32_t starttime;
 	int close;
+	// timestamp cache, reformat only when the second changes
+	uint64_t timesec;
+	char timestr[64];
+	// writer thread
+	pthread_t writer;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	pthread_cond_t space;
+	struct logbuffer front;
+	struct logbuffer back;
+	int reopen;
+	int quit;
+	int running;
 };
 
+// for flushing the pending lines at exit, see bootstrap in skynet_start.c
+static struct logger * LOGGER = NULL;
+
 struct logger *
 logger_create(void) {
 	struct logger * inst = skynet_malloc(sizeof(*inst));
+	memset(inst, 0, sizeof(*inst));
 	inst->handle = NULL;
 	inst->close = 0;
 	inst->filename = NULL;
+	inst->timesec = (uint64_t)-1;
 
 	return inst;
 }
 
+static void
+writer_stop(struct logger * inst) {
+	if (!inst->running)
+		return;
+	pthread_mutex_lock(&inst->mutex);
+	inst->quit = 1;
+	pthread_cond_signal(&inst->cond);
+	pthread_mutex_unlock(&inst->mutex);
+	pthread_join(inst->writer, NULL);
+	inst->running = 0;
+}
+
+static void
+logger_exit(void) {
+	struct logger * inst = LOGGER;
+	if (inst) {
+		writer_stop(inst);
+	}
+}
+
 void
 logger_release(struct logger * inst) {
+	if (LOGGER == inst) {
+		LOGGER = NULL;
+	}
+	writer_stop(inst);
 	if (inst->close) {
 		fclose(inst->handle);
 	}
+	pthread_mutex_destroy(&inst->mutex);
+	pthread_cond_destroy(&inst->cond);
+	pthread_cond_destroy(&inst->space);
+	skynet_free(inst->front.buf);
+	skynet_free(inst->back.buf);
 	skynet_free(inst->filename);
 	skynet_free(inst);
 }
 
-#define SIZETIMEFMT	250
+static void
+write_buffer(struct logger * inst, struct logbuffer * b) {
+	if (b->sz > 0) {
+		fwrite(b->buf, b->sz, 1, inst->handle);
+		fflush(inst->handle);
+		b->sz = 0;
+	}
+}
+
+static void *
+writer_thread(void * p) {
+	struct logger * inst = p;
+	pthread_mutex_lock(&inst->mutex);
+	for (;;) {
+		if (inst->front.sz < LOG_FLUSH_SIZE && !inst->reopen && !inst->quit) {
+			struct timespec ti;
+			clock_gettime(CLOCK_REALTIME, &ti);
+			ti.tv_nsec += LOG_FLUSH_INTERVAL * 1000000L;
+			if (ti.tv_nsec >= 1000000000L) {
+				ti.tv_sec += ti.tv_nsec / 1000000000L;
+				ti.tv_nsec %= 1000000000L;
+			}
+			pthread_cond_timedwait(&inst->cond, &inst->mutex, &ti);
+		}
+		struct logbuffer tmp = inst->back;
+		inst->back = inst->front;
+		inst->front = tmp;
+		int reopen = inst->reopen;
+		int quit = inst->quit;
+		inst->reopen = 0;
+		pthread_mutex_unlock(&inst->mutex);
+
+		write_buffer(inst, &inst->back);
+		if (reopen && inst->filename) {
+			inst->handle = freopen(inst->filename, "a", inst->handle);
+		}
+
+		pthread_mutex_lock(&inst->mutex);
+		pthread_cond_broadcast(&inst->space);
+		if (quit && inst->front.sz == 0)
+			break;
+	}
+	pthread_mutex_unlock(&inst->mutex);
+	return NULL;
+}
+
+static void
+reserve_buffer(struct logbuffer * b, size_t sz) {
+	if (b->sz + sz > b->cap) {
+		size_t cap = b->cap ? b->cap : LOG_FLUSH_SIZE;
+		while (cap < b->sz + sz) {
+			cap *= 2;
+		}
+		b->buf = skynet_realloc(b->buf, cap);
+		b->cap = cap;
+	}
+}
 
 static int
-timestring(struct logger *inst, char tmp[SIZETIMEFMT]) {
+timestring(struct logger *inst, const char ** str) {
 	uint64_t now = skynet_now();
-	time_t ti = now/100 + inst->starttime;
-	struct tm info;
-	(void)localtime_r(&ti,&info);
-	strftime(tmp, SIZETIMEFMT, "%d/%m/%y %H:%M:%S", &info);
+	uint64_t sec = now / 100;
+	if (sec != inst->timesec) {
+		time_t ti = sec + inst->starttime;
+		struct tm info;
+		(void)localtime_r(&ti,&info);
+		strftime(inst->timestr, sizeof(inst->timestr), "%d/%m/%y %H:%M:%S", &info);
+		inst->timesec = sec;
+	}
+	*str = inst->timestr;
 	return now % 100;
 }
 
+static void
+append_line(struct logger * inst, uint32_t source, const void * msg, size_t sz) {
+	char prefix[128];
+	int n = 0;
+	if (inst->filename) {
+		const char * timestr;
+		int csec = timestring(inst, &timestr);
+		n = snprintf(prefix, sizeof(prefix), "%s.%02d ", timestr, csec);
+	}
+	n += snprintf(prefix + n, sizeof(prefix) - n, "[:%08x] ", source);
+
+	pthread_mutex_lock(&inst->mutex);
+	while (inst->front.sz > LOG_BUFFER_MAX) {
+		pthread_cond_wait(&inst->space, &inst->mutex);
+	}
+	struct logbuffer * b = &inst->front;
+	reserve_buffer(b, n + sz + 1);
+	memcpy(b->buf + b->sz, prefix, n);
+	memcpy(b->buf + b->sz + n, msg, sz);
+	b->buf[b->sz + n + sz] = '\n';
+	b->sz += n + sz + 1;
+	if (b->sz >= LOG_FLUSH_SIZE) {
+		pthread_cond_signal(&inst->cond);
+	}
+	pthread_mutex_unlock(&inst->mutex);
+}
+
 static int
 logger_cb(struct skynet_context * context, void *ud, int type, int session, uint32_t source, const void * msg, size_t sz) {
 	struct logger * inst = ud;
 	switch (type) {
 	case PTYPE_SYSTEM:
 		if (inst->filename) {
-			inst->handle = freopen(inst->filename, "a", inst->handle);
+			pthread_mutex_lock(&inst->mutex);
+			inst->reopen = 1;
+			pthread_cond_signal(&inst->cond);
+			pthread_mutex_unlock(&inst->mutex);
 		}
 		break;
 	case PTYPE_TEXT:
-		if (inst->filename) {
-			char tmp[SIZETIMEFMT];
-			int csec = timestring(ud, tmp);
-			fprintf(inst->handle, "%s.%02d ", tmp, csec);
-		}
-		fprintf(inst->handle, "[:%08x] ", source);
-		fwrite(msg, sz , 1, inst->handle);
-		fprintf(inst->handle, "\n");
-		fflush(inst->handle);
+		append_line(inst, source, msg, sz);
 		break;
 	}
 
@@ -85,6 +231,17 @@ logger_init(struct logger * inst, struct skynet_context *ctx, const char * parm)
 		inst->handle = stdout;
 	}
 	if (inst->handle) {
+		pthread_mutex_init(&inst->mutex, NULL);
+		pthread_cond_init(&inst->cond, NULL);
+		pthread_cond_init(&inst->space, NULL);
+		if (pthread_create(&inst->writer, NULL, writer_thread, inst)) {
+			return 1;
+		}
+		inst->running = 1;
+		if (LOGGER == NULL) {
+			LOGGER = inst;
+			atexit(logger_exit);
+		}
 		skynet_callback(ctx, inst, logger_cb);
 		return 0;
 	}
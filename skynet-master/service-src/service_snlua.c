@@ -5,6 +5,7 @@
 #include <lualib.h>
 #include <lauxlib.h>
 
+#include <pthread.h>
 #include <assert.h>
 #include <string.h>
 #include <stdlib.h>
@@ -31,6 +32,8 @@ struct snlua {
 	size_t mem_limit;
 	lua_State * activeL;
 	ATOM_INT trap;
+	ATOM_INT trace;
+	struct skynet_larena * arena;
 };
 
 // LUA_CACHELIB may defined in patched lua for shared proto
@@ -67,6 +70,12 @@ signal_hook(lua_State *L, lua_Debug *ar) {
 	struct snlua *l = (struct snlua *)ud;
 
 	lua_sethook (L, NULL, 0, 0);
+	if (ATOM_LOAD(&l->trace)) {
+		ATOM_STORE(&l->trace , 0);
+		luaL_traceback(L, L, NULL, 0);
+		skynet_error(l->ctx, "Slow message %s", lua_tostring(L, -1));
+		lua_pop(L, 1);
+	}
 	if (ATOM_LOAD(&l->trap)) {
 		ATOM_STORE(&l->trap , 0);
 		luaL_error(L, "signal 0");
@@ -76,7 +85,7 @@ signal_hook(lua_State *L, lua_Debug *ar) {
 static void
 switchL(lua_State *L, struct snlua *l) {
 	l->activeL = L;
-	if (ATOM_LOAD(&l->trap)) {
+	if (ATOM_LOAD(&l->trap) || ATOM_LOAD(&l->trace)) {
 		lua_sethook(L, signal_hook, LUA_MASKCOUNT, 1);
 	}
 }
@@ -92,6 +101,16 @@ lua_resumeX(lua_State *L, lua_State *from, int nargs, int *nresults) {
 		// wait for lua_sethook. (l->trap == -1)
 		while (ATOM_LOAD(&l->trap) >= 0) ;
 	}
+	// wait for lua_sethook of signal 2
+	while (ATOM_LOAD(&l->trace) > 0) ;
+	if (from == l->L && ATOM_LOAD(&l->trace) < 0) {
+		// The slow message finishes before the hook, drop the traceback request,
+		// or else it's logged in the next unrelated message, and blocks the later requests.
+		// The hook left on a nested coroutine does nothing when trace is 0.
+		if (ATOM_CAS(&l->trace, -1, 0) && ATOM_LOAD(&l->trap) == 0) {
+			lua_sethook(L, NULL, 0, 0);
+		}
+	}
 	switchL(from, l);
 	return err;
 }
@@ -380,10 +399,9 @@ optstring(struct skynet_context *ctx, const char *key, const char * str) {
 	return ret;
 }
 
-static int
-init_cb(struct snlua *l, struct skynet_context *ctx, const char * args, size_t sz) {
-	lua_State *L = l->L;
-	l->ctx = ctx;
+// open the libraries which don't depend on the service, it may run before the service is created (see statepool)
+static void
+prepare_state(lua_State *L) {
 	lua_gc(L, LUA_GCSTOP, 0);
 	lua_pushboolean(L, 1);  /* signal for libraries to ignore env. vars. */
 	lua_setfield(L, LUA_REGISTRYINDEX, "LUA_NOENV");
@@ -400,10 +418,30 @@ init_cb(struct snlua *l, struct skynet_context *ctx, const char * args, size_t s
 
 	lua_settop(L, profile_lib-1);
 
-	lua_pushlightuserdata(L, ctx);
-	lua_setfield(L, LUA_REGISTRYINDEX, "skynet_context");
 	luaL_requiref(L, "skynet.codecache", codecache , 0);
 	lua_pop(L,1);
+}
+
+static struct snlua * statepool_pop(int node);
+static void snlua_newstate(struct snlua *l);
+static void snlua_adopt(struct snlua *l, struct snlua *from);
+
+static int
+init_cb(struct snlua *l, struct skynet_context *ctx, const char * args, size_t sz) {
+	if (l->L == NULL) {
+		// numa is on, create the state on the home node of service (see snlua_create)
+		struct snlua * pooled = statepool_pop(skynet_numa_node());
+		if (pooled) {
+			snlua_adopt(l, pooled);
+		} else {
+			snlua_newstate(l);
+		}
+	}
+	lua_State *L = l->L;
+	l->ctx = ctx;
+
+	lua_pushlightuserdata(L, ctx);
+	lua_setfield(L, LUA_REGISTRYINDEX, "skynet_context");
 
 	lua_gc(L, LUA_GCGEN, 0, 0);
 
@@ -496,6 +534,9 @@ lalloc(void * ud, void *ptr, size_t osize, size_t nsize) {
 		l->mem_report *= 2;
 		skynet_error(l->ctx, "Memory warning %.2f M", (float)l->mem / (1024 * 1024));
 	}
+	if (l->arena) {
+		return skynet_larena_alloc(l->arena, ptr, osize, nsize);
+	}
 	return skynet_lalloc(ptr, osize, nsize);
 }
 
@@ -513,27 +554,164 @@ global_seed() {
 	return ret;
 }
 
-struct snlua *
-snlua_create(void) {
+static struct snlua *
+snlua_alloc(void) {
 	struct snlua * l = skynet_malloc(sizeof(*l));
 	memset(l,0,sizeof(*l));
 	l->mem_report = MEMORY_WARNING_REPORT;
 	l->mem_limit = 0;
-	l->L = lua_newstate(lalloc, l, global_seed());
 	l->activeL = NULL;
 	ATOM_INIT(&l->trap , 0);
+	ATOM_INIT(&l->trace , 0);
+	return l;
+}
+
+static void
+snlua_newstate(struct snlua *l) {
+	// lua_arena = true : each lua service allocates from its own arena, which is dropped at once when the service exits
+	const char * arena = skynet_command(NULL, "GETENV", "lua_arena");
+	if (arena && strcmp(arena, "true") == 0) {
+		l->arena = skynet_larena_new();
+	}
+	l->L = lua_newstate(lalloc, l, global_seed());
+	prepare_state(l->L);
+}
+
+static struct snlua *
+snlua_new(void) {
+	struct snlua * l = snlua_alloc();
+	snlua_newstate(l);
+	return l;
+}
+
+// move the prepared state of a pooled snlua into l
+static void
+snlua_adopt(struct snlua *l, struct snlua *from) {
+	l->L = from->L;
+	l->arena = from->arena;
+	l->mem = from->mem;
+	l->mem_report = from->mem_report;
+	lua_setallocf(l->L, lalloc, l);
+	skynet_free(from);
+}
+
+// lua_statepool = n : keep n prepared lua states, a background thread refills the pool,
+// so spawning a service doesn't pay for opening the libraries in the worker threads.
+// The bytecode of lua files is already shared by the code cache (see LUA_CACHELIB).
+// When numa is on, each node has its own pool of n states, refilled by a thread bound to the node.
+
+struct statepool {
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	int node;
+	int size;
+	int n;
+	struct snlua ** slot;
+};
+
+static struct statepool * POOL = NULL;
+static int POOL_N = 0;
+static pthread_once_t POOL_ONCE = PTHREAD_ONCE_INIT;
+
+static void *
+statepool_refill(void *p) {
+	struct statepool *pool = p;
+	if (pool->node >= 0) {
+		skynet_numa_bind(pool->node);
+	}
+	for (;;) {
+		pthread_mutex_lock(&pool->mutex);
+		while (pool->n >= pool->size) {
+			pthread_cond_wait(&pool->cond, &pool->mutex);
+		}
+		pthread_mutex_unlock(&pool->mutex);
+		struct snlua * l = snlua_new();
+		pthread_mutex_lock(&pool->mutex);
+		pool->slot[pool->n++] = l;
+		pthread_mutex_unlock(&pool->mutex);
+	}
+	return NULL;
+}
+
+static void
+statepool_init(void) {
+	const char * size = skynet_command(NULL, "GETENV", "lua_statepool");
+	int n = size ? strtol(size, NULL, 10) : 0;
+	if (n <= 0)
+		return;
+	int nodes = skynet_numa_nodes();
+	int count = nodes > 1 ? nodes : 1;
+	struct statepool * pools = skynet_malloc(count * sizeof(*pools));
+	int i;
+	for (i=0;i<count;i++) {
+		struct statepool * pool = &pools[i];
+		pthread_mutex_init(&pool->mutex, NULL);
+		pthread_cond_init(&pool->cond, NULL);
+		pool->node = nodes > 1 ? i : -1;
+		pool->size = n;
+		pool->n = 0;
+		pool->slot = skynet_malloc(n * sizeof(struct snlua *));
+		pthread_t pid;
+		if (pthread_create(&pid, NULL, statepool_refill, pool)) {
+			skynet_error(NULL, "error: Can't create lua state pool thread");
+			return;
+		}
+		pthread_detach(pid);
+	}
+	POOL = pools;
+	POOL_N = count;
+}
+
+static struct snlua *
+statepool_pop(int node) {
+	pthread_once(&POOL_ONCE, statepool_init);
+	if (POOL == NULL)
+		return NULL;
+	if (node < 0 || node >= POOL_N)
+		node = 0;
+	struct statepool * pool = &POOL[node];
+	struct snlua * l = NULL;
+	pthread_mutex_lock(&pool->mutex);
+	if (pool->n > 0) {
+		l = pool->slot[--pool->n];
+	}
+	pthread_cond_signal(&pool->cond);
+	pthread_mutex_unlock(&pool->mutex);
+	return l;
+}
+
+struct snlua *
+snlua_create(void) {
+	if (skynet_numa_nodes() > 1) {
+		// The creator may run on another node, create the state in init_cb,
+		// which runs on the home node chosen by skynet_context_new.
+		return snlua_alloc();
+	}
+	struct snlua * l = statepool_pop(0);
+	if (l == NULL) {
+		l = snlua_new();
+	}
 	return l;
 }
 
 void
 snlua_release(struct snlua *l) {
-	lua_close(l->L);
+	if (l->L) {
+		lua_close(l->L);
+	}
+	if (l->arena) {
+		skynet_larena_delete(l->arena);
+	}
 	skynet_free(l);
 }
 
 void
 snlua_signal(struct snlua *l, int signal) {
 	skynet_error(l->ctx, "recv a signal %d", signal);
+	if (l->L == NULL) {
+		// not initialized
+		return;
+	}
 	if (signal == 0) {
 		if (ATOM_LOAD(&l->trap) == 0) {
 			// only one thread can set trap ( l->trap 0->1 )
@@ -545,5 +723,14 @@ snlua_signal(struct snlua *l, int signal) {
 		}
 	} else if (signal == 1) {
 		skynet_error(l->ctx, "Current Memory %.3fK", (float)l->mem / 1024);
+	} else if (signal == 2) {
+		// log the traceback of current coroutine, the monitor sends it for slow message
+		if (ATOM_LOAD(&l->trace) == 0) {
+			if (!ATOM_CAS(&l->trace, 0, 1))
+				return;
+			// activeL is NULL before the first coroutine resumes (service init)
+			lua_sethook (l->activeL ? l->activeL : l->L, signal_hook, LUA_MASKCOUNT, 1);
+			ATOM_CAS(&l->trace, 1, -1);
+		}
 	}
 }
@@ -9,6 +9,9 @@ gate = tonumber(gate)
 fd = tonumber(fd)
 
 local large_request = {}
+-- the bytes of the large requests in assembling, each is preallocated by the size in the header
+local large_inflight = 0
+local large_limit = tonumber(skynet.getenv "cluster_large_limit") or 0x8000000	-- 128M
 local inquery_name = {}
 local register_name
 
@@ -52,25 +55,51 @@ local function dispatch_request(_,_,addr, session, msg, sz, padding, is_push)
 		return
 	end
 	if padding then
-		local req = large_request[session] or { addr = addr , is_push = is_push, tracetag = tracetag }
-		tracetag = nil
-		large_request[session] = req
-		cluster.append(req, msg, sz)
+		local req = large_request[session]
+		if req == nil then
+			-- the header of multi parts, sz is the size of whole message
+			req = { addr = addr , is_push = is_push, tracetag = tracetag, size = sz }
+			tracetag = nil
+			large_request[session] = req
+			if large_inflight + sz <= large_limit then
+				large_inflight = large_inflight + sz
+				req.buffer = cluster.buffer(sz)
+			else
+				skynet.error(string.format("Large request (%d bytes) exceeds cluster_large_limit", sz))
+			end
+		elseif req.buffer then
+			-- msg points into the package, append it before yield
+			if not cluster.append(req.buffer, msg, sz) then
+				large_inflight = large_inflight - req.size
+				req.buffer = nil
+			end
+		end
 		return
 	else
 		local req = large_request[session]
 		if req then
 			tracetag = req.tracetag
 			large_request[session] = nil
-			cluster.append(req, msg, sz)
-			msg,sz = cluster.concat(req)
+			if req.buffer then
+				large_inflight = large_inflight - req.size
+				if cluster.append(req.buffer, msg, sz) then
+					msg,sz = cluster.concat(req.buffer)
+				else
+					msg = nil
+				end
+			else
+				msg = nil
+			end
 			addr = req.addr
 			is_push = req.is_push
 		end
 		if not msg then
 			tracetag = nil
-			local response = cluster.packresponse(session, false, "Invalid large req")
-			socket.write(fd, response)
+			if not is_push then
+				-- the sender never waits for the response of push
+				local response = cluster.packresponse(session, false, "Invalid large req")
+				socket.write(fd, response)
+			end
 			return
 		end
 	end
@@ -109,11 +138,11 @@ local function dispatch_request(_,_,addr, session, msg, sz, padding, is_push)
 		end
 	end
 	if ok then
-		response = cluster.packresponse(session, true, msg, sz)
-		if type(response) == "table" then
-			for _, v in ipairs(response) do
-				socket.lwrite(fd, v)
-			end
+		local response_sz
+		response, response_sz = cluster.packresponse(session, true, msg, sz)
+		if response_sz then
+			-- large response, all the parts are framed in it
+			socket.lwrite(fd, response, response_sz)
 		else
 			socket.write(fd, response)
 		end
@@ -8,11 +8,24 @@ local session = 1
 local node, nodename, init_host, init_port = ...
 
 local command = {}
+-- session -> buffer, the multi parts of large responses are assembled into them
+-- (or the reason string of a dropped response)
+local large_response = {}
+-- session -> size, the bytes of the large responses in assembling, each is preallocated by the size in the header
+local large_size = {}
+local large_inflight = 0
+local large_limit = tonumber(skynet.getenv "cluster_large_limit") or 0x8000000	-- 128M
+
+local function reset_large()
+	large_response = {}
+	large_size = {}
+	large_inflight = 0
+end
 
 local function send_request(addr, msg, sz)
 	-- msg is a local pointer, cluster.packrequest will free it
 	local current_session = session
-	local request, new_session, padding = cluster.packrequest(addr, session, msg, sz)
+	local request, new_session, padding, padding_sz = cluster.packrequest(addr, session, msg, sz)
 	session = new_session
 
 	local tracetag = skynet.tracetag()
@@ -24,15 +37,22 @@ local function send_request(addr, msg, sz)
 			tracetag = newtag
 		end
 		skynet.tracelog(tracetag, string.format("cluster %s", node))
-		channel:request(cluster.packtrace(tracetag))
+		local ok, err = pcall(channel.request, channel, cluster.packtrace(tracetag))
+		if not ok then
+			if padding_sz then
+				skynet.trash(padding, padding_sz)
+			end
+			error(err)
+		end
 	end
-	return channel:request(request, current_session, padding)
+	return channel:request(request, current_session, padding, padding_sz)
 end
 
 function command.req(...)
 	local ok, msg = pcall(send_request, ...)
 	if ok then
-		if type(msg) == "table" then
+		if type(msg) ~= "string" then
+			-- large response assembled by read_response
 			skynet.ret(cluster.concat(msg))
 		else
 			skynet.ret(msg)
@@ -44,21 +64,46 @@ function command.req(...)
 end
 
 function command.push(addr, msg, sz)
-	local request, new_session, padding = cluster.packpush(addr, session, msg, sz)
+	local request, new_session, padding, padding_sz = cluster.packpush(addr, session, msg, sz)
 	if padding then	-- is multi push
 		session = new_session
 	end
 
-	channel:request(request, nil, padding)
+	-- channel:request frees the padding if it fails
+	local ok, err = pcall(channel.request, channel, request, nil, padding, padding_sz)
+	if not ok then
+		skynet.error(err)
+	end
 end
 
 local function read_response(sock)
-	local sz = socket.header(sock:read(2))
-	local msg = sock:read(sz)
-	return cluster.unpackresponse(msg)	-- session, ok, data, padding
+	while true do
+		local sz = socket.header(sock:read(2))
+		local msg = sock:read(sz)
+		local session, ok, data, padding = cluster.unpackresponse(msg, large_response)
+		if not padding then
+			local sz = large_size[session]
+			if sz then
+				large_size[session] = nil
+				large_inflight = large_inflight - sz
+			end
+			return session, ok, data
+		elseif data then
+			-- multi begin, data is the size of whole response
+			if large_inflight + data <= large_limit then
+				large_inflight = large_inflight + data
+				large_size[session] = data
+				large_response[session] = cluster.buffer(data)
+			else
+				skynet.error(string.format("Large response (%d bytes) exceeds cluster_large_limit", data))
+				large_response[session] = "large response exceeds cluster_large_limit"
+			end
+		end
+	end
 end
 
 function command.changenode(host, port)
+	reset_large()
 	if not host then
 		skynet.error("Close cluster sender", channel.__host, channel.__port)
 		channel:close()
@@ -75,6 +120,8 @@ skynet.start(function()
 			port = tonumber(init_port),
 			response = read_response,
 			nodelay = true,
+			-- drop the half assembled large responses of the last connection
+			auth = reset_large,
 		}
 	skynet.dispatch("lua", function(session , source, cmd, ...)
 		local f = assert(command[cmd])
@@ -149,6 +149,8 @@ function COMMAND.help()
 		exit = "exit address : kill a lua service",
 		kill = "kill address : kill service",
 		mem = "mem : show memory status",
+		latency = "latency : show handler time and queue wait time percentiles of each service",
+		slow = "slow : show the duration histogram of long messages caught by monitor",
 		gc = "gc : force every lua service do garbage collect",
 		start = "lanuch a new lua service",
 		snax = "lanuch a new snax service",
@@ -163,6 +165,7 @@ function COMMAND.help()
 		debug = "debug address : debug a lua service",
 		signal = "signal address sig",
 		cmem = "Show C memory info",
+		memtop = "memtop [n] : show top n services by C memory, with allocation rate",
 		jmem = "Show jemalloc mem stats",
 		ping = "ping address",
 		call = "call address ...",
@@ -170,6 +173,8 @@ function COMMAND.help()
 		netstat = "netstat : show netstat",
 		profactive = "profactive [on|off] : active/deactive jemalloc heap profilling",
 		dumpheap = "dumpheap : dump heap profilling",
+		heapsample = "heapsample [bytes] : sample one C allocation every n bytes, 0 turns off",
+		heapprof = "heapprof filename : write sampled live C allocations in pprof format",
 		killtask = "killtask address threadname : threadname listed by task",
 		dbgcmd = "run address debug command",
 		getenv = "getenv name : skynet.getenv(name)",
@@ -255,6 +260,21 @@ function COMMAND.mem(ti)
 	return skynet.call(".launcher", "lua", "MEM", timeout(ti))
 end
 
+function COMMAND.latency(ti)
+	return skynet.call(".launcher", "lua", "LATENCY", timeout(ti))
+end
+
+function COMMAND.slow()
+	local tmp = { string.format("total %d", core.intcommand("SLOW")) }
+	for i = 0, 23 do
+		local n = core.intcommand("SLOW", i)
+		if n > 0 then
+			table.insert(tmp, string.format(">= %d ms : %d", 1 << i, n))
+		end
+	end
+	return tmp
+end
+
 function COMMAND.kill(address)
 	return skynet.call(".launcher", "lua", "KILL", adjust_address(address))
 end
@@ -372,6 +392,15 @@ function COMMAND.cmem()
 	return tmp
 end
 
+function COMMAND.memtop(n)
+	local top = memory.top(tonumber(n) or 10)
+	local tmp = {}
+	for i, v in ipairs(top) do
+		tmp[i] = string.format("%s %11d  %8.2f Mb  alloc %.2f Kb/s", skynet.address(v[1]), v[2], v[2]/1048576, v[3]/1024)
+	end
+	return tmp
+end
+
 function COMMAND.jmem()
 	local info = memory.jestat()
 	local tmp = {}
@@ -468,6 +497,16 @@ function COMMAND.dumpheap()
 	memory.dumpheap()
 end
 
+function COMMAND.heapsample(bytes)
+	local interval = memory.heapsample(tonumber(bytes))
+	return "heap sample interval is " .. interval
+end
+
+function COMMAND.heapprof(filename)
+	local n = memory.heapprof(assert(filename, "need filename"))
+	return string.format("%d samples written to %s", n, filename)
+end
+
 function COMMAND.profactive(flag)
 	if flag ~= nil then
 		if flag == "on" or flag == "off" then
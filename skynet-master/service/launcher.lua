@@ -51,6 +51,25 @@ function command.STAT(addr, ti)
 	return list_srv(ti, function(v) return v end, "STAT")
 end
 
+function command.LATENCY(addr, ti)
+	return list_srv(ti, function(v)
+		if type(v) == "string" then
+			return v
+		end
+		local function fmt(name, s)
+			if s then
+				return string.format("%s p50 %d p99 %d p999 %d max %d us (%d)", name, s.p50, s.p99, s.p999, s.max, s.count)
+			end
+		end
+		local h = fmt("handle", v.handle)
+		local w = fmt("wait", v.wait)
+		if h and w then
+			return h .. ", " .. w
+		end
+		return h or w or ""
+	end, "LATENCY")
+end
+
 function command.KILL(_, handle)
 	skynet.kill(handle)
 	local ret = { [skynet.address(handle)] = tostring(services[handle]) }
@@ -10,9 +10,10 @@ local pool_count = {}
 local objmap = {}
 local collect_tick = 10
 
-local function newobj(name, tbl)
+-- the new object shares the unchanged sub tables with the old version
+local function newobj(name, tbl, oldcobj)
 	assert(pool[name] == nil)
-	local cobj = sharedata.host.new(tbl)
+	local cobj = sharedata.host.new(tbl, oldcobj)
 	sharedata.host.incref(cobj)
 	local v = {obj = cobj, watch = {} }
 	objmap[cobj] = v
@@ -50,7 +51,7 @@ local CMD = {}
 
 local env_mt = { __index = _ENV }
 
-function CMD.new(name, t, ...)
+local function loadvalue(name, t, ...)
 	local dt = type(t)
 	local value
 	if dt == "table" then
@@ -73,7 +74,11 @@ function CMD.new(name, t, ...)
 	else
 		error ("Unknown data type " .. dt)
 	end
-	newobj(name, value)
+	return value
+end
+
+function CMD.new(name, t, ...)
+	newobj(name, loadvalue(name, t, ...))
 end
 
 function CMD.delete(name)
@@ -113,13 +118,14 @@ function CMD.update(name, t, ...)
 		pool[name] = nil
 		pool_count[name] = nil
 	end
-	CMD.new(name, t, ...)
-	local newobj = pool[name].obj
+	newobj(name, loadvalue(name, t, ...), oldcobj)
+	local newcobj = pool[name].obj
 	if watch then
-		sharedata.host.markdirty(oldcobj)
+		-- only the replaced tables are dirty
+		sharedata.host.markdirty(oldcobj, newcobj)
 		for _,response in pairs(watch) do
-			sharedata.host.incref(newobj)
-			response(true, newobj)
+			sharedata.host.incref(newcobj)
+			response(true, newcobj)
 		end
 	end
 	collect1min()	-- collect in 1 min
@@ -2,11 +2,13 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <time.h>
 
 #include <lauxlib.h>
 
 #include "skynet.h"
 #include "atomic.h"
+#include "spinlock.h"
 
 #include "malloc_hook.h"
 
@@ -16,13 +18,28 @@
 #define MEMORY_ALLOCTAG 0x20140605
 #define MEMORY_FREETAG 0x0badf00d
 
+// Each handle owns its own slot (open addressing, see flush_mem_delta), so the stats are exact.
+// The slots are only updated when a thread flushes its local delta, so a spinlock is cheap enough.
+// A zero initialized spinlock is unlocked.
 struct mem_data {
     alignas(CACHE_LINE_SIZE)
-	ATOM_ULONG     handle;
-    AtomicMemInfo  info;
+	struct spinlock lock;
+	uint32_t       handle;
+	int            used;
+	MemInfo        info;
+	size_t         last_alloc;	// for allocation rate, see malloc_memory_top
+	uint64_t       last_time;
 };
 _Static_assert(sizeof(struct mem_data) % CACHE_LINE_SIZE == 0, "mem_data must be cache-line aligned");
 
+// Every thread accumulates the stats in mem_delta, and flushes one handle after DELTA_FLUSH_COUNT operations
+// or DELTA_FLUSH_BYTES bytes, so an allocation doesn't touch any shared cache line.
+struct mem_delta {
+	uint32_t handle;
+	int count;
+	MemInfo info;
+};
+
 struct mem_cookie {
 	size_t size;
 	uint32_t handle;
@@ -33,39 +50,385 @@ struct mem_cookie {
 };
 
 #define SLOT_SIZE 0x10000
+#define MAX_PROBE 16
 #define PREFIX_SIZE sizeof(struct mem_cookie)
 
+#define DELTA_SLOT 16
+#define DELTA_FLUSH_COUNT 256
+#define DELTA_FLUSH_BYTES (64 * 1024)
+// in 1/100 sec, see malloc_delta_tick
+#define DELTA_FLUSH_INTERVAL 10
+
 static struct mem_data mem_stats[SLOT_SIZE];
 _Static_assert(alignof(mem_stats) % CACHE_LINE_SIZE == 0, "mem_stats must be cache-line aligned");
 
-static struct mem_data *
-get_mem_stat(uint32_t handle) {
+// for the handles can't find a slot in MAX_PROBE steps
+static struct mem_data mem_overflow;
+static struct spinlock mem_insert_lock;
+
+static __thread struct mem_delta mem_deltas[DELTA_SLOT];
+static __thread uint64_t mem_delta_time;
+
+// in 1/100 sec, skynet_now() can't be used before the timer init
+static uint64_t
+mem_time(void) {
+	struct timespec ti;
+	clock_gettime(CLOCK_MONOTONIC, &ti);
+	return (uint64_t)ti.tv_sec * 100 + ti.tv_nsec / 10000000;
+}
+
+static inline int
+mem_slot_match(struct mem_data *data, uint32_t handle) {
+	return data->used && data->handle == handle;
+}
+
+// the service has no memory in use, so no free will come for it later
+static inline int
+mem_slot_reusable(struct mem_data *data) {
+	return !data->used || data->info.alloc == data->info.free;
+}
+
+static int
+mem_slot_merge(struct mem_data *data, uint32_t handle, const MemInfo *delta) {
+	int ret = 0;
+	spinlock_lock(&data->lock);
+	if (mem_slot_match(data, handle)) {
+		meminfo_merge(&data->info, delta);
+		ret = 1;
+	}
+	spinlock_unlock(&data->lock);
+	return ret;
+}
+
+static void
+flush_mem_stat(uint32_t handle, const MemInfo *delta) {
 	int h = (int)(handle & (SLOT_SIZE - 1));
-	struct mem_data *data = &mem_stats[h];
-	return data;
+	int i;
+	for (i=0;i<MAX_PROBE;i++) {
+		if (mem_slot_merge(&mem_stats[(h + i) & (SLOT_SIZE - 1)], handle, delta))
+			return;
+	}
+	// insert a new slot, only one thread can insert, so a handle never owns two slots
+	spinlock_lock(&mem_insert_lock);
+	for (i=0;i<MAX_PROBE;i++) {
+		if (mem_slot_merge(&mem_stats[(h + i) & (SLOT_SIZE - 1)], handle, delta)) {
+			spinlock_unlock(&mem_insert_lock);
+			return;
+		}
+	}
+	for (i=0;i<MAX_PROBE;i++) {
+		struct mem_data *data = &mem_stats[(h + i) & (SLOT_SIZE - 1)];
+		spinlock_lock(&data->lock);
+		if (mem_slot_reusable(data)) {
+			data->used = 1;
+			data->handle = handle;
+			data->info = *delta;
+			data->last_alloc = 0;
+			data->last_time = mem_time();
+			spinlock_unlock(&data->lock);
+			spinlock_unlock(&mem_insert_lock);
+			return;
+		}
+		spinlock_unlock(&data->lock);
+	}
+	spinlock_unlock(&mem_insert_lock);
+
+	spinlock_lock(&mem_overflow.lock);
+	mem_overflow.used = 1;
+	meminfo_merge(&mem_overflow.info, delta);
+	spinlock_unlock(&mem_overflow.lock);
+}
+
+static void
+flush_mem_delta(struct mem_delta *d) {
+	if (d->count) {
+		flush_mem_stat(d->handle, &d->info);
+		meminfo_init(&d->info);
+		d->count = 0;
+	}
+}
+
+static inline struct mem_delta *
+get_mem_delta(uint32_t handle) {
+	struct mem_delta *d = &mem_deltas[handle % DELTA_SLOT];
+	if (d->handle != handle) {
+		flush_mem_delta(d);
+		d->handle = handle;
+	}
+	return d;
+}
+
+static inline void
+check_mem_delta(struct mem_delta *d) {
+	if (++d->count >= DELTA_FLUSH_COUNT ||
+		d->info.alloc + d->info.free >= DELTA_FLUSH_BYTES) {
+		flush_mem_delta(d);
+	}
+}
+
+// The deltas of a thread are flushed by count or bytes above, or else they stay in the thread.
+// So the threads flush them all periodically, before sleeping and before exit.
+void
+malloc_flush_delta(void) {
+	int i;
+	for (i=0;i<DELTA_SLOT;i++) {
+		flush_mem_delta(&mem_deltas[i]);
+	}
+}
+
+void
+malloc_delta_tick(uint64_t now) {
+	if (now - mem_delta_time >= DELTA_FLUSH_INTERVAL) {
+		mem_delta_time = now;
+		malloc_flush_delta();
+	}
 }
 
 #ifndef NOUSE_JEMALLOC
 
 #include "jemalloc.h"
+#include <execinfo.h>
+#include <math.h>
 
 // for skynet_lalloc use
 #define raw_realloc je_realloc
 #define raw_free je_free
 
+// Sampled heap profiler : a poisson process picks one allocation every heap_sample bytes on average,
+// keeps its backtrace in a live table until it's freed, see malloc_heap_dump.
+// The samples are allocated by je_malloc directly, so they don't recurse into the hook.
+
+#define SAMPLE_DEPTH 32
+#define SAMPLE_HASH 4096
+// the highest bit of mem_cookie.size marks a sampled allocation
+#define SAMPLE_TAG ((size_t)1 << (sizeof(size_t) * 8 - 1))
+
+struct heap_sample {
+	struct heap_sample *next;
+	void *ptr;
+	size_t size;
+	uint32_t handle;
+	int depth;
+	void *stack[SAMPLE_DEPTH];
+};
+
+struct heap_sampler {
+	struct spinlock lock;
+	ATOM_SIZET interval;
+	size_t n;
+	struct heap_sample *slot[SAMPLE_HASH];
+};
+
+static struct heap_sampler HS;
+
+struct sample_state {
+	uint64_t rng;	// 0 means uninitialized
+	int64_t left;	// bytes left before the next sample
+	int busy;	// backtrace() may allocate
+};
+
+static __thread struct sample_state sample_state;
+
+static inline uint64_t
+sample_random(struct sample_state *ss) {
+	// xorshift64
+	uint64_t x = ss->rng;
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+	ss->rng = x;
+	return x;
+}
+
+static int64_t
+sample_next(struct sample_state *ss, size_t interval) {
+	// exponential distribution, so the samples are a poisson process over the allocated bytes
+	double u = ((sample_random(ss) >> 11) + 1) * (1.0 / 9007199254740992.0);
+	return (int64_t)(-log(u) * interval) + 1;
+}
+
+static inline int
+sample_check(size_t sz) {
+	size_t interval = ATOM_LOAD(&HS.interval);
+	if (interval == 0)
+		return 0;
+	struct sample_state *ss = &sample_state;
+	if (ss->rng == 0) {
+		ss->rng = ((uint64_t)(uintptr_t)ss * 0x9E3779B97F4A7C15ull) | 1;
+		ss->left = sample_next(ss, interval);
+	}
+	ss->left -= (int64_t)sz;
+	if (ss->left > 0 || ss->busy)
+		return 0;
+	ss->left = sample_next(ss, interval);
+	return 1;
+}
+
+static inline unsigned
+sample_hash(void *ptr) {
+	uintptr_t h = (uintptr_t)ptr >> 4;
+	return (unsigned)(h ^ (h >> 12)) & (SAMPLE_HASH - 1);
+}
+
+static void
+sample_record(void *ptr, size_t sz, uint32_t handle) {
+	struct sample_state *ss = &sample_state;
+	struct heap_sample *hs = je_malloc(sizeof(*hs));
+	if (hs == NULL)
+		return;
+	ss->busy = 1;
+	hs->depth = backtrace(hs->stack, SAMPLE_DEPTH);
+	ss->busy = 0;
+	hs->ptr = ptr;
+	hs->size = sz;
+	hs->handle = handle;
+	unsigned h = sample_hash(ptr);
+	spinlock_lock(&HS.lock);
+	hs->next = HS.slot[h];
+	HS.slot[h] = hs;
+	++HS.n;
+	spinlock_unlock(&HS.lock);
+}
+
+static void
+sample_remove(void *ptr) {
+	unsigned h = sample_hash(ptr);
+	struct heap_sample *hs = NULL;
+	spinlock_lock(&HS.lock);
+	struct heap_sample **prev = &HS.slot[h];
+	while (*prev) {
+		if ((*prev)->ptr == ptr) {
+			hs = *prev;
+			*prev = hs->next;
+			--HS.n;
+			break;
+		}
+		prev = &(*prev)->next;
+	}
+	spinlock_unlock(&HS.lock);
+	je_free(hs);
+}
+
+void
+malloc_heap_sample(size_t interval) {
+	if (interval) {
+		// backtrace() loads the unwinder at the first call, which allocates
+		void *dummy[1];
+		struct sample_state *ss = &sample_state;
+		ss->busy = 1;
+		backtrace(dummy, 1);
+		ss->busy = 0;
+	}
+	ATOM_STORE(&HS.interval, interval);
+}
+
+size_t
+malloc_heap_sample_interval(void) {
+	return ATOM_LOAD(&HS.interval);
+}
+
+static int
+sample_compare(const void *a, const void *b) {
+	const struct heap_sample *sa = *(const struct heap_sample **)a;
+	const struct heap_sample *sb = *(const struct heap_sample **)b;
+	if (sa->depth != sb->depth)
+		return sa->depth < sb->depth ? -1 : 1;
+	return memcmp(sa->stack, sb->stack, sa->depth * sizeof(void *));
+}
+
+static void
+sample_dump_maps(FILE *f) {
+	FILE *maps = fopen("/proc/self/maps", "r");
+	if (maps == NULL)
+		return;
+	char buf[4096];
+	size_t n;
+	fprintf(f, "\nMAPPED_LIBRARIES:\n");
+	while ((n = fread(buf, 1, sizeof(buf), maps)) > 0) {
+		fwrite(buf, 1, n, f);
+	}
+	fclose(maps);
+}
+
+// write the live samples in gperftools heap profile format (heap_v2), which can be read by pprof.
+// returns the number of samples, or -1 if the file can't be written
+int
+malloc_heap_dump(const char *filename) {
+	struct sample_state *ss = &sample_state;
+	size_t interval = ATOM_LOAD(&HS.interval);
+	// copy the samples, don't hold the lock in the file operations, because they allocate
+	ss->busy = 1;
+	spinlock_lock(&HS.lock);
+	size_t n = HS.n;
+	struct heap_sample *samples = je_malloc((n ? n : 1) * sizeof(struct heap_sample));
+	struct heap_sample **sorted = je_malloc((n ? n : 1) * sizeof(struct heap_sample *));
+	size_t i, count = 0;
+	if (samples && sorted) {
+		for (i=0;i<SAMPLE_HASH;i++) {
+			struct heap_sample *hs;
+			for (hs = HS.slot[i]; hs; hs = hs->next) {
+				samples[count] = *hs;
+				sorted[count] = &samples[count];
+				++count;
+			}
+		}
+	}
+	spinlock_unlock(&HS.lock);
+	ss->busy = 0;
+	if (samples == NULL || sorted == NULL) {
+		je_free(samples);
+		je_free(sorted);
+		return -1;
+	}
+	FILE *f = fopen(filename, "w");
+	if (f == NULL) {
+		je_free(samples);
+		je_free(sorted);
+		return -1;
+	}
+	qsort(sorted, count, sizeof(struct heap_sample *), sample_compare);
+	size_t total = 0;
+	for (i=0;i<count;i++) {
+		total += sorted[i]->size;
+	}
+	fprintf(f, "heap profile: %zu: %zu [%zu: %zu] @ heap_v2/%zu\n", count, total, count, total, interval);
+	i = 0;
+	while (i < count) {
+		size_t j = i;
+		size_t objs = 0, bytes = 0;
+		while (j < count && sample_compare(&sorted[i], &sorted[j]) == 0) {
+			++objs;
+			bytes += sorted[j]->size;
+			++j;
+		}
+		fprintf(f, "%zu: %zu [%zu: %zu] @", objs, bytes, objs, bytes);
+		int k;
+		// skip the frame of sample_record
+		for (k=1;k<sorted[i]->depth;k++) {
+			fprintf(f, " %p", sorted[i]->stack[k]);
+		}
+		fprintf(f, "\n");
+		i = j;
+	}
+	sample_dump_maps(f);
+	fclose(f);
+	je_free(samples);
+	je_free(sorted);
+	return (int)count;
+}
+
 inline static void
 update_xmalloc_stat_alloc(uint32_t handle, size_t __n) {
-	struct mem_data *data = get_mem_stat(handle);
-    // 当两个不同的 handle 被哈希到同一个槽位时, 新的服务会覆盖旧服务的数据
-    // 这种情况在实际运行中非常罕见, 因为同时存在的服务数量很难超过 65536
-    ATOM_STORE(&data->handle, handle);
-	atomic_meminfo_alloc(&data->info, __n);
+	struct mem_delta *d = get_mem_delta(handle);
+	meminfo_alloc(&d->info, __n);
+	check_mem_delta(d);
 }
 
 inline static void
 update_xmalloc_stat_free(uint32_t handle, size_t __n) {
-	struct mem_data *data = get_mem_stat(handle);
-	atomic_meminfo_free(&data->info, __n);
+	struct mem_delta *d = get_mem_delta(handle);
+	meminfo_free(&d->info, __n);
+	check_mem_delta(d);
 }
 
 inline static void*
@@ -81,6 +444,10 @@ fill_prefix(char* ptr, size_t sz, uint32_t cookie_size) {
 #endif
 	update_xmalloc_stat_alloc(handle, sz);
 	memcpy(ret - sizeof(uint32_t), &cookie_size, sizeof(cookie_size));
+	if (sample_check(sz)) {
+		p->size |= SAMPLE_TAG;
+		sample_record(ret, sz, handle);
+	}
 	return ret;
 }
 
@@ -104,6 +471,10 @@ clean_prefix(char* ptr) {
 	assert(dogtag == MEMORY_ALLOCTAG);	// memory out of bounds
 	p->dogtag = MEMORY_FREETAG;
 #endif
+	if (p->size & SAMPLE_TAG) {
+		p->size &= ~SAMPLE_TAG;
+		sample_remove(ptr);
+	}
 	update_xmalloc_stat_free(handle, p->size);
 	return p;
 }
@@ -243,12 +614,62 @@ skynet_posix_memalign(void **memptr, size_t alignment, size_t size) {
 	return err;
 }
 
+// One arena for each numa node. The worker threads are pinned to their node,
+// so the pages of the arena are first touched (and placed) on the node.
+
+#define NUMA_MAX_NODE 64
+
+static unsigned numa_arena[NUMA_MAX_NODE];
+static int numa_nodes = 0;
+
+void
+malloc_numa_init(int nodes) {
+	int i;
+	if (nodes > NUMA_MAX_NODE)
+		nodes = NUMA_MAX_NODE;
+	for (i=0;i<nodes;i++) {
+		size_t sz = sizeof(unsigned);
+		if (je_mallctl("arenas.create", &numa_arena[i], &sz, NULL, 0)) {
+			skynet_error(NULL, "error: Create arena for numa node %d failed", i);
+			break;
+		}
+	}
+	numa_nodes = i;
+}
+
+void
+malloc_numa_bind(int node) {
+	if (node < 0 || node >= numa_nodes)
+		return;
+	if (je_mallctl("thread.arena", NULL, NULL, &numa_arena[node], sizeof(unsigned))) {
+		skynet_error(NULL, "error: Bind arena of numa node %d failed", node);
+	}
+}
+
 #else
 
 // for skynet_lalloc use
 #define raw_realloc realloc
 #define raw_free free
 
+void
+malloc_heap_sample(size_t interval) {
+	if (interval) {
+		skynet_error(NULL, "No jemalloc : heap sample is not supported");
+	}
+}
+
+size_t
+malloc_heap_sample_interval(void) {
+	return 0;
+}
+
+int
+malloc_heap_dump(const char *filename) {
+	skynet_error(NULL, "No jemalloc : malloc_heap_dump %s.", filename);
+	return -1;
+}
+
 void
 memory_info_dump(const char* opts) {
 	skynet_error(NULL, "No jemalloc");
@@ -278,31 +699,53 @@ mallctl_cmd(const char* name) {
 	return 0;
 }
 
+void
+malloc_numa_init(int nodes) {
+}
+
+void
+malloc_numa_bind(int node) {
+}
+
 #endif
 
-size_t
-malloc_used_memory(void) {
-	MemInfo total = {};
+// read a slot, returns 0 if the slot is empty
+static int
+mem_slot_read(struct mem_data *data, uint32_t *handle, MemInfo *info) {
+	spinlock_lock(&data->lock);
+	int used = data->used;
+	*handle = data->handle;
+	*info = data->info;
+	spinlock_unlock(&data->lock);
+	return used;
+}
+
+static void
+mem_total(MemInfo *total) {
+	uint32_t handle;
+	MemInfo info;
+	meminfo_init(total);
 	for(int i = 0; i < SLOT_SIZE; i++) {
-		struct mem_data* data = &mem_stats[i];
-		const uint32_t handle = ATOM_LOAD(&data->handle);
-		if (handle != 0) {
-			atomic_meminfo_merge(&total, &data->info);
+		if (mem_slot_read(&mem_stats[i], &handle, &info)) {
+			meminfo_merge(total, &info);
 		}
 	}
+	if (mem_slot_read(&mem_overflow, &handle, &info)) {
+		meminfo_merge(total, &info);
+	}
+}
+
+size_t
+malloc_used_memory(void) {
+	MemInfo total;
+	mem_total(&total);
 	return total.alloc - total.free;
 }
 
 size_t
 malloc_memory_block(void) {
-	MemInfo total = {};
-	for(int i = 0; i < SLOT_SIZE; i++) {
-		struct mem_data* data = &mem_stats[i];
-		const uint32_t handle = ATOM_LOAD(&data->handle);
-		if (handle != 0) {
-			atomic_meminfo_merge(&total, &data->info);
-		}
-	}
+	MemInfo total;
+	mem_total(&total);
 	return total.alloc_count - total.free_count;
 }
 
@@ -310,21 +753,87 @@ void
 dump_c_mem() {
 	skynet_error(NULL, "dump all service mem:");
 	MemInfo total = {};
+	uint32_t handle;
+	MemInfo info;
 	for(int i = 0; i < SLOT_SIZE; i++) {
-		struct mem_data* data = &mem_stats[i];
-		const uint32_t handle = ATOM_LOAD(&data->handle);
-		if (handle != 0) {
-			MemInfo info = {};
-			atomic_meminfo_merge(&info, &data->info);
+		if (mem_slot_read(&mem_stats[i], &handle, &info)) {
 			meminfo_merge(&total, &info);
 			const size_t using = info.alloc - info.free;
-			skynet_error(NULL, ":%08x -> %zukb %zub", handle, using >> 10, using);
+			if (using) {
+				skynet_error(NULL, ":%08x -> %zukb %zub", handle, using >> 10, using);
+			}
 		}
 	}
+	if (mem_slot_read(&mem_overflow, &handle, &info)) {
+		meminfo_merge(&total, &info);
+		const size_t using = info.alloc - info.free;
+		skynet_error(NULL, "overflow -> %zukb %zub", using >> 10, using);
+	}
 	const size_t using = total.alloc - total.free;
 	skynet_error(NULL, "+total: %zukb", using >> 10);
 }
 
+static void
+mem_top_insert(struct malloc_top *top, int n, int *count, const struct malloc_top *m) {
+	int i = *count;
+	if (i == n) {
+		if (top[n-1].mem >= m->mem)
+			return;
+		--i;
+	} else {
+		++*count;
+	}
+	while (i > 0 && top[i-1].mem < m->mem) {
+		top[i] = top[i-1];
+		--i;
+	}
+	top[i] = *m;
+}
+
+int
+malloc_memory_top(struct malloc_top *top, int n) {
+	int count = 0;
+	if (n <= 0)
+		return 0;
+	uint64_t now = mem_time();
+	for(int i = 0; i < SLOT_SIZE; i++) {
+		struct mem_data *data = &mem_stats[i];
+		struct malloc_top m;
+		spinlock_lock(&data->lock);
+		if (!data->used) {
+			spinlock_unlock(&data->lock);
+			continue;
+		}
+		m.handle = data->handle;
+		m.mem = data->info.alloc - data->info.free;
+		m.rate = 0;
+		// allocation rate since last query, mem_time() is in 1/100 sec
+		if (now > data->last_time) {
+			m.rate = (double)(data->info.alloc - data->last_alloc) * 100 / (now - data->last_time);
+			data->last_alloc = data->info.alloc;
+			data->last_time = now;
+		}
+		spinlock_unlock(&data->lock);
+		mem_top_insert(top, n, &count, &m);
+	}
+	return count;
+}
+
+#define MAX_MEMTOP 256
+
+void
+dump_c_memtop(int n) {
+	if (n > MAX_MEMTOP)
+		n = MAX_MEMTOP;
+	struct malloc_top top[n > 0 ? n : 1];
+	n = malloc_memory_top(top, n);
+	skynet_error(NULL, "dump top %d service mem:", n);
+	int i;
+	for (i=0;i<n;i++) {
+		skynet_error(NULL, ":%08x -> %zukb %zub, alloc %.2fkb/s", top[i].handle, top[i].mem >> 10, top[i].mem, top[i].rate / 1024);
+	}
+}
+
 char *
 skynet_strdup(const char *str) {
 	size_t sz = strlen(str);
@@ -343,16 +852,87 @@ skynet_lalloc(void *ptr, size_t osize, size_t nsize) {
 	}
 }
 
+#ifndef NOUSE_JEMALLOC
+
+// A private arena (and an explicit tcache) for one lua state.
+// A service is dispatched by only one thread at a time, so the explicit tcache is never used concurrently.
+struct skynet_larena {
+	int flags;
+	unsigned arena;
+	unsigned tcache;
+};
+
+struct skynet_larena *
+skynet_larena_new(void) {
+	unsigned arena, tcache;
+	size_t sz = sizeof(unsigned);
+	if (je_mallctl("arenas.create", &arena, &sz, NULL, 0)) {
+		return NULL;
+	}
+	sz = sizeof(unsigned);
+	if (je_mallctl("tcache.create", &tcache, &sz, NULL, 0)) {
+		char name[64];
+		snprintf(name, sizeof(name), "arena.%u.destroy", arena);
+		je_mallctl(name, NULL, NULL, NULL, 0);
+		return NULL;
+	}
+	struct skynet_larena * a = skynet_malloc(sizeof(*a));
+	a->arena = arena;
+	a->tcache = tcache;
+	a->flags = MALLOCX_ARENA(arena) | MALLOCX_TCACHE(tcache);
+	return a;
+}
+
+void
+skynet_larena_delete(struct skynet_larena *a) {
+	char name[64];
+	je_mallctl("tcache.destroy", NULL, NULL, &a->tcache, sizeof(a->tcache));
+	// drop all the extents of the arena at once, instead of leaving the retained pages fragmented
+	snprintf(name, sizeof(name), "arena.%u.destroy", a->arena);
+	je_mallctl(name, NULL, NULL, NULL, 0);
+	skynet_free(a);
+}
+
+void *
+skynet_larena_alloc(struct skynet_larena *a, void *ptr, size_t osize, size_t nsize) {
+	if (nsize == 0) {
+		if (ptr) {
+			je_sdallocx(ptr, osize, a->flags);
+		}
+		return NULL;
+	} else if (ptr == NULL) {
+		return je_mallocx(nsize, a->flags);
+	} else {
+		return je_rallocx(ptr, nsize, a->flags);
+	}
+}
+
+#else
+
+struct skynet_larena *
+skynet_larena_new(void) {
+	return NULL;
+}
+
+void
+skynet_larena_delete(struct skynet_larena *a) {
+}
+
+void *
+skynet_larena_alloc(struct skynet_larena *a, void *ptr, size_t osize, size_t nsize) {
+	return skynet_lalloc(ptr, osize, nsize);
+}
+
+#endif
+
 int
 dump_mem_lua(lua_State *L) {
 	int i;
+	uint32_t handle;
+	MemInfo info;
 	lua_newtable(L);
 	for(i=0; i<SLOT_SIZE; i++) {
-		struct mem_data* data = &mem_stats[i];
-		const uint32_t handle = ATOM_LOAD(&data->handle);
-		if (handle != 0) {
-			MemInfo info = {};
-			atomic_meminfo_merge(&info, &data->info);
+		if (mem_slot_read(&mem_stats[i], &handle, &info)) {
 			lua_pushinteger(L, info.alloc - info.free);
 			lua_rawseti(L, -2, handle);
 		}
@@ -363,13 +943,20 @@ dump_mem_lua(lua_State *L) {
 size_t
 malloc_current_memory(void) {
 	uint32_t handle = skynet_current_handle();
-	struct mem_data *data = get_mem_stat(handle);
-	if (ATOM_LOAD(&data->handle) != handle) {
-		return 0;
+	// the other threads may keep some delta of this handle (at most DELTA_FLUSH_INTERVAL),
+	// but the current thread is the major one
+	malloc_flush_delta();
+	int h = (int)(handle & (SLOT_SIZE - 1));
+	int i;
+	for (i=0;i<MAX_PROBE;i++) {
+		struct mem_data *data = &mem_stats[(h + i) & (SLOT_SIZE - 1)];
+		uint32_t slot_handle;
+		MemInfo info;
+		if (mem_slot_read(data, &slot_handle, &info) && slot_handle == handle) {
+			return info.alloc - info.free;
+		}
 	}
-	MemInfo info = {};
-	atomic_meminfo_merge(&info, &data->info);
-	return info.alloc - info.free;
+	return 0;
 }
 
 void
@@ -3,6 +3,7 @@
 
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <lua.h>
 
 #include "mem_info.h"
@@ -17,5 +18,28 @@ extern int    mallctl_cmd(const char* name);
 extern void   dump_c_mem(void);
 extern int    dump_mem_lua(lua_State *L);
 extern size_t malloc_current_memory(void);
+// flush the memory stat deltas of current thread, malloc_delta_tick flushes them every 1/10 sec
+extern void   malloc_flush_delta(void);
+extern void   malloc_delta_tick(uint64_t now);
+
+struct malloc_top {
+	uint32_t handle;
+	size_t mem;
+	double rate;	// allocated bytes per second since last query
+};
+
+// fill the top n services by memory in use, returns the number filled
+extern int    malloc_memory_top(struct malloc_top *top, int n);
+extern void   dump_c_memtop(int n);
+
+// sample one allocation every interval bytes on average, 0 turns off
+extern void   malloc_heap_sample(size_t interval);
+extern size_t malloc_heap_sample_interval(void);
+// write the live samples in pprof (gperftools heap) format, returns the number of samples or -1
+extern int    malloc_heap_dump(const char *filename);
+
+// one arena for each numa node, malloc_numa_bind makes the current thread allocate from it
+extern void   malloc_numa_init(int nodes);
+extern void   malloc_numa_bind(int node);
 
 #endif /* SKYNET_MALLOC_HOOK_H */
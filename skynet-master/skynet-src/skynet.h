@@ -23,6 +23,8 @@
 
 #define PTYPE_TAG_DONTCOPY 0x10000
 #define PTYPE_TAG_ALLOCSESSION 0x20000
+// msg is a payload from skynet_shared_new, each local receiver holds a reference instead of a copy
+#define PTYPE_TAG_SHARED 0x40000
 
 struct skynet_context;
 
@@ -32,12 +34,26 @@ uint32_t skynet_queryname(struct skynet_context * context, const char * name);
 int skynet_send(struct skynet_context * context, uint32_t source, uint32_t destination , int type, int session, void * msg, size_t sz);
 int skynet_sendname(struct skynet_context * context, uint32_t source, const char * destination , int type, int session, void * msg, size_t sz);
 
+// Shared payloads are read-only and released by the core after the receiver's callback returns.
+// A receiver whose callback may keep the message (see skynet_callback_reserve) gets its own copy.
+void * skynet_shared_new(const void * msg, size_t sz);
+void skynet_shared_grab(void * payload);
+void skynet_shared_release(void * payload);
+
 int skynet_isremote(struct skynet_context *, uint32_t handle, int * harbor);
 
 typedef int (*skynet_cb)(struct skynet_context * context, void *ud, int type, int session, uint32_t source , const void * msg, size_t sz);
 void skynet_callback(struct skynet_context * context, void *ud, skynet_cb cb);
+// reserve = 0 : the callback never returns 1 to keep the message, so it can read shared payloads in place.
+// The default is 1, as the callback of forward mode.
+void skynet_callback_reserve(struct skynet_context * context, int reserve);
 
 uint32_t skynet_current_handle(void);
+// numa nodes (0 when numa is off), the node of current thread (-1 for none),
+// and bind current thread to the cpus and the allocation arena of a node
+int skynet_numa_nodes(void);
+int skynet_numa_node(void);
+void skynet_numa_bind(int node);
 uint64_t skynet_now(void);
 void skynet_debug_memory(const char *info);	// for debug use, output current service memory to stderr
 
@@ -1,45 +1,112 @@
 #include "skynet.h"
 #include "skynet_env.h"
+#include "skynet_imp.h"
 #include "spinlock.h"
-
-#include <lua.h>
-#include <lauxlib.h>
+#include "atomic.h"
 
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
 #include <assert.h>
 
+// The env is a lock free hash table for skynet_getenv. The keys are never changed or removed,
+// so skynet_setenv fills an empty slot of the published table in place, and publishes the key
+// at last. Only a resize builds a new table, the replaced tables are kept in a list because a
+// reader may still use them (they are less than the live table in total, as the cap doubles).
+
+struct env_slot {
+	ATOM_POINTER key;	// const char *, NULL for empty slot
+	uint32_t hash;
+	const char * value;
+};
+
+struct env_table {
+	struct env_table * prev;
+	int count;
+	int cap;	// power of 2
+	struct env_slot slot[1];
+};
+
 struct skynet_env {
 	struct spinlock lock;
-	lua_State *L;
+	ATOM_POINTER table;
 };
 
 static struct skynet_env *E = NULL;
 
-const char * 
-skynet_getenv(const char *key) {
-	SPIN_LOCK(E)
+static uint32_t
+env_hash(const char *key) {
+	// FNV-1a
+	uint32_t h = 2166136261u;
+	const uint8_t * p = (const uint8_t *)key;
+	while (*p) {
+		h ^= *p++;
+		h *= 16777619u;
+	}
+	return h;
+}
 
-	lua_State *L = E->L;
-	
-	lua_getglobal(L, key);
-	const char * result = lua_tostring(L, -1);
-	lua_pop(L, 1);
+static struct env_slot *
+env_find(struct env_table *t, const char *key, uint32_t hash) {
+	int mask = t->cap - 1;
+	int i = hash & mask;
+	for (;;) {
+		struct env_slot * slot = &t->slot[i];
+		const char * k = (const char *)ATOM_LOAD(&slot->key);
+		if (k == NULL || (slot->hash == hash && strcmp(k, key) == 0)) {
+			return slot;
+		}
+		i = (i + 1) & mask;
+	}
+}
 
-	SPIN_UNLOCK(E)
+static struct env_table *
+env_new(int cap) {
+	struct env_table * t = skynet_malloc(sizeof(*t) + (cap - 1) * sizeof(struct env_slot));
+	memset(t, 0, sizeof(*t) + (cap - 1) * sizeof(struct env_slot));
+	t->cap = cap;
+	return t;
+}
+
+// fill the slot, then publish the key, the reader never sees a key without its value
+static void
+env_insert(struct env_table *t, const char *key, uint32_t hash, const char *value) {
+	struct env_slot * slot = env_find(t, key, hash);
+	slot->hash = hash;
+	slot->value = value;
+	ATOM_STORE(&slot->key, (uintptr_t)key);
+	++t->count;
+}
 
-	return result;
+const char *
+skynet_getenv(const char *key) {
+	struct env_table * t = (struct env_table *)ATOM_LOAD(&E->table);
+	return env_find(t, key, env_hash(key))->value;
 }
 
-void 
+void
 skynet_setenv(const char *key, const char *value) {
+	uint32_t hash = env_hash(key);
 	SPIN_LOCK(E)
-	
-	lua_State *L = E->L;
-	lua_getglobal(L, key);
-	assert(lua_isnil(L, -1));
-	lua_pop(L,1);
-	lua_pushstring(L,value);
-	lua_setglobal(L,key);
+
+	struct env_table * t = (struct env_table *)ATOM_LOAD(&E->table);
+	assert(ATOM_LOAD(&env_find(t, key, hash)->key) == 0);
+	// keep the load factor under 1/2
+	if (t->cap < (t->count + 1) * 2) {
+		struct env_table * old = t;
+		t = env_new(old->cap * 2);
+		int i;
+		for (i=0;i<old->cap;i++) {
+			struct env_slot * slot = &old->slot[i];
+			const char * k = (const char *)ATOM_LOAD(&slot->key);
+			if (k) {
+				env_insert(t, k, slot->hash, slot->value);
+			}
+		}
+		t->prev = old;
+		ATOM_STORE(&E->table, (uintptr_t)t);
+	}
+	env_insert(t, skynet_strdup(key), hash, skynet_strdup(value));
 
 	SPIN_UNLOCK(E)
 }
@@ -48,5 +115,5 @@ void
 skynet_env_init() {
 	E = skynet_malloc(sizeof(*E));
 	SPIN_INIT(E)
-	E->L = luaL_newstate();
+	ATOM_INIT(&E->table, (uintptr_t)env_new(16));
 }
@@ -7,11 +7,18 @@ struct skynet_config {
 	int thread;
 	int harbor;
 	int profile;
+	int heap_sample;
+	int monitor_interval;
+	int monitor_slow;
 	const char * daemon;
 	const char * module_path;
+	const char * module_preload;
 	const char * bootstrap;
 	const char * logger;
 	const char * logservice;
+	const char * worker_group;
+	const char * worker_cpu;
+	const char * numa;
 };
 
 #define THREAD_WORKER 0
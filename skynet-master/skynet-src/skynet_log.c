@@ -2,76 +2,283 @@
 #include "skynet_timer.h"
 #include "skynet.h"
 #include "skynet_socket.h"
+#include "skynet_imp.h"
+#include <stdio.h>
 #include <string.h>
+#include <stdlib.h>
 #include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
 
-FILE * 
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
+// The trace file is a header followed by a ring of binary records, see log_header and log_record.
+// The payload of each message is truncated to `logpayload` bytes, and the ring size is `logsize`.
+// Use tools/tracedump.lua to decode it.
+
+#define LOG_MAGIC "SKYTRACE"
+#define LOG_VERSION 1
+#define LOG_DEFAULT_SIZE (16 * 1024 * 1024)
+#define LOG_MIN_SIZE (64 * 1024)
+#define LOG_DEFAULT_PAYLOAD 256
+// the record size with LOG_PAD tag is the padding at the end of the ring
+#define LOG_PAD 0x80000000
+#define LOG_ALIGN(sz) (((sz) + 7) & ~7)
+
+struct log_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t handle;
+	uint32_t starttime;
+	uint32_t opentime;
+	uint32_t closetime;
+	uint32_t size;		// ring size
+	uint32_t payload;	// max bytes captured per message
+	uint32_t reserved;
+	uint64_t head;	// total bytes written into the ring
+	uint64_t tail;	// the oldest record in the ring
+	uint64_t count;	// total messages
+};
+
+struct log_record {
+	uint32_t size;	// record size (8 aligned), include this header
+	uint32_t len;	// bytes captured
+	uint32_t sz;	// message size
+	uint32_t source;
+	int32_t session;
+	int32_t type;
+	uint32_t time;
+	uint32_t reserved;
+};
+
+struct skynet_log {
+	struct skynet_log * next;
+	char * tmpname;	// not NULL before skynet_log_publish
+	char * filename;
+	int fd;
+	size_t mapsize;
+	struct log_header * header;
+	uint8_t * ring;
+	uint32_t size;
+	uint32_t payload;
+};
+
+static uint32_t
+getenv_size(const char * key, uint32_t def) {
+	const char * str = skynet_getenv(key);
+	if (str == NULL)
+		return def;
+	return (uint32_t)strtoul(str, NULL, 10);
+}
+
+#ifdef _WIN32
+
+static void *
+map_file(int fd, size_t sz) {
+	void * ptr = skynet_malloc(sz);
+	memset(ptr, 0, sz);
+	return ptr;
+}
+
+static void
+unmap_file(int fd, void *ptr, size_t sz) {
+	write(fd, ptr, sz);
+	skynet_free(ptr);
+}
+
+#else
+
+static void *
+map_file(int fd, size_t sz) {
+	if (ftruncate(fd, sz) != 0)
+		return NULL;
+	void * ptr = mmap(NULL, sz, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (ptr == MAP_FAILED)
+		return NULL;
+	return ptr;
+}
+
+static void
+unmap_file(int fd, void *ptr, size_t sz) {
+	munmap(ptr, sz);
+}
+
+#endif
+
+struct skynet_log *
 skynet_log_open(struct skynet_context * ctx, uint32_t handle) {
 	const char * logpath = skynet_getenv("logpath");
 	if (logpath == NULL)
 		return NULL;
+	uint32_t size = getenv_size("logsize", LOG_DEFAULT_SIZE);
+	if (size < LOG_MIN_SIZE)
+		size = LOG_MIN_SIZE;
+	size = LOG_ALIGN(size);
+	uint32_t payload = getenv_size("logpayload", LOG_DEFAULT_PAYLOAD);
+	// a record never takes more than 1/4 of the ring
+	if (payload > size / 4)
+		payload = size / 4;
+
+	// Never truncate <handle>.trace, it may be still mapped by the log closing (see skynet_log_defer).
+	// Create a new file and rename it to <handle>.trace in skynet_log_publish.
+	static ATOM_INT tmpid = 0;
 	size_t sz = strlen(logpath);
-	char tmp[sz + 16];
-	sprintf(tmp, "%s/%08x.log", logpath, handle);
-	FILE *f = fopen(tmp, "ab");
-	if (f) {
-		uint32_t starttime = skynet_starttime();
-		uint64_t currenttime = skynet_now();
-		time_t ti = starttime + currenttime/100;
-		skynet_error(ctx, "Open log file %s", tmp);
-		fprintf(f, "open time: %u %s", (uint32_t)currenttime, ctime(&ti));
-		fflush(f);
-	} else {
+	char filename[sz + 16];
+	char tmp[sz + 32];
+	sprintf(filename, "%s/%08x.trace", logpath, handle);
+	sprintf(tmp, "%s.%d", filename, ATOM_FINC(&tmpid));
+	int fd = open(tmp, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
 		skynet_error(ctx, "Open log file %s fail", tmp);
+		return NULL;
+	}
+	size_t mapsize = sizeof(struct log_header) + size;
+	struct log_header * h = map_file(fd, mapsize);
+	if (h == NULL) {
+		close(fd);
+		unlink(tmp);
+		skynet_error(ctx, "Map log file %s fail", tmp);
+		return NULL;
+	}
+	memcpy(h->magic, LOG_MAGIC, sizeof(h->magic));
+	h->version = LOG_VERSION;
+	h->handle = handle;
+	h->starttime = skynet_starttime();
+	h->opentime = (uint32_t)skynet_now();
+	h->size = size;
+	h->payload = payload;
+
+	struct skynet_log * log = skynet_malloc(sizeof(*log));
+	log->next = NULL;
+	log->tmpname = skynet_strdup(tmp);
+	log->filename = skynet_strdup(filename);
+	log->fd = fd;
+	log->mapsize = mapsize;
+	log->header = h;
+	log->ring = (uint8_t *)(h + 1);
+	log->size = size;
+	log->payload = payload;
+
+	return log;
+}
+
+void
+skynet_log_publish(struct skynet_context * ctx, struct skynet_log *log) {
+	if (rename(log->tmpname, log->filename) != 0) {
+		skynet_error(ctx, "Rename log file %s fail", log->tmpname);
+		return;
 	}
-	return f;
+	skynet_free(log->tmpname);
+	log->tmpname = NULL;
+	skynet_error(ctx, "Open log file %s", log->filename);
 }
 
 void
-skynet_log_close(struct skynet_context * ctx, FILE *f, uint32_t handle) {
-	skynet_error(ctx, "Close log file :%08x", handle);
-	fprintf(f, "close time: %u\n", (uint32_t)skynet_now());
-	fclose(f);
+skynet_log_close(struct skynet_context * ctx, struct skynet_log *log, uint32_t handle) {
+	if (ctx) {
+		skynet_error(ctx, "Close log file :%08x", handle);
+	}
+	log->header->closetime = (uint32_t)skynet_now();
+	unmap_file(log->fd, log->header, log->mapsize);
+	close(log->fd);
+	if (log->tmpname) {
+		// never published
+		unlink(log->tmpname);
+		skynet_free(log->tmpname);
+	}
+	skynet_free(log->filename);
+	skynet_free(log);
 }
 
-static void
-log_blob(FILE *f, void * buffer, size_t sz) {
-	size_t i;
-	uint8_t * buf = buffer;
-	for (i=0;i!=sz;i++) {
-		fprintf(f, "%02x", buf[i]);
+void
+skynet_log_defer(ATOM_POINTER *pending, struct skynet_log *log) {
+	uintptr_t next;
+	do {
+		next = ATOM_LOAD(pending);
+		log->next = (struct skynet_log *)next;
+	} while (!ATOM_CAS_POINTER(pending, next, (uintptr_t)log));
+}
+
+void
+skynet_log_close_pending(ATOM_POINTER *pending, uint32_t handle) {
+	uintptr_t list;
+	do {
+		list = ATOM_LOAD(pending);
+	} while (!ATOM_CAS_POINTER(pending, list, 0));
+	struct skynet_log * log = (struct skynet_log *)list;
+	while (log) {
+		struct skynet_log * next = log->next;
+		skynet_log_close(NULL, log, handle);
+		log = next;
 	}
 }
 
+// drop the oldest records until n bytes after head are free
 static void
-log_socket(FILE * f, struct skynet_socket_message * message, size_t sz) {
-	fprintf(f, "[socket] %d %d %d ", message->type, message->id, message->ud);
-
-	if (message->buffer == NULL) {
-		const char *buffer = (const char *)(message + 1);
-		sz -= sizeof(*message);
-		const char * eol = memchr(buffer, '\0', sz);
-		if (eol) {
-			sz = eol - buffer;
-		}
-		fprintf(f, "[%*s]", (int)sz, (const char *)buffer);
-	} else {
-		sz = message->ud;
-		log_blob(f, message->buffer, sz);
+ring_evict(struct skynet_log *log, uint32_t n) {
+	struct log_header * h = log->header;
+	while (h->head + n - h->tail > log->size) {
+		uint32_t size = *(uint32_t *)(log->ring + h->tail % log->size);
+		h->tail += size & ~LOG_PAD;
+	}
+}
+
+static uint8_t *
+ring_alloc(struct skynet_log *log, uint32_t size) {
+	struct log_header * h = log->header;
+	uint32_t pos = h->head % log->size;
+	uint32_t left = log->size - pos;
+	if (left < size) {
+		// records never wrap around, skip the end of ring
+		ring_evict(log, left);
+		*(uint32_t *)(log->ring + pos) = left | LOG_PAD;
+		h->head += left;
+		pos = 0;
 	}
-	fprintf(f, "\n");
-	fflush(f);
+	ring_evict(log, size);
+	return log->ring + pos;
 }
 
-void 
-skynet_log_output(FILE *f, uint32_t source, int type, int session, void * buffer, size_t sz) {
+void
+skynet_log_output(struct skynet_log *log, uint32_t source, int type, int session, void * buffer, size_t sz) {
+	// for socket message, capture type, id, ud first
+	int32_t socket_head[3];
+	const void * data = buffer;
+	uint32_t prefix = 0;
 	if (type == PTYPE_SOCKET) {
-		log_socket(f, buffer, sz);
-	} else {
-		uint32_t ti = (uint32_t)skynet_now();
-		fprintf(f, ":%08x %d %d %u ", source, type, session, ti);
-		log_blob(f, buffer, sz);
-		fprintf(f,"\n");
-		fflush(f);
+		struct skynet_socket_message * message = buffer;
+		socket_head[0] = message->type;
+		socket_head[1] = message->id;
+		socket_head[2] = message->ud;
+		prefix = sizeof(socket_head);
+		if (message->buffer == NULL) {
+			data = message + 1;
+			sz -= sizeof(*message);
+		} else {
+			data = message->buffer;
+			sz = message->ud;
+		}
+	}
+	uint32_t len = sz < log->payload ? (uint32_t)sz : log->payload;
+	uint32_t size = LOG_ALIGN(sizeof(struct log_record) + prefix + len);
+	struct log_record * r = (struct log_record *)ring_alloc(log, size);
+	r->size = size;
+	r->len = prefix + len;
+	r->sz = (uint32_t)sz;
+	r->source = source;
+	r->session = session;
+	r->type = type;
+	r->time = (uint32_t)skynet_now();
+	r->reserved = 0;
+	uint8_t * ptr = (uint8_t *)(r + 1);
+	if (prefix) {
+		memcpy(ptr, socket_head, prefix);
 	}
+	memcpy(ptr + prefix, data, len);
+
+	struct log_header * h = log->header;
+	h->head += size;
+	++h->count;
 }
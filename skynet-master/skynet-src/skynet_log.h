@@ -3,12 +3,20 @@
 
 #include "skynet_env.h"
 #include "skynet.h"
+#include "atomic.h"
 
 #include <stdio.h>
 #include <stdint.h>
 
-FILE * skynet_log_open(struct skynet_context * ctx, uint32_t handle);
-void skynet_log_close(struct skynet_context * ctx, FILE *f, uint32_t handle);
-void skynet_log_output(FILE *f, uint32_t source, int type, int session, void * buffer, size_t sz);
+struct skynet_log;
+
+struct skynet_log * skynet_log_open(struct skynet_context * ctx, uint32_t handle);
+void skynet_log_publish(struct skynet_context * ctx, struct skynet_log *log);
+// ctx can be NULL, close silently
+void skynet_log_close(struct skynet_context * ctx, struct skynet_log *log, uint32_t handle);
+// LOGOFF may run in other thread, so the service closes the log in its own thread later
+void skynet_log_defer(ATOM_POINTER *pending, struct skynet_log *log);
+void skynet_log_close_pending(ATOM_POINTER *pending, uint32_t handle);
+void skynet_log_output(struct skynet_log *log, uint32_t source, int type, int session, void * buffer, size_t sz);
 
 #endif
\ No newline at end of file
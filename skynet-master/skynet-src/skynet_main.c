@@ -163,12 +163,19 @@ main(int argc, char *argv[]) {
 		return 1;
 	}
 	config.module_path = optstring("cpath","./cservice/?.so");
+	config.module_preload = optstring("cservice_preload", NULL);
 	config.harbor = optint("harbor", 1);
 	config.bootstrap = optstring("bootstrap","snlua bootstrap");
 	config.daemon = optstring("daemon", NULL);
 	config.logger = optstring("logger", NULL);
 	config.logservice = optstring("logservice", "logger");
 	config.profile = optboolean("profile", 1);
+	config.heap_sample = optint("heap_sample", 0);
+	config.monitor_interval = optint("monitor_interval", 100);
+	config.monitor_slow = optint("monitor_slow", 1000);
+	config.worker_group = optstring("worker_group", NULL);
+	config.worker_cpu = optstring("worker_cpu", NULL);
+	config.numa = optstring("numa", NULL);
 
 	skynet_start(&config);
 	skynet_globalexit();
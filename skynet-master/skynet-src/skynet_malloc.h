@@ -16,6 +16,12 @@ void * skynet_calloc(size_t nmemb,size_t size);
 void * skynet_realloc(void *ptr, size_t size);
 void skynet_free(void *ptr);
 void * skynet_lalloc(void *ptr, size_t osize, size_t nsize);	// use for lua
+
+// private allocation arena for one lua state, skynet_larena_new returns NULL if it's not supported
+struct skynet_larena;
+struct skynet_larena * skynet_larena_new(void);
+void skynet_larena_delete(struct skynet_larena *);
+void * skynet_larena_alloc(struct skynet_larena *, void *ptr, size_t osize, size_t nsize);
 void * skynet_memalign(size_t alignment, size_t size);
 void * skynet_aligned_alloc(size_t alignment, size_t size);
 int skynet_posix_memalign(void **memptr, size_t alignment, size_t size);
@@ -3,6 +3,7 @@
 #include "skynet_imp.h"
 #include "skynet_module.h"
 #include "spinlock.h"
+#include "atomic.h"
 
 #include <assert.h>
 #include <string.h>
@@ -13,8 +14,11 @@
 
 #define MAX_MODULE_TYPE 32
 
+// The modules are append only, m[i] is filled before count is increased,
+// so skynet_module_query can search m[0, count) without the lock.
+
 struct modules {
-	int count;
+	ATOM_INT count;
 	struct spinlock lock;
 	const char * path;
 	struct skynet_module m[MAX_MODULE_TYPE];
@@ -66,7 +70,8 @@ _try_open(struct modules *m, const char * name) {
 static struct skynet_module *
 _query(const char * name) {
 	int i;
-	for (i=0;i<M->count;i++) {
+	int n = ATOM_LOAD(&M->count);
+	for (i=0;i<n;i++) {
 		if (strcmp(M->m[i].name,name)==0) {
 			return &M->m[i];
 		}
@@ -110,8 +115,8 @@ skynet_module_query(const char * name) {
 
 	result = _query(name); // double check
 
-	if (result == NULL && M->count < MAX_MODULE_TYPE) {
-		int index = M->count;
+	int index = ATOM_LOAD(&M->count);
+	if (result == NULL && index < MAX_MODULE_TYPE) {
 		void * dl = _try_open(M,name);
 		if (dl) {
 			M->m[index].name = name;
@@ -119,8 +124,8 @@ skynet_module_query(const char * name) {
 
 			if (open_sym(&M->m[index]) == 0) {
 				M->m[index].name = skynet_strdup(name);
-				M->count ++;
 				result = &M->m[index];
+				ATOM_STORE(&M->count, index + 1);
 			}
 		}
 	}
@@ -158,13 +163,79 @@ skynet_module_instance_signal(struct skynet_module *m, void *inst, int signal) {
 	}
 }
 
+#ifdef SKYNET_STATIC_MODULE
+
+// The C services linked into the skynet binary (CSERVICE_STATIC in Makefile).
+// The symbols are weak, so the ones not linked are NULL and loaded from cpath instead.
+
+#define STATIC_MODULE(name) \
+	void * name##_create(void) __attribute__((weak)); \
+	int name##_init(void * inst, struct skynet_context *, const char * parm) __attribute__((weak)); \
+	void name##_release(void * inst) __attribute__((weak)); \
+	void name##_signal(void * inst, int signal) __attribute__((weak));
+
+#define STATIC_ENTRY(name) { #name, NULL, name##_create, name##_init, name##_release, name##_signal },
+
+STATIC_MODULE(snlua)
+STATIC_MODULE(logger)
+STATIC_MODULE(gate)
+STATIC_MODULE(harbor)
+
+static struct skynet_module static_modules[] = {
+	STATIC_ENTRY(snlua)
+	STATIC_ENTRY(logger)
+	STATIC_ENTRY(gate)
+	STATIC_ENTRY(harbor)
+};
+
+static void
+open_static(struct modules *m) {
+	int i;
+	int n = 0;
+	for (i=0;i<sizeof(static_modules)/sizeof(static_modules[0]);i++) {
+		if (static_modules[i].init) {
+			m->m[n++] = static_modules[i];
+		}
+	}
+	ATOM_STORE(&m->count, n);
+}
+
+#else
+
+static void
+open_static(struct modules *m) {
+}
+
+#endif
+
 void
 skynet_module_init(const char *path) {
 	struct modules *m = skynet_malloc(sizeof(*m));
-	m->count = 0;
+	ATOM_INIT(&m->count, 0);
 	m->path = skynet_strdup(path);
 
 	SPIN_INIT(m)
 
+	open_static(m);
+
 	M = m;
 }
+
+void
+skynet_module_preload(const char *list) {
+	// comma separated module names
+	while (*list) {
+		size_t sz = strcspn(list, ",");
+		if (sz > 0) {
+			char name[sz+1];
+			memcpy(name, list, sz);
+			name[sz] = '\0';
+			if (skynet_module_query(name) == NULL) {
+				fprintf(stderr, "Preload C service %s failed\n", name);
+			}
+		}
+		list += sz;
+		if (*list == ',')
+			++list;
+	}
+}
@@ -24,5 +24,6 @@ void skynet_module_instance_release(struct skynet_module *, void *inst);
 void skynet_module_instance_signal(struct skynet_module *, void *inst, int signal);
 
 void skynet_module_init(const char *path);
+void skynet_module_preload(const char *list);
 
 #endif
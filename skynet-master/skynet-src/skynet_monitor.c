@@ -2,19 +2,40 @@
 
 #include "skynet_monitor.h"
 #include "skynet_server.h"
+#include "skynet_timer.h"
 #include "skynet.h"
 #include "atomic.h"
 
 #include <stdlib.h>
 #include <string.h>
 
+// a message runs longer than ENDLESS_TIME (in ms) maybe in an endless loop
+#define ENDLESS_TIME 5000
+// signal 2 asks the service to log its traceback (see snlua_signal)
+#define SIGNAL_TRACEBACK 2
+
 struct skynet_monitor {
 	ATOM_INT version;
 	int check_version;
 	uint32_t source;
 	uint32_t destination;
+	uint64_t check_time;	// the last check, in ms
+	uint64_t start_time;	// the current message starts at, in microsec, 0 for none
+	uint64_t stuck_time;	// the current message runs since, 0 for none
+	uint64_t report_time;	// the next endless report
+	int traced;
 };
 
+// duration histogram of the long messages, bucket n is [2^n, 2^(n+1)) ms.
+// the workers record the messages run 1 ms at least when they finish.
+static ATOM_SIZET SLOW[MONITOR_SLOW_BUCKETS];
+static int SLOW_TIME = 1000;
+
+static inline uint64_t
+now_ms(void) {
+	return skynet_monotonic_time() / 1000;
+}
+
 struct skynet_monitor * 
 skynet_monitor_new() {
 	struct skynet_monitor * ret = skynet_malloc(sizeof(*ret));
@@ -27,21 +48,80 @@ skynet_monitor_delete(struct skynet_monitor *sm) {
 	skynet_free(sm);
 }
 
+static void
+record_slow(uint64_t ti) {
+	int n = 0;
+	while (ti > 1 && n < MONITOR_SLOW_BUCKETS - 1) {
+		ti >>= 1;
+		++n;
+	}
+	ATOM_FINC(&SLOW[n]);
+}
+
+// the worker triggers at the start (destination != 0) and the end (0) of each message
 void 
 skynet_monitor_trigger(struct skynet_monitor *sm, uint32_t source, uint32_t destination) {
+	uint64_t now = skynet_monotonic_time();
+	if (destination) {
+		sm->start_time = now;
+	} else if (sm->start_time) {
+		uint64_t elapsed = (now - sm->start_time) / 1000;
+		if (elapsed > 0) {
+			record_slow(elapsed);
+		}
+		sm->start_time = 0;
+	}
 	sm->source = source;
 	sm->destination = destination;
 	ATOM_FINC(&sm->version);
 }
 
+void
+skynet_monitor_slowtime(int ms) {
+	SLOW_TIME = ms;
+}
+
+uint64_t
+skynet_monitor_slow(int n) {
+	if (n >= 0) {
+		return n < MONITOR_SLOW_BUCKETS ? ATOM_LOAD(&SLOW[n]) : 0;
+	}
+	uint64_t total = 0;
+	int i;
+	for (i=0;i<MONITOR_SLOW_BUCKETS;i++) {
+		total += ATOM_LOAD(&SLOW[i]);
+	}
+	return total;
+}
+
+// the periodic check only logs the traceback of a long message and reports the endless loop,
+// the durations are recorded by skynet_monitor_trigger.
 void 
 skynet_monitor_check(struct skynet_monitor *sm) {
+	uint64_t now = now_ms();
 	if (sm->version == sm->check_version) {
 		if (sm->destination) {
-			skynet_context_endless(sm->destination);
-			skynet_error(NULL, "error: A message from [ :%08x ] to [ :%08x ] maybe in an endless loop (version = %d)", sm->source , sm->destination, sm->version);
+			if (sm->stuck_time == 0) {
+				// it runs since the last check at least
+				sm->stuck_time = sm->check_time;
+				sm->report_time = sm->stuck_time + ENDLESS_TIME;
+				sm->traced = 0;
+			}
+			uint64_t elapsed = now - sm->stuck_time;
+			if (!sm->traced && elapsed >= SLOW_TIME) {
+				sm->traced = 1;
+				skynet_error(NULL, "error: A message from [ :%08x ] to [ :%08x ] has been running for %d ms", sm->source , sm->destination, (int)elapsed);
+				skynet_context_signal(sm->destination, SIGNAL_TRACEBACK);
+			}
+			if (now >= sm->report_time) {
+				sm->report_time += ENDLESS_TIME;
+				skynet_context_endless(sm->destination);
+				skynet_error(NULL, "error: A message from [ :%08x ] to [ :%08x ] maybe in an endless loop (version = %d)", sm->source , sm->destination, sm->version);
+			}
 		}
 	} else {
+		sm->stuck_time = 0;
 		sm->check_version = sm->version;
 	}
+	sm->check_time = now;
 }
@@ -10,4 +10,11 @@ void skynet_monitor_delete(struct skynet_monitor *);
 void skynet_monitor_trigger(struct skynet_monitor *, uint32_t source, uint32_t destination);
 void skynet_monitor_check(struct skynet_monitor *);
 
+#define MONITOR_SLOW_BUCKETS 24
+
+// log the traceback of the message runs longer than ms
+void skynet_monitor_slowtime(int ms);
+// the count of long messages in [2^n, 2^(n+1)) ms, n < 0 for total
+uint64_t skynet_monitor_slow(int n);
+
 #endif
@@ -1,7 +1,9 @@
 #include "skynet.h"
 #include "skynet_mq.h"
 #include "skynet_handle.h"
+#include "skynet_timer.h"
 #include "spinlock.h"
+#include "atomic.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -28,52 +30,97 @@ struct message_queue {
 	int in_global;
 	int overload;
 	int overload_threshold;
+	// set by other services (AFFINITY, PRIORITY) while the workers read them
+	ATOM_INT group;	// the worker group serves this queue, see skynet_mq_setgroup
+	ATOM_INT priority;
 	struct skynet_message *queue;
 	struct message_queue *next;
 };
 
-struct global_queue {
+struct queue_list {
 	struct message_queue *head;
 	struct message_queue *tail;
+};
+
+// Each priority class has its own list. The high class is served first, but every 4th pop
+// starts from the normal class and every 16th pop starts from the background class,
+// so the lower classes never starve.
+struct global_queue {
+	struct queue_list list[MQ_PRIORITIES];
+	unsigned turn;
 	struct spinlock lock;
 };
 
+// one global queue for each worker group
 static struct global_queue *Q = NULL;
+static int GROUPS = 1;
 
 void 
 skynet_globalmq_push(struct message_queue * queue) {
-	struct global_queue *q= Q;
+	struct global_queue *q= &Q[ATOM_LOAD(&queue->group)];
+	struct queue_list *l = &q->list[ATOM_LOAD(&queue->priority)];
 
 	SPIN_LOCK(q)
 	assert(queue->next == NULL);
-	if(q->tail) {
-		q->tail->next = queue;
-		q->tail = queue;
+	if(l->tail) {
+		l->tail->next = queue;
+		l->tail = queue;
 	} else {
-		q->head = q->tail = queue;
+		l->head = l->tail = queue;
 	}
 	SPIN_UNLOCK(q)
 }
 
+static struct message_queue *
+list_pop(struct queue_list *l) {
+	struct message_queue *mq = l->head;
+	if(mq) {
+		l->head = mq->next;
+		if(l->head == NULL) {
+			assert(mq == l->tail);
+			l->tail = NULL;
+		}
+		mq->next = NULL;
+	}
+	return mq;
+}
+
 struct message_queue * 
-skynet_globalmq_pop() {
-	struct global_queue *q = Q;
+skynet_globalmq_pop(int group) {
+	struct global_queue *q = &Q[group];
 
 	SPIN_LOCK(q)
-	struct message_queue *mq = q->head;
-	if(mq) {
-		q->head = mq->next;
-		if(q->head == NULL) {
-			assert(mq == q->tail);
-			q->tail = NULL;
+	unsigned turn = ++q->turn;
+	int first = MQ_PRIORITY_HIGH;
+	if ((turn & 15) == 0) {
+		first = MQ_PRIORITY_BACKGROUND;
+	} else if ((turn & 3) == 0) {
+		first = MQ_PRIORITY_NORMAL;
+	}
+	struct message_queue *mq = list_pop(&q->list[first]);
+	int i;
+	for (i=0;mq == NULL && i<MQ_PRIORITIES;i++) {
+		if (i != first) {
+			mq = list_pop(&q->list[i]);
 		}
-		mq->next = NULL;
 	}
 	SPIN_UNLOCK(q)
 
 	return mq;
 }
 
+int
+skynet_globalmq_pending(int group) {
+	// read without lock, it's only a hint
+	struct global_queue *q = &Q[group];
+	int i;
+	for (i=0;i<MQ_PRIORITIES;i++) {
+		if (q->list[i].head)
+			return 1;
+	}
+	return 0;
+}
+
 struct message_queue * 
 skynet_mq_create(uint32_t handle) {
 	struct message_queue *q = skynet_malloc(sizeof(*q));
@@ -89,6 +136,8 @@ skynet_mq_create(uint32_t handle) {
 	q->release = 0;
 	q->overload = 0;
 	q->overload_threshold = MQ_OVERLOAD;
+	ATOM_INIT(&q->group, 0);
+	ATOM_INIT(&q->priority, MQ_PRIORITY_NORMAL);
 	q->queue = skynet_malloc(sizeof(struct skynet_message) * q->cap);
 	q->next = NULL;
 
@@ -108,6 +157,34 @@ skynet_mq_handle(struct message_queue *q) {
 	return q->handle;
 }
 
+int
+skynet_mq_group(struct message_queue *q) {
+	return ATOM_LOAD(&q->group);
+}
+
+int
+skynet_mq_priority(struct message_queue *q) {
+	return ATOM_LOAD(&q->priority);
+}
+
+int
+skynet_mq_setpriority(struct message_queue *q, int priority) {
+	if (priority < 0 || priority >= MQ_PRIORITIES)
+		return -1;
+	// takes effect at next push, like skynet_mq_setgroup
+	ATOM_STORE(&q->priority, priority);
+	return 0;
+}
+
+int
+skynet_mq_setgroup(struct message_queue *q, int group) {
+	if (group < 0 || group >= GROUPS)
+		return -1;
+	// if the queue is in global queue now, it moves to the new group at next push
+	ATOM_STORE(&q->group, group);
+	return 0;
+}
+
 int
 skynet_mq_length(struct message_queue *q) {
 	int head, tail,cap;
@@ -189,6 +266,9 @@ expand_queue(struct message_queue *q) {
 void 
 skynet_mq_push(struct message_queue *q, struct skynet_message *message) {
 	assert(message);
+#ifdef MQ_TIMESTAMP
+	message->stamp = skynet_monotonic_time();
+#endif
 	SPIN_LOCK(q)
 
 	q->queue[q->tail] = *message;
@@ -209,10 +289,15 @@ skynet_mq_push(struct message_queue *q, struct skynet_message *message) {
 }
 
 void 
-skynet_mq_init() {
-	struct global_queue *q = skynet_malloc(sizeof(*q));
-	memset(q,0,sizeof(*q));
-	SPIN_INIT(q);
+skynet_mq_init(int groups) {
+	assert(groups >= 1 && groups <= MQ_MAX_GROUP);
+	struct global_queue *q = skynet_malloc(sizeof(*q) * groups);
+	memset(q,0,sizeof(*q) * groups);
+	int i;
+	for (i=0;i<groups;i++) {
+		SPIN_INIT(&q[i]);
+	}
+	GROUPS = groups;
 	Q=q;
 }
 
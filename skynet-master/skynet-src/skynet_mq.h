@@ -9,16 +9,33 @@ struct skynet_message {
 	int session;
 	void * data;
 	size_t sz;
+#ifdef MQ_TIMESTAMP
+	uint64_t stamp;	// enqueue time in microsec, for queue wait time
+#endif
 };
 
 // type is encoding in skynet_message.sz high 8bit
 #define MESSAGE_TYPE_MASK (SIZE_MAX >> 8)
 #define MESSAGE_TYPE_SHIFT ((sizeof(size_t)-1) * 8)
+// the highest bit of size marks a shared payload (see skynet_shared_new)
+#define MESSAGE_SHARED_TAG ((size_t)1 << (MESSAGE_TYPE_SHIFT - 1))
+#define MESSAGE_SIZE_MASK (MESSAGE_TYPE_MASK >> 1)
 
 struct message_queue;
 
+// worker group 0 is the shared pool, the others are dedicated workers (see worker_group in skynet_start.c)
+#define MQ_MAX_GROUP 16
+
+// priority classes in global queue
+#define MQ_PRIORITY_HIGH 0
+#define MQ_PRIORITY_NORMAL 1
+#define MQ_PRIORITY_BACKGROUND 2
+#define MQ_PRIORITIES 3
+
 void skynet_globalmq_push(struct message_queue * queue);
-struct message_queue * skynet_globalmq_pop(void);
+struct message_queue * skynet_globalmq_pop(int group);
+// the global queue of the group is not empty, for waking up the workers of other groups
+int skynet_globalmq_pending(int group);
 
 struct message_queue * skynet_mq_create(uint32_t handle);
 void skynet_mq_mark_release(struct message_queue *q);
@@ -27,6 +44,12 @@ typedef void (*message_drop)(struct skynet_message *, void *);
 
 void skynet_mq_release(struct message_queue *q, message_drop drop_func, void *ud);
 uint32_t skynet_mq_handle(struct message_queue *);
+int skynet_mq_group(struct message_queue *);
+// -1 for invalid group
+int skynet_mq_setgroup(struct message_queue *, int group);
+int skynet_mq_priority(struct message_queue *);
+// -1 for invalid priority
+int skynet_mq_setpriority(struct message_queue *, int priority);
 
 // 0 for success
 int skynet_mq_pop(struct message_queue *q, struct skynet_message *message);
@@ -36,6 +59,6 @@ void skynet_mq_push(struct message_queue *q, struct skynet_message *message);
 int skynet_mq_length(struct message_queue *q);
 int skynet_mq_overload(struct message_queue *q);
 
-void skynet_mq_init();
+void skynet_mq_init(int groups);
 
 #endif
@@ -10,6 +10,7 @@
 #include "skynet_monitor.h"
 #include "skynet_imp.h"
 #include "skynet_log.h"
+#include "malloc_hook.h"
 #include "spinlock.h"
 #include "atomic.h"
 
@@ -18,6 +19,7 @@
 #include <string.h>
 #include <assert.h>
 #include <stdint.h>
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdbool.h>
 
@@ -39,6 +41,24 @@
 
 #endif
 
+// log-linear latency histogram in microsec, 4 buckets for each power of 2
+#define LATENCY_BUCKETS 128
+
+#ifdef MQ_TIMESTAMP
+#define LATENCY_TYPES 2
+#else
+#define LATENCY_TYPES 1
+#endif
+
+#define LATENCY_HANDLE 0
+#define LATENCY_WAIT 1
+
+struct latency_hist {
+	uint64_t count;
+	uint64_t max;
+	uint64_t bucket[LATENCY_BUCKETS];
+};
+
 struct skynet_context {
 	void * instance;
 	struct skynet_module * mod;
@@ -46,16 +66,20 @@ struct skynet_context {
 	skynet_cb cb;
 	struct message_queue *queue;
 	ATOM_POINTER logfile;
+	ATOM_POINTER logclose;
 	uint64_t cpu_cost;	// in microsec
 	uint64_t cpu_start;	// in microsec
+	struct latency_hist * latency;	// handler cpu time and queue wait time, only when profile is on
 	char result[32];
 	uint32_t handle;
 	int session_id;
 	ATOM_INT ref;
 	size_t message_count;
+	size_t crossnode;	// messages sent to the services on other numa nodes
 	bool init;
 	bool endless;
 	bool profile;
+	bool reserve;	// the callback may keep the message, see skynet_callback_reserve
 
 	CHECKCALLING_DECL
 };
@@ -66,10 +90,15 @@ struct skynet_node {
 	uint32_t monitor_exit;
 	pthread_key_t handle_key;
 	bool profile;	// default is on
+	int numa;	// numa nodes, 0 for off
+	ATOM_INT numa_next;
 };
 
 static struct skynet_node G_NODE;
 
+// the worker group of current thread, see STAT workergroup
+static __thread int worker_group = -1;
+
 int
 skynet_context_total() {
 	return ATOM_LOAD(&G_NODE.total);
@@ -107,6 +136,56 @@ id_to_hex(char * str, uint32_t id) {
 	str[9] = '\0';
 }
 
+struct shared_payload {
+	ATOM_INT ref;
+	size_t sz;
+};
+
+// keep the payload aligned as skynet_malloc does
+#define SHARED_HEADER_SIZE ((sizeof(struct shared_payload) + 15) & ~(size_t)15)
+
+static inline struct shared_payload *
+shared_header(void *payload) {
+	return (struct shared_payload *)((char *)payload - SHARED_HEADER_SIZE);
+}
+
+void *
+skynet_shared_new(const void * msg, size_t sz) {
+	char * ptr = skynet_malloc(SHARED_HEADER_SIZE + sz + 1);
+	struct shared_payload * h = (struct shared_payload *)ptr;
+	ATOM_INIT(&h->ref, 1);
+	h->sz = sz;
+	char * payload = ptr + SHARED_HEADER_SIZE;
+	if (msg) {
+		memcpy(payload, msg, sz);
+	}
+	payload[sz] = '\0';
+	return payload;
+}
+
+void
+skynet_shared_grab(void * payload) {
+	ATOM_FINC(&shared_header(payload)->ref);
+}
+
+void
+skynet_shared_release(void * payload) {
+	struct shared_payload * h = shared_header(payload);
+	if (ATOM_FDEC(&h->ref) == 1) {
+		skynet_free(h);
+	}
+}
+
+// sz is the size field of skynet_message, with type and shared tag
+static inline void
+free_payload(void * data, size_t sz) {
+	if (sz & MESSAGE_SHARED_TAG) {
+		skynet_shared_release(data);
+	} else {
+		skynet_free(data);
+	}
+}
+
 struct drop_t {
 	uint32_t handle;
 };
@@ -114,7 +193,7 @@ struct drop_t {
 static void
 drop_message(struct skynet_message *msg, void *ud) {
 	struct drop_t *d = ud;
-	skynet_free(msg->data);
+	free_payload(msg->data, msg->sz);
 	uint32_t source = d->handle;
 	assert(source);
 	// report error to the message source
@@ -141,19 +220,33 @@ skynet_context_new(const char * name, const char *param) {
 	ctx->cb_ud = NULL;
 	ctx->session_id = 0;
 	ATOM_INIT(&ctx->logfile, (uintptr_t)NULL);
+	ATOM_INIT(&ctx->logclose, (uintptr_t)NULL);
 
 	ctx->init = false;
 	ctx->endless = false;
+	ctx->reserve = true;
 
 	ctx->cpu_cost = 0;
 	ctx->cpu_start = 0;
 	ctx->message_count = 0;
+	ctx->crossnode = 0;
 	ctx->profile = G_NODE.profile;
+	if (ctx->profile) {
+		size_t sz = sizeof(struct latency_hist) * LATENCY_TYPES;
+		ctx->latency = skynet_malloc(sz);
+		memset(ctx->latency, 0, sz);
+	} else {
+		ctx->latency = NULL;
+	}
 	// Should set to 0 first to avoid skynet_handle_retireall get an uninitialized handle
 	ctx->handle = 0;
 	const uint32_t handle = skynet_handle_register(ctx);
 	ctx->handle = handle;
 	struct message_queue * queue = ctx->queue = skynet_mq_create(handle);
+	if (G_NODE.numa > 1) {
+		// place the new services on the nodes in turn, it stays there unless AFFINITY moves it
+		skynet_mq_setgroup(queue, (unsigned)ATOM_FINC(&G_NODE.numa_next) % G_NODE.numa);
+	}
 	// init function maybe use ctx->handle, so it must init at last
 	context_inc();
 
@@ -203,10 +296,12 @@ skynet_context_reserve(struct skynet_context *ctx) {
 
 static void
 delete_context(struct skynet_context *ctx) {
-	FILE *f = (FILE *)ATOM_LOAD(&ctx->logfile);
+	struct skynet_log *f = (struct skynet_log *)ATOM_LOAD(&ctx->logfile);
 	if (f) {
-		fclose(f);
+		skynet_log_close(NULL, f, ctx->handle);
 	}
+	skynet_log_close_pending(&ctx->logclose, ctx->handle);
+	skynet_free(ctx->latency);
 	skynet_module_instance_release(ctx->mod, ctx->instance);
 	skynet_mq_mark_release(ctx->queue);
 	CHECKCALLING_DESTROY(ctx)
@@ -221,18 +316,26 @@ skynet_context_release(struct skynet_context *ctx) {
 	}
 }
 
-int
-skynet_context_push(uint32_t handle, struct skynet_message *message) {
+static int
+context_push(struct skynet_context *source, uint32_t handle, struct skynet_message *message) {
 	struct skynet_context * ctx = skynet_handle_grab(handle);
 	if (ctx == NULL) {
 		return -1;
 	}
+	if (source && G_NODE.numa > 1 && skynet_mq_group(source->queue) != skynet_mq_group(ctx->queue)) {
+		++source->crossnode;
+	}
 	skynet_mq_push(ctx->queue, message);
 	skynet_context_release(ctx);
 
 	return 0;
 }
 
+int
+skynet_context_push(uint32_t handle, struct skynet_message *message) {
+	return context_push(NULL, handle, message);
+}
+
 void
 skynet_context_endless(uint32_t handle) {
 	struct skynet_context * ctx = skynet_handle_grab(handle);
@@ -243,6 +346,17 @@ skynet_context_endless(uint32_t handle) {
 	skynet_context_release(ctx);
 }
 
+void
+skynet_context_signal(uint32_t handle, int sig) {
+	struct skynet_context * ctx = skynet_handle_grab(handle);
+	if (ctx == NULL) {
+		return;
+	}
+	// NOTICE: the signal function should be thread safe.
+	skynet_module_instance_signal(ctx->mod, ctx->instance, sig);
+	skynet_context_release(ctx);
+}
+
 int
 skynet_isremote(struct skynet_context * ctx, uint32_t handle, int * harbor) {
 	int ret = skynet_harbor_message_isremote(handle);
@@ -252,28 +366,91 @@ skynet_isremote(struct skynet_context * ctx, uint32_t handle, int * harbor) {
 	return ret;
 }
 
+static inline int
+latency_bucket(uint64_t v) {
+	if (v < 4)
+		return (int)v;
+	int e = 63 - __builtin_clzll(v);
+	int b = (e - 1) * 4 + (int)((v >> (e - 2)) & 3);
+	return b < LATENCY_BUCKETS ? b : LATENCY_BUCKETS - 1;
+}
+
+// the max value of the bucket
+static uint64_t
+latency_bucket_top(int b) {
+	if (b < 4)
+		return b;
+	int e = b / 4 + 1;
+	return ((uint64_t)(4 + b % 4 + 1) << (e - 2)) - 1;
+}
+
+static inline void
+latency_add(struct latency_hist *h, uint64_t v) {
+	++h->count;
+	++h->bucket[latency_bucket(v)];
+	if (v > h->max)
+		h->max = v;
+}
+
+static uint64_t
+latency_percentile(struct latency_hist *h, double p) {
+	if (h->count == 0)
+		return 0;
+	uint64_t n = (uint64_t)(h->count * p / 100.0);
+	if (n >= h->count)
+		return h->max;
+	uint64_t sum = 0;
+	int i;
+	for (i=0;i<LATENCY_BUCKETS;i++) {
+		sum += h->bucket[i];
+		if (sum > n) {
+			uint64_t top = latency_bucket_top(i);
+			return top < h->max ? top : h->max;
+		}
+	}
+	return h->max;
+}
+
 static void
 dispatch_message(struct skynet_context *ctx, struct skynet_message *msg) {
 	assert(ctx->init);
 	CHECKCALLING_BEGIN(ctx)
 	pthread_setspecific(G_NODE.handle_key, (void *)(uintptr_t)(ctx->handle));
 	int type = msg->sz >> MESSAGE_TYPE_SHIFT;
-	size_t sz = msg->sz & MESSAGE_TYPE_MASK;
-	FILE *f = (FILE *)ATOM_LOAD(&ctx->logfile);
+	size_t sz = msg->sz & MESSAGE_SIZE_MASK;
+	if ((msg->sz & MESSAGE_SHARED_TAG) && ctx->reserve) {
+		// the callback may keep (forward) the message, give it an owned copy
+		void * data = skynet_malloc(sz + 1);
+		memcpy(data, msg->data, sz + 1);
+		skynet_shared_release(msg->data);
+		msg->data = data;
+		msg->sz &= ~MESSAGE_SHARED_TAG;
+	}
+	if (ATOM_LOAD(&ctx->logclose)) {
+		skynet_log_close_pending(&ctx->logclose, ctx->handle);
+	}
+	struct skynet_log *f = (struct skynet_log *)ATOM_LOAD(&ctx->logfile);
 	if (f) {
 		skynet_log_output(f, msg->source, type, msg->session, msg->data, sz);
 	}
 	++ctx->message_count;
 	int reserve_msg;
 	if (ctx->profile) {
+#ifdef MQ_TIMESTAMP
+		latency_add(&ctx->latency[LATENCY_WAIT], skynet_monotonic_time() - msg->stamp);
+#endif
 		ctx->cpu_start = skynet_thread_time();
 		reserve_msg = ctx->cb(ctx, ctx->cb_ud, type, msg->session, msg->source, msg->data, sz);
 		uint64_t cost_time = skynet_thread_time() - ctx->cpu_start;
 		ctx->cpu_cost += cost_time;
+		latency_add(&ctx->latency[LATENCY_HANDLE], cost_time);
 	} else {
 		reserve_msg = ctx->cb(ctx, ctx->cb_ud, type, msg->session, msg->source, msg->data, sz);
 	}
-	if (!reserve_msg) {
+	if (msg->sz & MESSAGE_SHARED_TAG) {
+		// the receiver never owns a shared payload, drop its reference
+		skynet_shared_release(msg->data);
+	} else if (!reserve_msg) {
 		skynet_free(msg->data);
 	}
 	CHECKCALLING_END(ctx)
@@ -289,10 +466,22 @@ skynet_context_dispatchall(struct skynet_context * ctx) {
 	}
 }
 
+// pop a queue for the worker group, the queues moved to another group (by AFFINITY)
+// while they are in the global queue go to their new group
+static struct message_queue *
+globalmq_pop(int group) {
+	struct message_queue *q;
+	while ((q = skynet_globalmq_pop(group)) != NULL && skynet_mq_group(q) != group) {
+		skynet_globalmq_push(q);
+	}
+	return q;
+}
+
 struct message_queue *
-skynet_context_message_dispatch(struct skynet_monitor *sm, struct message_queue *q, int weight) {
+skynet_context_message_dispatch(struct skynet_monitor *sm, struct message_queue *q, int weight, int group) {
+	worker_group = group;
 	if (q == NULL) {
-		q = skynet_globalmq_pop();
+		q = globalmq_pop(group);
 		if (q==NULL)
 			return NULL;
 	}
@@ -303,7 +492,7 @@ skynet_context_message_dispatch(struct skynet_monitor *sm, struct message_queue
 	if (ctx == NULL) {
 		struct drop_t d = { handle };
 		skynet_mq_release(q, drop_message, &d);
-		return skynet_globalmq_pop();
+		return globalmq_pop(group);
 	}
 
 	int i,n=1;
@@ -312,7 +501,7 @@ skynet_context_message_dispatch(struct skynet_monitor *sm, struct message_queue
 	for (i=0;i<n;i++) {
 		if (skynet_mq_pop(q,&msg)) {
 			skynet_context_release(ctx);
-			return skynet_globalmq_pop();
+			return globalmq_pop(group);
 		} else if (i==0 && weight >= 0) {
 			n = skynet_mq_length(q);
 			n >>= weight;
@@ -325,7 +514,7 @@ skynet_context_message_dispatch(struct skynet_monitor *sm, struct message_queue
 		skynet_monitor_trigger(sm, msg.source , handle);
 
 		if (ctx->cb == NULL) {
-			skynet_free(msg.data);
+			free_payload(msg.data, msg.sz);
 		} else {
 			dispatch_message(ctx, &msg);
 		}
@@ -334,12 +523,16 @@ skynet_context_message_dispatch(struct skynet_monitor *sm, struct message_queue
 	}
 
 	assert(q == ctx->queue);
-	struct message_queue *nq = skynet_globalmq_pop();
+	struct message_queue *nq = globalmq_pop(group);
 	if (nq) {
 		// If global mq is not empty , push q back, and return next queue (nq)
 		// Else (global mq is empty or block, don't push q back, and return q again (for next dispatch)
 		skynet_globalmq_push(q);
 		q = nq;
+	} else if (skynet_mq_group(q) != group) {
+		// the service moves to another worker group
+		skynet_globalmq_push(q);
+		q = NULL;
 	}
 	skynet_context_release(ctx);
 
@@ -570,6 +763,29 @@ cmd_stat(struct skynet_context * context, const char * param) {
 		}
 	} else if (strcmp(param, "message") == 0) {
 		sprintf(context->result, "%zu", context->message_count);
+	} else if (strcmp(param, "crossnode") == 0) {
+		sprintf(context->result, "%zu", context->crossnode);
+	} else if (strcmp(param, "workergroup") == 0) {
+		// the worker group of current thread, -1 if it's not a worker
+		sprintf(context->result, "%d", worker_group);
+	} else if (strncmp(param, "handle:", 7) == 0 || strncmp(param, "wait:", 5) == 0) {
+		// "handle:99" is the 99th percentile of handler cpu time in microsec, "wait:99.9" for queue wait time
+		int t = param[0] == 'h' ? LATENCY_HANDLE : LATENCY_WAIT;
+		if (context->latency == NULL || t >= LATENCY_TYPES) {
+			strcpy(context->result, "0");
+		} else {
+			struct latency_hist * h = &context->latency[t];
+			const char * p = strchr(param, ':') + 1;
+			uint64_t v;
+			if (strcmp(p, "max") == 0) {
+				v = h->max;
+			} else if (strcmp(p, "count") == 0) {
+				v = h->count;
+			} else {
+				v = latency_percentile(h, strtod(p, NULL));
+			}
+			sprintf(context->result, "%" PRIu64, v);
+		}
 	} else {
 		context->result[0] = '\0';
 	}
@@ -584,14 +800,16 @@ cmd_logon(struct skynet_context * context, const char * param) {
 	struct skynet_context * ctx = skynet_handle_grab(handle);
 	if (ctx == NULL)
 		return NULL;
-	FILE *f = NULL;
-	FILE * lastf = (FILE *)ATOM_LOAD(&ctx->logfile);
+	struct skynet_log *f = NULL;
+	struct skynet_log * lastf = (struct skynet_log *)ATOM_LOAD(&ctx->logfile);
 	if (lastf == NULL) {
 		f = skynet_log_open(context, handle);
 		if (f) {
-			if (!ATOM_CAS_POINTER(&ctx->logfile, 0, (uintptr_t)f)) {
-				// logfile opens in other thread, close this one.
-				fclose(f);
+			if (ATOM_CAS_POINTER(&ctx->logfile, 0, (uintptr_t)f)) {
+				skynet_log_publish(context, f);
+			} else {
+				// logfile opens in other thread, close this one (never published).
+				skynet_log_close(NULL, f, handle);
 			}
 		}
 	}
@@ -607,11 +825,13 @@ cmd_logoff(struct skynet_context * context, const char * param) {
 	struct skynet_context * ctx = skynet_handle_grab(handle);
 	if (ctx == NULL)
 		return NULL;
-	FILE * f = (FILE *)ATOM_LOAD(&ctx->logfile);
+	struct skynet_log * f = (struct skynet_log *)ATOM_LOAD(&ctx->logfile);
 	if (f) {
 		// logfile may close in other thread
 		if (ATOM_CAS_POINTER(&ctx->logfile, (uintptr_t)f, (uintptr_t)NULL)) {
-			skynet_log_close(context, f, handle);
+			skynet_error(context, "Close log file :%08x", handle);
+			// the service may be writing it now
+			skynet_log_defer(&ctx->logclose, f);
 		}
 	}
 	skynet_context_release(ctx);
@@ -623,18 +843,89 @@ cmd_signal(struct skynet_context * context, const char * param) {
 	uint32_t handle = tohandle(context, param);
 	if (handle == 0)
 		return NULL;
-	struct skynet_context * ctx = skynet_handle_grab(handle);
-	if (ctx == NULL)
-		return NULL;
 	param = strchr(param, ' ');
 	int sig = 0;
 	if (param) {
 		sig = strtol(param, NULL, 0);
 	}
-	// NOTICE: the signal function should be thread safe.
-	skynet_module_instance_signal(ctx->mod, ctx->instance, sig);
+	skynet_context_signal(handle, sig);
+	return NULL;
+}
 
+// AFFINITY ":handle group" binds the service to a worker group, returns the old group
+static const char *
+cmd_affinity(struct skynet_context * context, const char * param) {
+	size_t sz = strlen(param);
+	char name[sz+1];
+	int group = 0;
+	if (sscanf(param, "%s %d", name, &group) != 2)
+		return NULL;
+	uint32_t handle = tohandle(context, name);
+	if (handle == 0)
+		return NULL;
+	struct skynet_context * ctx = skynet_handle_grab(handle);
+	if (ctx == NULL)
+		return NULL;
+	int old = skynet_mq_group(ctx->queue);
+	if (skynet_mq_setgroup(ctx->queue, group)) {
+		skynet_error(context, "Invalid worker group %d", group);
+		skynet_context_release(ctx);
+		return NULL;
+	}
 	skynet_context_release(ctx);
+	sprintf(context->result, "%d", old);
+	return context->result;
+}
+
+static const char * priority_names[MQ_PRIORITIES] = { "high", "normal", "background" };
+
+// PRIORITY ":handle high|normal|background" sets the priority class of the service, returns the old one
+static const char *
+cmd_priority(struct skynet_context * context, const char * param) {
+	size_t sz = strlen(param);
+	char name[sz+1];
+	char class[sz+1];
+	if (sscanf(param, "%s %s", name, class) != 2)
+		return NULL;
+	int priority;
+	for (priority=0;priority<MQ_PRIORITIES;priority++) {
+		if (strcmp(class, priority_names[priority]) == 0)
+			break;
+	}
+	if (priority == MQ_PRIORITIES) {
+		skynet_error(context, "Invalid priority %s", class);
+		return NULL;
+	}
+	uint32_t handle = tohandle(context, name);
+	if (handle == 0)
+		return NULL;
+	struct skynet_context * ctx = skynet_handle_grab(handle);
+	if (ctx == NULL)
+		return NULL;
+	int old = skynet_mq_priority(ctx->queue);
+	skynet_mq_setpriority(ctx->queue, priority);
+	skynet_context_release(ctx);
+	strcpy(context->result, priority_names[old]);
+	return context->result;
+}
+
+static const char *
+cmd_slow(struct skynet_context * context, const char * param) {
+	int n = -1;
+	if (param && param[0]) {
+		n = strtol(param, NULL, 10);
+	}
+	sprintf(context->result, "%" PRIu64, skynet_monitor_slow(n));
+	return context->result;
+}
+
+static const char *
+cmd_memtop(struct skynet_context * context, const char * param) {
+	int n = 10;
+	if (param && param[0]) {
+		n = strtol(param, NULL, 10);
+	}
+	dump_c_memtop(n);
 	return NULL;
 }
 
@@ -655,6 +946,10 @@ static struct command_func cmd_funcs[] = {
 	{ "LOGON", cmd_logon },
 	{ "LOGOFF", cmd_logoff },
 	{ "SIGNAL", cmd_signal },
+	{ "MEMTOP", cmd_memtop },
+	{ "SLOW", cmd_slow },
+	{ "AFFINITY", cmd_affinity },
+	{ "PRIORITY", cmd_priority },
 	{ NULL, NULL },
 };
 
@@ -671,9 +966,30 @@ skynet_command(struct skynet_context * context, const char * cmd , const char *
 	return NULL;
 }
 
+// free the message which is not accepted by skynet_send, the caller keeps its reference of a shared payload
+static void
+drop_unsent(int type, void * data) {
+	if ((type & PTYPE_TAG_DONTCOPY) && !(type & PTYPE_TAG_SHARED)) {
+		skynet_free(data);
+	}
+}
+
+// harbor owns the message it sends, so a shared payload should be copied out
+static void *
+unshare_payload(void * data, size_t * sz) {
+	size_t size = *sz & MESSAGE_SIZE_MASK;
+	char * msg = skynet_malloc(size+1);
+	memcpy(msg, data, size);
+	msg[size] = '\0';
+	skynet_shared_release(data);
+	*sz &= ~MESSAGE_SHARED_TAG;
+	return msg;
+}
+
 static void
 _filter_args(struct skynet_context * context, int type, int *session, void ** data, size_t * sz) {
-	int needcopy = !(type & PTYPE_TAG_DONTCOPY);
+	int shared = type & PTYPE_TAG_SHARED;
+	int needcopy = !(type & (PTYPE_TAG_DONTCOPY | PTYPE_TAG_SHARED));
 	int allocsession = type & PTYPE_TAG_ALLOCSESSION;
 	type &= 0xff;
 
@@ -682,7 +998,10 @@ _filter_args(struct skynet_context * context, int type, int *session, void ** da
 		*session = skynet_context_newsession(context);
 	}
 
-	if (needcopy && *data) {
+	if (shared && *data) {
+		skynet_shared_grab(*data);
+		*sz |= MESSAGE_SHARED_TAG;
+	} else if (needcopy && *data) {
 		char * msg = skynet_malloc(*sz+1);
 		memcpy(msg, *data, *sz);
 		msg[*sz] = '\0';
@@ -694,11 +1013,9 @@ _filter_args(struct skynet_context * context, int type, int *session, void ** da
 
 int
 skynet_send(struct skynet_context * context, uint32_t source, uint32_t destination , int type, int session, void * data, size_t sz) {
-	if ((sz & MESSAGE_TYPE_MASK) != sz) {
+	if ((sz & MESSAGE_SIZE_MASK) != sz) {
 		skynet_error(context, "error: The message to %x is too large", destination);
-		if (type & PTYPE_TAG_DONTCOPY) {
-			skynet_free(data);
-		}
+		drop_unsent(type, data);
 		return -2;
 	}
 	_filter_args(context, type, &session, (void **)&data, &sz);
@@ -710,13 +1027,16 @@ skynet_send(struct skynet_context * context, uint32_t source, uint32_t destinati
 	if (destination == 0) {
 		if (data) {
 			skynet_error(context, "error: Destination address can't be 0");
-			skynet_free(data);
+			free_payload(data, sz);
 			return -1;
 		}
 
 		return session;
 	}
 	if (skynet_harbor_message_isremote(destination)) {
+		if (sz & MESSAGE_SHARED_TAG) {
+			data = unshare_payload(data, &sz);
+		}
 		struct remote_message * rmsg = skynet_malloc(sizeof(*rmsg));
 		rmsg->destination.handle = destination;
 		rmsg->message = data;
@@ -730,8 +1050,8 @@ skynet_send(struct skynet_context * context, uint32_t source, uint32_t destinati
 		smsg.data = data;
 		smsg.sz = sz;
 
-		if (skynet_context_push(destination, &smsg)) {
-			skynet_free(data);
+		if (context_push(context, destination, &smsg)) {
+			free_payload(data, sz);
 			return -1;
 		}
 	}
@@ -749,20 +1069,19 @@ skynet_sendname(struct skynet_context * context, uint32_t source, const char * a
 	} else if (addr[0] == '.') {
 		des = skynet_handle_findname(addr + 1);
 		if (des == 0) {
-			if (type & PTYPE_TAG_DONTCOPY) {
-				skynet_free(data);
-			}
+			drop_unsent(type, data);
 			return -1;
 		}
 	} else {
-		if ((sz & MESSAGE_TYPE_MASK) != sz) {
+		if ((sz & MESSAGE_SIZE_MASK) != sz) {
 			skynet_error(context, "error: The message to %s is too large", addr);
-			if (type & PTYPE_TAG_DONTCOPY) {
-				skynet_free(data);
-			}
+			drop_unsent(type, data);
 			return -2;
 		}
 		_filter_args(context, type, &session, (void **)&data, &sz);
+		if (sz & MESSAGE_SHARED_TAG) {
+			data = unshare_payload(data, &sz);
+		}
 
 		struct remote_message * rmsg = skynet_malloc(sizeof(*rmsg));
 		copy_name(rmsg->destination.name, addr);
@@ -789,6 +1108,11 @@ skynet_callback(struct skynet_context * context, void *ud, skynet_cb cb) {
 	context->cb_ud = ud;
 }
 
+void
+skynet_callback_reserve(struct skynet_context * context, int reserve) {
+	context->reserve = reserve;
+}
+
 void
 skynet_context_send(struct skynet_context * ctx, void * msg, size_t sz, uint32_t source, int type, int session) {
 	struct skynet_message smsg;
@@ -803,6 +1127,7 @@ skynet_context_send(struct skynet_context * ctx, void * msg, size_t sz, uint32_t
 void
 skynet_globalinit(void) {
 	ATOM_INIT(&G_NODE.total , 0);
+	ATOM_INIT(&G_NODE.numa_next , 0);
 	G_NODE.monitor_exit = 0;
 	G_NODE.init = 1;
 	if (pthread_key_create(&G_NODE.handle_key, NULL)) {
@@ -828,3 +1153,13 @@ void
 skynet_profile_enable(int enable) {
 	G_NODE.profile = (bool)enable;
 }
+
+void
+skynet_numa_enable(int nodes) {
+	G_NODE.numa = nodes;
+}
+
+int
+skynet_numa_nodes(void) {
+	return G_NODE.numa;
+}
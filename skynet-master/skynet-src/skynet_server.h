@@ -16,16 +16,19 @@ uint32_t skynet_context_handle(struct skynet_context *);
 int skynet_context_push(uint32_t handle, struct skynet_message *message);
 void skynet_context_send(struct skynet_context * context, void * msg, size_t sz, uint32_t source, int type, int session);
 int skynet_context_newsession(struct skynet_context *);
-struct message_queue * skynet_context_message_dispatch(struct skynet_monitor *, struct message_queue *, int weight);	// return next queue
+struct message_queue * skynet_context_message_dispatch(struct skynet_monitor *, struct message_queue *, int weight, int group);	// return next queue
 int skynet_context_total();
 void skynet_context_dispatchall(struct skynet_context * context);	// for skynet_error output before exit
 
 void skynet_context_endless(uint32_t handle);	// for monitor
+void skynet_context_signal(uint32_t handle, int sig);
 
 void skynet_globalinit(void);
 void skynet_globalexit(void);
 void skynet_initthread(int m);
 
 void skynet_profile_enable(int enable);
+// place the new services on the numa nodes (worker groups) in turn
+void skynet_numa_enable(int nodes);
 
 #endif
@@ -1,3 +1,8 @@
+#ifdef __linux__
+// for pthread_setaffinity_np
+#define _GNU_SOURCE
+#endif
+
 #include "skynet.h"
 #include "skynet_server.h"
 #include "skynet_imp.h"
@@ -9,6 +14,7 @@
 #include "skynet_socket.h"
 #include "skynet_daemon.h"
 #include "skynet_harbor.h"
+#include "malloc_hook.h"
 
 #include <pthread.h>
 #include <unistd.h>
@@ -18,23 +24,52 @@
 #include <string.h>
 #include <signal.h>
 
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+// The workers of group 0 serve the services by default, the other groups only serve the services bound to them.
+// See AFFINITY in skynet_server.c
+struct worker_group {
+	pthread_cond_t cond;
+	int count;
+	int sleep;
+};
+
+// numa = "0-3;4-7" : the cpus of each numa node, or "auto" to read them from /sys/devices/system/node
+// Each node has its own worker group and allocation arena, and a new service stays on one node.
+struct numa_layout {
+	int nodes;
+#ifdef __linux__
+	cpu_set_t cpus[MQ_MAX_GROUP];
+#endif
+};
+
 struct monitor {
 	int count;
 	struct skynet_monitor ** m;
-	pthread_cond_t cond;
 	pthread_mutex_t mutex;
-	int sleep;
+	int groups;
+	struct worker_group group[MQ_MAX_GROUP];
 	int quit;
+	int interval;	// check interval of monitor thread, in ms
+	struct numa_layout * numa;	// NULL when numa is off
 };
 
 struct worker_parm {
 	struct monitor *m;
 	int id;
 	int weight;
+	int group;
+	int cpu;	// -1 for no cpu affinity
+	int node;	// -1 for numa off
 };
 
 static volatile int SIG = 0;
 
+static struct numa_layout * NUMA = NULL;
+static __thread int numa_current = -1;
+
 static void
 handle_hup(int signal) {
 	if (signal == SIGHUP) {
@@ -42,6 +77,9 @@ handle_hup(int signal) {
 	}
 }
 
+// the monitor thread checks abort every MONITOR_STEP ms
+#define MONITOR_STEP 100
+
 #define CHECK_ABORT if (skynet_context_total()==0) break;
 
 static void
@@ -54,26 +92,51 @@ create_thread(pthread_t *thread, void *(*start_routine) (void *), void *arg) {
 
 static void
 wakeup(struct monitor *m, int busy) {
-	if (m->sleep >= m->count - busy) {
-		// signal sleep worker, "spurious wakeup" is harmless
-		pthread_cond_signal(&m->cond);
+	int i;
+	for (i=0;i<m->groups;i++) {
+		struct worker_group *g = &m->group[i];
+		if (g->sleep > 0 && g->sleep >= g->count - busy) {
+			// signal sleep worker, "spurious wakeup" is harmless
+			pthread_cond_signal(&g->cond);
+		}
 	}
 }
 
+// wake up a sleeping worker of the other groups which have queues to dispatch,
+// or they wait for the timer thread
+static void
+wakeup_group(struct monitor *m, int group) {
+	int i;
+	for (i=0;i<m->groups;i++) {
+		struct worker_group *g = &m->group[i];
+		if (i != group && g->sleep > 0 && g->sleep == g->count && skynet_globalmq_pending(i)) {
+			pthread_cond_signal(&g->cond);
+		}
+	}
+}
+
+static void bind_node(struct numa_layout *l, int node);
+
 static void *
 thread_socket(void *p) {
 	struct monitor * m = p;
 	skynet_initthread(THREAD_SOCKET);
+	if (m->numa) {
+		// the socket thread works for all the nodes, put it on the first one
+		bind_node(m->numa, 0);
+	}
 	for (;;) {
 		int r = skynet_socket_poll();
 		if (r==0)
 			break;
+		malloc_delta_tick(skynet_now());
 		if (r<0) {
 			CHECK_ABORT
 			continue;
 		}
 		wakeup(m,0);
 	}
+	malloc_flush_delta();
 	return NULL;
 }
 
@@ -85,7 +148,9 @@ free_monitor(struct monitor *m) {
 		skynet_monitor_delete(m->m[i]);
 	}
 	pthread_mutex_destroy(&m->mutex);
-	pthread_cond_destroy(&m->cond);
+	for (i=0;i<m->groups;i++) {
+		pthread_cond_destroy(&m->group[i].cond);
+	}
 	skynet_free(m->m);
 	skynet_free(m);
 }
@@ -101,9 +166,10 @@ thread_monitor(void *p) {
 		for (i=0;i<n;i++) {
 			skynet_monitor_check(m->m[i]);
 		}
-		for (i=0;i<5;i++) {
+		int t;
+		for (t=m->interval;t>0;t-=MONITOR_STEP) {
 			CHECK_ABORT
-			sleep(1);
+			usleep((t < MONITOR_STEP ? t : MONITOR_STEP) * 1000);
 		}
 	}
 
@@ -132,6 +198,7 @@ thread_timer(void *p) {
 	for (;;) {
 		skynet_updatetime();
 		skynet_socket_updatetime();
+		malloc_delta_tick(skynet_now());
 		CHECK_ABORT
 		wakeup(m,m->count-1);
 		usleep(2500);
@@ -145,48 +212,209 @@ thread_timer(void *p) {
 	// wakeup all worker thread
 	pthread_mutex_lock(&m->mutex);
 	m->quit = 1;
-	pthread_cond_broadcast(&m->cond);
+	int i;
+	for (i=0;i<m->groups;i++) {
+		pthread_cond_broadcast(&m->group[i].cond);
+	}
 	pthread_mutex_unlock(&m->mutex);
+	malloc_flush_delta();
 	return NULL;
 }
 
+static void
+bind_cpu(int cpu) {
+	if (cpu < 0)
+		return;
+#ifdef __linux__
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+	if (err) {
+		skynet_error(NULL, "error: Bind worker thread to cpu %d failed (%d)", cpu, err);
+	}
+#else
+	skynet_error(NULL, "error: cpu affinity is not supported");
+#endif
+}
+
+static void
+bind_node(struct numa_layout *l, int node) {
+#ifdef __linux__
+	int err = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &l->cpus[node]);
+	if (err) {
+		skynet_error(NULL, "error: Bind thread to numa node %d failed (%d)", node, err);
+	}
+#endif
+}
+
+void
+skynet_numa_bind(int node) {
+	if (NUMA == NULL || node < 0 || node >= NUMA->nodes)
+		return;
+	bind_node(NUMA, node);
+	malloc_numa_bind(node);
+	numa_current = node;
+}
+
+int
+skynet_numa_node(void) {
+	return numa_current;
+}
+
 static void *
 thread_worker(void *p) {
 	struct worker_parm *wp = p;
 	int id = wp->id;
 	int weight = wp->weight;
+	int group = wp->group;
 	struct monitor *m = wp->m;
+	struct worker_group *g = &m->group[group];
 	struct skynet_monitor *sm = m->m[id];
 	skynet_initthread(THREAD_WORKER);
+	if (wp->node >= 0) {
+		if (wp->cpu < 0) {
+			bind_node(m->numa, wp->node);
+		}
+		malloc_numa_bind(wp->node);
+		numa_current = wp->node;
+	}
+	bind_cpu(wp->cpu);
 	struct message_queue * q = NULL;
 	while (!m->quit) {
-		q = skynet_context_message_dispatch(sm, q, weight);
+		q = skynet_context_message_dispatch(sm, q, weight, group);
+		if (m->groups > 1) {
+			wakeup_group(m, group);
+		}
 		if (q == NULL) {
+			// don't keep the memory stat while sleeping
+			malloc_flush_delta();
 			if (pthread_mutex_lock(&m->mutex) == 0) {
-				++ m->sleep;
+				++ g->sleep;
 				// "spurious wakeup" is harmless,
 				// because skynet_context_message_dispatch() can be call at any time.
 				if (!m->quit)
-					pthread_cond_wait(&m->cond, &m->mutex);
-				-- m->sleep;
+					pthread_cond_wait(&g->cond, &m->mutex);
+				-- g->sleep;
 				if (pthread_mutex_unlock(&m->mutex)) {
 					fprintf(stderr, "unlock mutex error");
 					exit(1);
 				}
 			}
+		} else {
+			malloc_delta_tick(skynet_now());
 		}
 	}
+	malloc_flush_delta();
 	return NULL;
 }
 
+// parse "n1,n2,..." into the list, return the count of numbers
+static int
+parse_list(const char *str, int list[], int n) {
+	int i = 0;
+	if (str == NULL)
+		return 0;
+	while (i < n && *str) {
+		char *end;
+		list[i] = strtol(str, &end, 10);
+		if (end == str)
+			break;
+		++i;
+		str = end;
+		while (*str == ',' || *str == ' ')
+			++str;
+	}
+	return i;
+}
+
+#ifdef __linux__
+
+// parse the cpu list "0-3,8,10-11"
+static int
+parse_cpus(const char *str, const char *end, cpu_set_t *set) {
+	CPU_ZERO(set);
+	int n = 0;
+	while (str < end) {
+		char *p;
+		long from = strtol(str, &p, 10);
+		if (p == str || from < 0)
+			return 0;
+		long to = from;
+		if (*p == '-') {
+			str = p + 1;
+			to = strtol(str, &p, 10);
+			if (p == str || to < from)
+				return 0;
+		}
+		for (;from <= to && from < CPU_SETSIZE;from++) {
+			CPU_SET(from, set);
+			++n;
+		}
+		str = p;
+		while (str < end && (*str == ',' || *str == ' ' || *str == '\n'))
+			++str;
+	}
+	return n;
+}
+
+static int
+numa_auto(struct numa_layout *l) {
+	int i;
+	for (i=0;i<MQ_MAX_GROUP;i++) {
+		char filename[64];
+		char buf[1024];
+		snprintf(filename, sizeof(filename), "/sys/devices/system/node/node%d/cpulist", i);
+		FILE *f = fopen(filename, "r");
+		if (f == NULL)
+			break;
+		size_t sz = fread(buf, 1, sizeof(buf)-1, f);
+		fclose(f);
+		buf[sz] = '\0';
+		if (parse_cpus(buf, buf + sz, &l->cpus[i]) == 0)
+			break;
+	}
+	return i;
+}
+
+static int
+numa_init(const char *config, struct numa_layout *l) {
+	if (strcmp(config, "auto") == 0)
+		return l->nodes = numa_auto(l);
+	int n = 0;
+	while (*config && n < MQ_MAX_GROUP) {
+		const char *end = strchr(config, ';');
+		if (end == NULL)
+			end = config + strlen(config);
+		if (parse_cpus(config, end, &l->cpus[n]) == 0)
+			return 0;
+		++n;
+		config = *end ? end + 1 : end;
+	}
+	return l->nodes = n;
+}
+
+#else
+
+static int
+numa_init(const char *config, struct numa_layout *l) {
+	fprintf(stderr, "numa is not supported\n");
+	return 0;
+}
+
+#endif
+
 static void
-start(int thread) {
+start(struct skynet_config *config, int groups, int group_size[], struct numa_layout *numa) {
+	int thread = config->thread;
 	pthread_t pid[thread+3];
 
 	struct monitor *m = skynet_malloc(sizeof(*m));
 	memset(m, 0, sizeof(*m));
 	m->count = thread;
-	m->sleep = 0;
+	m->interval = config->monitor_interval > 0 ? config->monitor_interval : MONITOR_STEP;
+	m->groups = groups;
+	m->numa = numa;
 
 	m->m = skynet_malloc(thread * sizeof(struct skynet_monitor *));
 	int i;
@@ -197,10 +425,15 @@ start(int thread) {
 		fprintf(stderr, "Init mutex error");
 		exit(1);
 	}
-	if (pthread_cond_init(&m->cond, NULL)) {
-		fprintf(stderr, "Init cond error");
-		exit(1);
+	for (i=0;i<groups;i++) {
+		m->group[i].count = group_size[i];
+		if (pthread_cond_init(&m->group[i].cond, NULL)) {
+			fprintf(stderr, "Init cond error");
+			exit(1);
+		}
 	}
+	int cpu[thread];
+	int ncpu = parse_list(config->worker_cpu, cpu, thread);
 
 	create_thread(&pid[0], thread_monitor, m);
 	create_thread(&pid[1], thread_timer, m);
@@ -212,14 +445,33 @@ start(int thread) {
 		2, 2, 2, 2, 2, 2, 2, 2,
 		3, 3, 3, 3, 3, 3, 3, 3, };
 	struct worker_parm wp[thread];
+	int group = 0;
+	int group_left = group_size[0];
+	int index = 0;	// index in group
 	for (i=0;i<thread;i++) {
+		if (group_left == 0) {
+			++group;
+			group_left = group_size[group];
+			index = 0;
+		}
+		--group_left;
 		wp[i].m = m;
 		wp[i].id = i;
-		if (i < sizeof(weight)/sizeof(weight[0])) {
+		wp[i].group = group;
+		wp[i].cpu = i < ncpu ? cpu[i] : -1;
+		wp[i].node = numa ? group : -1;
+		if (numa) {
+			// the worker groups of numa nodes are all shared pools
+			wp[i].weight = index < sizeof(weight)/sizeof(weight[0]) ? weight[index] : 0;
+		} else if (group > 0) {
+			// dedicated workers drain the whole queue
+			wp[i].weight = 0;
+		} else if (i < sizeof(weight)/sizeof(weight[0])) {
 			wp[i].weight= weight[i];
 		} else {
 			wp[i].weight = 0;
 		}
+		++index;
 		create_thread(&pid[i+3], thread_worker, &wp[i]);
 	}
 
@@ -274,11 +526,58 @@ skynet_start(struct skynet_config * config) {
 	}
 	skynet_harbor_init(config->harbor);
 	skynet_handle_init(config->harbor);
-	skynet_mq_init();
+	int i;
+	// worker_group = "2,1" : 2 workers in group 1, 1 worker in group 2, the others in group 0
+	int group_size[MQ_MAX_GROUP];
+	int groups;
+	static struct numa_layout numa_layout;
+	struct numa_layout *numa = NULL;
+	if (config->numa) {
+		if (config->worker_group) {
+			fprintf(stderr, "Can't use worker_group and numa together\n");
+			exit(1);
+		}
+		groups = numa_init(config->numa, &numa_layout);
+		if (groups < 1 || groups > config->thread) {
+			fprintf(stderr, "Invalid numa %s (%d nodes), thread = %d\n", config->numa, groups, config->thread);
+			exit(1);
+		}
+		// split the worker threads evenly
+		for (i=0;i<groups;i++) {
+			group_size[i] = config->thread / groups + (i < config->thread % groups);
+		}
+		numa = &numa_layout;
+		NUMA = numa;
+		malloc_numa_init(groups);
+		skynet_numa_enable(groups);
+	} else {
+		groups = 1 + parse_list(config->worker_group, group_size + 1, MQ_MAX_GROUP - 1);
+		int dedicated = 0;
+		for (i=1;i<groups;i++) {
+			if (group_size[i] <= 0) {
+				fprintf(stderr, "Invalid worker_group %s\n", config->worker_group);
+				exit(1);
+			}
+			dedicated += group_size[i];
+		}
+		group_size[0] = config->thread - dedicated;
+		if (group_size[0] < 1) {
+			fprintf(stderr, "Need at least one shared worker thread, thread = %d, worker_group = %s\n", config->thread, config->worker_group);
+			exit(1);
+		}
+	}
+	skynet_mq_init(groups);
 	skynet_module_init(config->module_path);
+	if (config->module_preload) {
+		skynet_module_preload(config->module_preload);
+	}
 	skynet_timer_init();
 	skynet_socket_init();
 	skynet_profile_enable(config->profile);
+	if (config->heap_sample > 0) {
+		malloc_heap_sample(config->heap_sample);
+	}
+	skynet_monitor_slowtime(config->monitor_slow);
 
 	const uint32_t logger_handle = skynet_context_new(config->logservice, config->logger);
 	if (logger_handle == 0) {
@@ -290,7 +589,7 @@ skynet_start(struct skynet_config * config) {
 
 	bootstrap(logger_handle, config->bootstrap);
 
-	start(config->thread);
+	start(config, groups, group_size, numa);
 
 	// harbor_exit may call socket send, so it should exit before socket_free
 	skynet_harbor_exit();
@@ -7,6 +7,7 @@ int skynet_timeout(uint32_t handle, int time, int session);
 void skynet_updatetime(void);
 uint32_t skynet_starttime(void);
 uint64_t skynet_thread_time(void);	// for profile, in micro second
+uint64_t skynet_monotonic_time(void);	// in micro second
 
 void skynet_timer_init(void);
 
@@ -0,0 +1,70 @@
+local skynet = require "skynet.manager"	-- import skynet.affinity, skynet.abort
+
+-- usage: testaffinity [count]
+-- Run with worker_group = "1" (thread >= 2) in config, see examples/config.
+-- Pin a service to the dedicated group 1, check it only runs there while the busy services
+-- of group 0 never run on the dedicated worker.
+
+local mode = ...
+
+if mode == "probe" then
+
+skynet.start(function()
+	skynet.dispatch("lua", function()
+		skynet.ret(skynet.pack(skynet.stat "workergroup"))
+	end)
+end)
+
+elseif mode == "busy" then
+
+skynet.start(function()
+	local groups = {}
+	local running = true
+	skynet.dispatch("lua", function(_, _, cmd)
+		if cmd == "spin" then
+			if running then
+				groups[skynet.stat "workergroup"] = true
+				skynet.send(skynet.self(), "lua", "spin")
+			end
+		else
+			running = false
+			skynet.ret(skynet.pack(groups))
+		end
+	end)
+	skynet.send(skynet.self(), "lua", "spin")
+end)
+
+else
+
+local count = tonumber(mode) or 1000
+
+skynet.start(function()
+	local busy = {}
+	for i = 1, 4 do
+		busy[i] = skynet.newservice(SERVICE_NAME, "busy")
+	end
+	local probe = skynet.newservice(SERVICE_NAME, "probe")
+	assert(skynet.call(probe, "lua") == 0, "A new service should start in group 0")
+
+	assert(skynet.affinity(probe, 1) == 0)
+	for _ = 1, count do
+		local group = skynet.call(probe, "lua")
+		assert(group == 1, "The pinned service runs in group " .. group)
+	end
+
+	-- move it back
+	assert(skynet.affinity(probe, 0) == 1)
+	for _ = 1, count do
+		assert(skynet.call(probe, "lua") == 0)
+	end
+
+	for _, addr in ipairs(busy) do
+		local groups = skynet.call(addr, "lua", "stop")
+		assert(groups[0] and not groups[1], "A service of group 0 runs on the dedicated worker")
+	end
+	skynet.error("affinity ok")
+	skynet.sleep(10)
+	skynet.abort()
+end)
+
+end
@@ -0,0 +1,309 @@
+local skynet = require "skynet.manager"	-- import skynet.abort
+local socket = require "skynet.socket"
+
+-- usage: testbench [case ...] , run with examples/config.bench
+-- Cases : msg timer socket spawn seri (all by default).
+-- The results are printed, and written as one json object per line to `bench_output`,
+-- compare two result files by tools/benchcompare.lua
+
+local mode = ...
+
+if mode == "sink" then
+
+skynet.start(function()
+	local n = 0
+	skynet.dispatch("lua", function(session, _, cmd)
+		if session == 0 then
+			n = n + 1
+		elseif cmd == "count" then
+			skynet.ret(skynet.pack(n))
+			n = 0
+		elseif cmd == "exit" then
+			skynet.ret()
+			skynet.exit()
+		else
+			skynet.ret()
+		end
+	end)
+end)
+
+elseif mode == "echo" then
+
+skynet.start(function()
+	local port = tonumber(skynet.getenv "bench_port") or 2529
+	local id = socket.listen("127.0.0.1", port)
+	socket.start(id, function(fd)
+		socket.start(fd)
+		while true do
+			local data = socket.read(fd)
+			if not data then
+				break
+			end
+			socket.write(fd, data)
+		end
+		socket.close(fd)
+	end)
+	skynet.dispatch("lua", function(_, _, cmd)
+		if cmd == "port" then
+			skynet.ret(skynet.pack(port))
+		else
+			socket.close(id)
+			skynet.ret()
+			skynet.exit()
+		end
+	end)
+end)
+
+elseif mode == "child" then
+
+skynet.start(function()
+	skynet.dispatch("lua", function()
+		skynet.exit()
+	end)
+end)
+
+else
+
+local cases = { ... }
+local scale = tonumber(skynet.getenv "bench_scale") or 1
+local results = {}
+
+local function count(n)
+	return math.max(1, math.floor(n * scale))
+end
+
+local function seconds(t)
+	return t / 1e9
+end
+
+local function report(name, value, unit)
+	skynet.error(string.format("%-16s %14.2f %s", name, value, unit))
+	table.insert(results, { name = name, value = value, unit = unit })
+end
+
+local function percentile(list, p)
+	table.sort(list)
+	return list[math.max(1, math.ceil(#list * p))]
+end
+
+-- wait for all the forked functions
+local function parallel(n, f)
+	local running = n
+	local co = coroutine.running()
+	for i = 1, n do
+		skynet.fork(function()
+			f(i)
+			running = running - 1
+			if running == 0 then
+				skynet.wakeup(co)
+			end
+		end)
+	end
+	skynet.wait(co)
+end
+
+local bench = {}
+
+function bench.msg()
+	local sink = skynet.newservice(SERVICE_NAME, "sink")
+	local n = count(200000)
+	local t = skynet.hpc()
+	for _ = 1, n do
+		skynet.send(sink, "lua", "push")
+	end
+	-- the messages from one source are in order, so the count arrives last
+	assert(skynet.call(sink, "lua", "count") == n)
+	report("msg.send", n / seconds(skynet.hpc() - t), "msg/s")
+
+	n = count(50000)
+	local latency = {}
+	for i = 1, n do
+		local ti = skynet.hpc()
+		skynet.call(sink, "lua", "ping")
+		latency[i] = skynet.hpc() - ti
+	end
+	local sum = 0
+	for i = 1, n do
+		sum = sum + latency[i]
+	end
+	report("msg.call", n / seconds(sum), "call/s")
+	report("msg.call.avg", sum / n / 1e3, "us")
+	report("msg.call.p50", percentile(latency, 0.5) / 1e3, "us")
+	report("msg.call.p99", percentile(latency, 0.99) / 1e3, "us")
+
+	local worker = 16
+	local task = count(100000) // worker
+	t = skynet.hpc()
+	parallel(worker, function()
+		for _ = 1, task do
+			skynet.call(sink, "lua", "ping")
+		end
+	end)
+	report("msg.call.parallel", task * worker / seconds(skynet.hpc() - t), "call/s")
+	skynet.call(sink, "lua", "exit")
+end
+
+function bench.timer()
+	local n = count(200000)
+	local fired = 0
+	local co = coroutine.running()
+	local function f()
+		fired = fired + 1
+		if fired == n then
+			skynet.wakeup(co)
+		end
+	end
+	local t = skynet.hpc()
+	for _ = 1, n do
+		skynet.timeout(1, f)
+	end
+	skynet.wait(co)
+	-- include the one tick (10ms) of waiting
+	report("timer.fire", n / seconds(skynet.hpc() - t), "timer/s")
+
+	n = count(1000)
+	local late = {}
+	for i = 1, n do
+		local ti = skynet.hpc()
+		skynet.sleep(1)
+		late[i] = skynet.hpc() - ti
+	end
+	report("timer.sleep.p99", percentile(late, 0.99) / 1e6, "ms")
+end
+
+function bench.socket()
+	local echo = skynet.newservice(SERVICE_NAME, "echo")
+	local port = skynet.call(echo, "lua", "port")
+	local conn = 4
+	local window = 16
+	local size = 64
+	local round = count(20000) // conn
+	local packet = string.rep("x", size * window)
+	local t = skynet.hpc()
+	parallel(conn, function()
+		local fd = assert(socket.open("127.0.0.1", port))
+		for _ = 1, round do
+			socket.write(fd, packet)
+			assert(socket.read(fd, #packet))
+		end
+		socket.close(fd)
+	end)
+	local elapsed = seconds(skynet.hpc() - t)
+	report("socket.echo", conn * round * window / elapsed, "packet/s")
+	report("socket.echo.bytes", conn * round * #packet / elapsed / 1024 / 1024, "MB/s")
+
+	-- one packet in flight
+	local fd = assert(socket.open("127.0.0.1", port))
+	local n = count(20000)
+	packet = string.rep("x", size)
+	t = skynet.hpc()
+	for _ = 1, n do
+		socket.write(fd, packet)
+		assert(socket.read(fd, size))
+	end
+	report("socket.rtt", (skynet.hpc() - t) / n / 1e3, "us")
+	socket.close(fd)
+	skynet.call(echo, "lua", "exit")
+end
+
+function bench.spawn()
+	local n = count(2000)
+	local services = {}
+	local t = skynet.hpc()
+	parallel(16, function()
+		while #services < n do
+			table.insert(services, skynet.newservice(SERVICE_NAME, "child"))
+		end
+	end)
+	report("spawn", #services / seconds(skynet.hpc() - t), "service/s")
+	for _, addr in ipairs(services) do
+		skynet.send(addr, "lua")
+	end
+end
+
+function bench.seri()
+	local obj = {
+		id = 10001,
+		name = "player",
+		pos = { x = 1.5, y = -2.5, z = 0 },
+		items = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10 },
+		flags = { online = true, vip = false },
+		desc = string.rep("a", 100),
+	}
+	local n = count(200000)
+	local msg, sz = skynet.pack(obj)
+	local t = skynet.hpc()
+	for _ = 1, n do
+		skynet.trash(skynet.pack(obj))
+	end
+	local elapsed = seconds(skynet.hpc() - t)
+	report("seri.pack", n / elapsed, "op/s")
+	report("seri.pack.bytes", n * sz / elapsed / 1024 / 1024, "MB/s")
+	-- don't run too long in one message
+	skynet.yield()
+
+	t = skynet.hpc()
+	for _ = 1, n do
+		skynet.unpack(msg, sz)
+	end
+	report("seri.unpack", n / seconds(skynet.hpc() - t), "op/s")
+	skynet.trash(msg, sz)
+	skynet.yield()
+
+	local str = skynet.packstring(obj)
+	t = skynet.hpc()
+	for _ = 1, n do
+		skynet.unpack(str)
+	end
+	report("seri.unpack.str", n / seconds(skynet.hpc() - t), "op/s")
+end
+
+local ORDER = { "msg", "timer", "socket", "spawn", "seri" }
+
+local function jsonstr(s)
+	return '"' .. s:gsub('[%c"\\]', function(c)
+		return string.format("\\u%04x", c:byte())
+	end) .. '"'
+end
+
+local function output(filename)
+	local f = io.open(filename, "wb")
+	if not f then
+		skynet.error("Can't open", filename)
+		return
+	end
+	f:write(string.format('{"meta":{"thread":%s,"scale":%s,"time":%d,"version":%s}}\n',
+		skynet.getenv "thread", scale, math.floor(skynet.time()), jsonstr(_VERSION)))
+	for _, r in ipairs(results) do
+		f:write(string.format('{"bench":%s,"value":%.3f,"unit":%s}\n', jsonstr(r.name), r.value, jsonstr(r.unit)))
+	end
+	f:close()
+	skynet.error("Write results to", filename)
+end
+
+skynet.start(function()
+	if #cases == 0 then
+		cases = ORDER
+	end
+	for _, name in ipairs(cases) do
+		local f = bench[name]
+		if not f then
+			skynet.error("Unknown bench case", name)
+		else
+			-- start from a quiet node
+			collectgarbage()
+			skynet.sleep(10)
+			local ok, err = pcall(f)
+			if not ok then
+				skynet.error("Bench case", name, "failed :", err)
+			end
+		end
+	end
+	local filename = skynet.getenv "bench_output"
+	if filename then
+		output(filename)
+	end
+	skynet.abort()
+end)
+
+end
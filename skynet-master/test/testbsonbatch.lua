@@ -0,0 +1,152 @@
+local bson = require "bson"
+
+-- usage: lua testbsonbatch.lua [count]
+-- Check bson.encode_batch and bson.decode_lazy against encode/decode, and compare the time.
+
+local count = tonumber((...)) or 20000
+
+local function deepeq(a, b)
+	if type(a) ~= "table" or type(b) ~= "table" then
+		return a == b
+	end
+	for k, v in pairs(a) do
+		if not deepeq(v, b[k]) then
+			return false
+		end
+	end
+	for k in pairs(b) do
+		if a[k] == nil then
+			return false
+		end
+	end
+	return true
+end
+
+local function newdoc(i)
+	return {
+		_id = i,
+		name = "player" .. i,
+		level = i % 100,
+		score = i * 1.5,
+		online = i % 2 == 0,
+		pos = { x = i, y = -i },
+		items = { i, i + 1, i + 2 },
+		note = "中文",
+	}
+end
+
+local function bigdoc(i)
+	local doc = newdoc(i)
+	local bag = {}
+	for j = 1, 30 do
+		bag[j] = { id = j, count = i + j }
+	end
+	doc.bag = bag
+	return doc
+end
+
+do
+	local docs = {}
+	for i = 1, 12000 do
+		docs[i] = newdoc(i)
+	end
+	-- bson object and the metatable __pairs are supported
+	docs[3] = bson.encode(docs[3])
+	docs[5] = setmetatable({}, { __pairs = function() return next, { a = 1 } end })
+	local batch = bson.encode_batch(docs)
+	assert(tostring(bson.encode { d = docs }) == tostring(bson.encode { d = batch }))
+	local t = bson.decode(bson.encode { d = batch })
+	assert(#t.d == #docs and t.d[12000].name == "player12000" and t.d[5].a == 1)
+	-- empty batch, and the buffer is reused
+	assert(#bson.decode(bson.encode { d = bson.encode_batch {} }).d == 0)
+	assert(not pcall(bson.encode_batch, { 1 }))
+	assert(not pcall(bson.encode_batch, { { ["\xff"] = 1 } }))
+	assert(tostring(bson.encode { d = docs }) == tostring(bson.encode { d = bson.encode_batch(docs) }))
+	print("encode_batch ok")
+end
+
+do
+	-- the sub documents smaller than 256 bytes are decoded at once
+	local pad = string.rep("x", 256)
+	local obj = {
+		a = 1,
+		b = { c = { d = { 1, 2, { e = "e", pad = pad } }, pad = pad } },
+		f = {},
+		g = { 10, 20, 30, pad },
+		h = bson.null,
+		i = bson.objectid(),
+	}
+	local doc = bson.encode(obj)
+	local t = bson.decode(doc)
+	assert(deepeq(bson.decode_lazy(doc), t))
+	local ptr = bson.to_lightuserdata(doc)
+	local lazy = bson.decode_lazy(ptr)
+	assert(#lazy.g == 4 and lazy.g[3] == 30)
+	assert(lazy.b.c.d[3].e == "e")
+	assert(next(lazy.f) == nil)
+	-- write before the first read
+	local b = bson.decode_lazy(doc).b
+	b.x = 1
+	assert(b.x == 1 and b.c.d[1] == 1)
+	local n = 0
+	for _ in pairs(bson.decode_lazy(doc).g) do
+		n = n + 1
+	end
+	assert(n == 4)
+	local a = bson.decode_lazy(doc).b
+	collectgarbage()
+	assert(a.c.d[2] == 2)
+	print("decode_lazy ok")
+end
+
+local function bench()
+	local docs = {}
+	for i = 1, count do
+		docs[i] = newdoc(i)
+	end
+	-- collect the garbage before each timed section, don't count it in the next one
+	collectgarbage()
+	local t1 = os.clock()
+	local encoded = {}
+	for i = 1, count do
+		encoded[i] = bson.encode(docs[i])
+	end
+	local cmd1 = bson.encode_order("insert", "test", "documents", encoded)
+	t1 = os.clock() - t1
+	encoded = nil
+	collectgarbage()
+	local t2 = os.clock()
+	local cmd2 = bson.encode_order("insert", "test", "documents", bson.encode_batch(docs))
+	t2 = os.clock() - t2
+	assert(tostring(cmd1) == tostring(cmd2))
+	print(string.format("encode %d docs : encode %.3fs, encode_batch %.3fs", count, t1, t2))
+
+	for i = 1, count do
+		docs[i] = bigdoc(i)
+	end
+	local reply = bson.encode_order("cursor", bson.encode_order("firstBatch", bson.encode_batch(docs)), "ok", 1)
+	local ptr = bson.to_lightuserdata(reply)
+	docs = nil
+	collectgarbage()
+	t1 = os.clock()
+	local r = bson.decode(ptr)
+	local s = 0
+	for i = 1, #r.cursor.firstBatch do
+		s = s + r.cursor.firstBatch[i].level
+	end
+	t1 = os.clock() - t1
+	r = nil
+	collectgarbage()
+	t2 = os.clock()
+	r = bson.decode_lazy(ptr)
+	local s2 = 0
+	local batch = r.cursor.firstBatch
+	for i = 1, #batch do
+		s2 = s2 + batch[i].level
+	end
+	t2 = os.clock() - t2
+	assert(s == s2)
+	print(string.format("read a field of %d docs : decode %.3fs, decode_lazy %.3fs", count, t1, t2))
+end
+
+bench()
@@ -31,4 +31,64 @@ assert(desencode(key, "123456","pkcs7")=="ED5wLgc3Mnw=")
 assert(desencode(key, "1234567","pkcs7")=="mYo+BYIT41M=")
 assert(desencode(key, "12345678","pkcs7")=="ltACiHjVjIn+uVm31GQvyw==")
 
+-- known answers of hex, xor and the handshake, the inputs are from a LCG
+do
+	local seed = 1
+	local function bytes(n)
+		local t = {}
+		for i = 1, n do
+			seed = (seed * 1103515245 + 12345) % 2147483648
+			t[i] = string.char((seed >> 16) & 0xff)
+		end
+		return table.concat(t)
+	end
+	local function h(t)
+		return crypt.hexencode(crypt.sha1(table.concat(t)))
+	end
+	local hex = {}
+	for _, n in ipairs {0,1,7,15,16,17,31,32,33,100,1000} do
+		local s = bytes(n)
+		hex[#hex+1] = crypt.hexencode(s)
+		assert(crypt.hexdecode(hex[#hex]) == s)
+	end
+	assert(h(hex) == "18d6f6f6f67dd28ee1b78b6c9bb5a914bc82c8cf")
+	local dh, sec, hm = {}, {}, {}
+	for i = 1, 64 do
+		local a, b = bytes(8), bytes(8)
+		dh[i] = crypt.dhexchange(a)
+		sec[i] = crypt.dhsecret(a, b)
+		hm[i] = crypt.hmac64(a, b)
+	end
+	assert(h(dh) == "872b100aaf07ce8f997ce3029d02c9d9c21c260e")
+	assert(h(sec) == "fc24374eed88560aa1b5d7c9949791823a54d66c")
+	assert(h(hm) == "78f72acefdf7c7fc32e174e24cf3d47d8e9cbb55")
+	local x = {}
+	for _, n in ipairs {0,1,3,4,5,8,15,16,17,33,100,1000} do
+		local s = bytes(n)
+		for _, k in ipairs {1,2,4,7,8,16,17,40} do
+			x[#x+1] = crypt.xor_str(s, bytes(k))
+		end
+	end
+	assert(h(x) == "22a65d7dc28ebf2dcea7bf1eef6ee7446ee76d1c")
+
+	assert(crypt.hexencode(crypt.dhexchange("12345678")) == "a18e89af97222f0e")
+	assert(crypt.hexencode(crypt.dhsecret("12345678", "87654321")) == "0487fc3b00d392a6")
+	assert(crypt.hexencode(crypt.hmac64("12345678", "87654321")) == "20748a553ffe142e")
+	assert(crypt.hexencode(crypt.dhsecret(string.rep("\xff", 8), string.rep("\xff", 8))) == "2c4f081c6ac8d444")
+	assert(crypt.hexdecode(string.rep("0123456789abcdef", 5)) == string.rep("\x01\x23\x45\x67\x89\xab\xcd\xef", 5))
+	assert(not pcall(crypt.hexdecode, string.rep("0A", 20)))
+
+	local clientkeys, serverkeys, challenges = {}, {}, {}
+	for i = 1, 10 do
+		clientkeys[i], serverkeys[i], challenges[i] = bytes(8), bytes(8), bytes(8)
+	end
+	local exchanges, secrets, hmacs = crypt.handshake_batch(clientkeys, serverkeys, challenges)
+	for i = 1, 10 do
+		assert(exchanges[i] == crypt.dhexchange(serverkeys[i]))
+		assert(secrets[i] == crypt.dhsecret(clientkeys[i], serverkeys[i]))
+		assert(hmacs[i] == crypt.hmac64(challenges[i], secrets[i]))
+	end
+	assert(not pcall(crypt.handshake_batch, { "12345678" }, {}))
+end
+
 skynet.start(skynet.exit)
\ No newline at end of file
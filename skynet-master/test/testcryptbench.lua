@@ -0,0 +1,55 @@
+local skynet = require "skynet"
+local crypt = require "skynet.crypt"
+
+-- usage: testcryptbench [seconds]
+-- Measure the throughput of the crypt primitives used by the login handshake and websocket.
+
+local duration = tonumber((...)) or 0.5
+
+local function bench(name, size, f, ...)
+	local n = 0
+	local ti = skynet.hpc()
+	local limit = ti + duration * 1e9
+	local t
+	repeat
+		for _ = 1, 100 do
+			f(...)
+		end
+		n = n + 100
+		t = skynet.hpc()
+	until t > limit
+	local sec = (t - ti) / 1e9
+	if size then
+		print(string.format("%-20s %10.0f op/s %10.1f MB/s", name, n / sec, n * size / sec / 1024 / 1024))
+	else
+		print(string.format("%-20s %10.0f op/s", name, n / sec))
+	end
+end
+
+skynet.start(function()
+	local text = string.rep("abcdefghijklmnopqrstuvwxyz0123456789", 128):sub(1, 4096)
+	local hex = crypt.hexencode(text)
+	bench("hexencode 32", 32, crypt.hexencode, text:sub(1, 32))
+	bench("hexencode 4k", 4096, crypt.hexencode, text)
+	bench("hexdecode 4k", 4096, crypt.hexdecode, hex)
+	bench("xor_str 4k/4", 4096, crypt.xor_str, text, "mask")
+	bench("xor_str 4k/8", 4096, crypt.xor_str, text, "12345678")
+	bench("desencode 64", 64, crypt.desencode, "12345678", text:sub(1, 64))
+	bench("hmac64", nil, crypt.hmac64, "12345678", "87654321")
+	bench("dhexchange", nil, crypt.dhexchange, "12345678")
+	bench("dhsecret", nil, crypt.dhsecret, "12345678", "87654321")
+	local clientkeys, serverkeys, challenges = {}, {}, {}
+	for i = 1, 100 do
+		clientkeys[i], serverkeys[i], challenges[i] = crypt.randomkey(), crypt.randomkey(), crypt.randomkey()
+	end
+	bench("handshake x100", nil, function()
+		for i = 1, 100 do
+			crypt.dhexchange(serverkeys[i])
+			crypt.hmac64(challenges[i], crypt.dhsecret(clientkeys[i], serverkeys[i]))
+		end
+	end)
+	if crypt.handshake_batch then
+		bench("handshake_batch x100", nil, crypt.handshake_batch, clientkeys, serverkeys, challenges)
+	end
+	skynet.exit()
+end)
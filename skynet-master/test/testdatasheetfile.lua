@@ -0,0 +1,49 @@
+local skynet = require "skynet"
+local builder = require "skynet.datasheet.builder"
+local datasheet = require "skynet.datasheet"
+
+-- Build a datasheet file (as tools/mkdatasheet.lua), load it by builder.load and read it back.
+-- Then replace the file while it's mapped, and update the sheet.
+
+local MAGIC = "SKYSHEET"
+local VERSION = 1
+
+local function mkdatasheet(filename, t)
+	local doc = builder.compile(t)
+	local tmp = filename .. ".tmp"
+	local f = assert(io.open(tmp, "wb"))
+	f:write(MAGIC, string.pack("<I4I4", VERSION, #doc), doc)
+	f:close()
+	assert(os.rename(tmp, filename))
+end
+
+skynet.start(function()
+	local filename = os.tmpname()
+	mkdatasheet(filename, { a = 1, b = "hello", c = { 1, 2, 3 }, d = { x = 1.5 } })
+	builder.load("file", filename)
+
+	local t = datasheet.query "file"
+	assert(t.a == 1 and t.b == "hello")
+	assert(#t.c == 3 and t.c[3] == 3)
+	assert(t.d.x == 1.5)
+
+	-- replace the file, the loaded one is still mapped
+	mkdatasheet(filename, { a = 2 })
+	assert(t.a == 1 and t.c[2] == 2)
+
+	builder.update("file", { a = 3, c = { 4 } })
+	skynet.sleep(10)
+	assert(t.a == 3 and t.b == nil and t.c[1] == 4 and #t.c == 1)
+
+	-- an invalid file
+	local f = assert(io.open(filename, "wb"))
+	f:write "invalid"
+	f:close()
+	local ok, err = pcall(builder.load, "invalid", filename)
+	assert(not ok)
+	print(err)
+
+	os.remove(filename)
+	print("datasheet file ok")
+	skynet.exit()
+end)
@@ -0,0 +1,61 @@
+local skynet = require "skynet"
+require "skynet.manager"
+local harbor = require "skynet.harbor"
+
+-- usage: testharbor server | testharbor client [count]
+-- Start the server in harbor 1 (standalone) and the client in harbor 2,
+-- check the remote messages (order and binary content) and measure the messages/s.
+
+local mode, count = ...
+count = tonumber(count) or 100000
+
+local function server()
+	local n = 0
+	skynet.dispatch("lua", function(session, source, cmd, ...)
+		if cmd == "push" then
+			local seq = ...
+			n = n + 1
+			assert(seq == n, "order error")
+		elseif cmd == "echo" then
+			skynet.ret(skynet.pack(...))
+		elseif cmd == "count" then
+			skynet.ret(skynet.pack(n))
+			n = 0
+		end
+	end)
+	skynet.register "HARBOR_ECHO"
+end
+
+local function client()
+	local echo = harbor.queryname "HARBOR_ECHO"
+	local bin = string.rep("\0\1\2\255", 100)
+	for i = 1, 100 do
+		local s = bin:sub(1, i * 4)
+		assert(skynet.call(echo, "lua", "echo", s, i) == s)
+	end
+	local big = string.rep("x\0", 100 * 1024)
+	assert(skynet.call(echo, "lua", "echo", big) == big)
+	print("harbor echo ok")
+	local ti = skynet.hpc()
+	for i = 1, count do
+		skynet.send(echo, "lua", "push", i)
+	end
+	assert(skynet.call(echo, "lua", "count") == count)
+	local t = (skynet.hpc() - ti) / 1e9
+	print(string.format("harbor push %d messages : %.3fs, %.0f msg/s", count, t, count / t))
+	ti = skynet.hpc()
+	for i = 1, 1000 do
+		skynet.call(echo, "lua", "echo", i)
+	end
+	t = (skynet.hpc() - ti) / 1e9
+	print(string.format("harbor call : %.1f us", t / 1000 * 1e6))
+	skynet.abort()
+end
+
+skynet.start(function()
+	if mode == "server" then
+		server()
+	else
+		client()
+	end
+end)
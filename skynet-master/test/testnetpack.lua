@@ -0,0 +1,146 @@
+local skynet = require "skynet"
+local sproto = require "sproto"
+local sprotoparser = require "sprotoparser"
+
+-- usage: testnetpack [rounds]
+-- Send sproto packages to the gateservers in three modes, check them and compare the packages/s :
+--	string : netpack.tostring then decode the string (as msgserver)
+--	copy : decode the malloced package (netpack.filter)
+--	view : decode the view on the socket buffer (netpack.filterview)
+
+local proto = sprotoparser.parse [[
+.package {
+	type 0 : integer
+	session 1 : integer
+}
+
+push 1 {
+	request {
+		id 0 : integer
+		data 1 : string
+	}
+}
+]]
+
+local mode = ...
+
+if mode == "gate" then
+
+local netpack = require "skynet.netpack"
+local gateserver = require "snax.gateserver"
+
+local kind = select(2, ...)
+local host = sproto.new(proto):host "package"
+local count = 0
+local sum = 0
+local bytes = 0
+local waiting
+
+local handler = { view = kind == "view" }
+
+function handler.connect(fd)
+	gateserver.openclient(fd)
+end
+
+function handler.message(fd, msg, sz)
+	local t, name, args
+	if kind == "string" then
+		t, name, args = host:dispatch(netpack.tostring(msg, sz))
+	elseif kind == "copy" then
+		t, name, args = host:dispatch(msg, sz)
+		skynet.trash(msg, sz)
+	else
+		t, name, args = host:dispatch(msg, sz)
+	end
+	assert(t == "REQUEST" and name == "push")
+	count = count + 1
+	sum = sum + args.id
+	bytes = bytes + #args.data
+	if waiting and count >= waiting.n then
+		skynet.wakeup(waiting.co)
+	end
+end
+
+function handler.command(cmd, _, n)
+	assert(cmd == "wait")
+	if count < n then
+		waiting = { n = n, co = coroutine.running() }
+		skynet.wait(waiting.co)
+		waiting = nil
+	end
+	local r = { count = count, sum = sum, bytes = bytes }
+	count, sum, bytes = 0, 0, 0
+	return r
+end
+
+gateserver.start(handler)
+
+else
+
+local socket = require "skynet.socket"
+
+local rounds = tonumber(mode) or 200
+local BATCH = 256
+
+local function batch()
+	local request = sproto.new(proto):host "package":attach(sproto.new(proto))
+	local t = {}
+	local sum, bytes = 0, 0
+	for i = 1, BATCH do
+		local data = string.rep(string.char(i % 26 + 97), i * 7 % 300)
+		t[i] = string.pack(">s2", request("push", { id = i, data = data }))
+		sum = sum + i
+		bytes = bytes + #data
+	end
+	return table.concat(t), sum, bytes
+end
+
+local function check(r, n, sum, bytes)
+	assert(r.count == n, string.format("count %d ~= %d", r.count, n))
+	assert(r.sum == sum and r.bytes == bytes)
+end
+
+local function run(kind, port, packages, sum, bytes)
+	local gate = skynet.newservice(SERVICE_NAME, "gate", kind)
+	skynet.call(gate, "lua", "open", { address = "127.0.0.1", port = port })
+	local fd = assert(socket.open("127.0.0.1", port))
+
+	-- split the packages (and the headers) across the reads
+	local i = 1
+	local chunk = 0
+	while i <= #packages do
+		local n = math.random(1, 97)
+		socket.write(fd, packages:sub(i, i + n - 1))
+		i = i + n
+		chunk = chunk + 1
+		if chunk % 8 == 0 then
+			skynet.sleep(0)
+		end
+	end
+	check(skynet.call(gate, "lua", "wait", BATCH), BATCH, sum, bytes)
+
+	local t = skynet.hpc()
+	for _ = 1, rounds do
+		socket.write(fd, packages)
+	end
+	check(skynet.call(gate, "lua", "wait", BATCH * rounds), BATCH * rounds, sum * rounds, bytes * rounds)
+	local elapsed = (skynet.hpc() - t) / 1e9
+	skynet.error(string.format("%-6s %10.1f package/s %8.2f MB/s", kind, BATCH * rounds / elapsed,
+		#packages * rounds / elapsed / 1024 / 1024))
+	socket.close(fd)
+	skynet.call(gate, "lua", "close")
+	collectgarbage()
+end
+
+skynet.start(function()
+	local packages, sum, bytes = batch()
+	run("string", 8601, packages, sum, bytes)
+	run("copy", 8602, packages, sum, bytes)
+	run("view", 8603, packages, sum, bytes)
+	-- let the logger print the results before abort
+	skynet.sleep(10)
+	require "skynet.manager"
+	skynet.abort()
+end)
+
+end
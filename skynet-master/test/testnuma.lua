@@ -0,0 +1,128 @@
+local skynet = require "skynet.manager"	-- import skynet.affinity, skynet.abort
+
+-- usage: testnuma [pairs] [count]
+-- Run with numa = "0-3;4-7" (or "auto") in config, see examples/config.
+-- Pairs of services call each other, placed on the same node and then on different nodes,
+-- compare the throughput and the cross node messages (STAT crossnode).
+-- Simulate two nodes on one machine by splitting the cpus, ie. numa = "0-1;2-3" , thread = 4.
+
+local mode = ...
+
+if mode == "peer" then
+
+skynet.start(function()
+	local peer
+	skynet.dispatch("lua", function(_, _, cmd, ...)
+		if cmd == "ping" then
+			skynet.ret()
+		elseif cmd == "run" then
+			local n = ...
+			for _ = 1, n do
+				skynet.call(peer, "lua", "ping")
+			end
+			skynet.ret()
+		elseif cmd == "peer" then
+			peer = ...
+			skynet.ret()
+		elseif cmd == "stat" then
+			skynet.ret(skynet.pack(skynet.stat "crossnode"))
+		end
+	end)
+end)
+
+else
+
+local pairs_n = tonumber(mode) or 8
+local count = tonumber((select(2, ...))) or 20000
+
+local function numa_nodes()
+	local numa = skynet.getenv "numa"
+	if numa == nil then
+		return 0
+	elseif numa == "auto" then
+		local n = 0
+		while true do
+			local f = io.open(string.format("/sys/devices/system/node/node%d/cpulist", n))
+			if not f then
+				return n
+			end
+			f:close()
+			n = n + 1
+		end
+	end
+	local n = 1
+	for _ in numa:gmatch ";" do
+		n = n + 1
+	end
+	return n
+end
+
+local function crossnode(services)
+	local n = 0
+	for _, s in ipairs(services) do
+		n = n + skynet.call(s, "lua", "stat")
+	end
+	return n
+end
+
+local function bench(name, nodes, place)
+	local services = {}
+	local list = {}
+	for i = 1, pairs_n do
+		local a = skynet.newservice(SERVICE_NAME, "peer")
+		local b = skynet.newservice(SERVICE_NAME, "peer")
+		if nodes > 1 then
+			local na, nb = place(i, nodes)
+			skynet.affinity(a, na)
+			skynet.affinity(b, nb)
+		end
+		skynet.call(a, "lua", "peer", b)
+		table.insert(services, a)
+		table.insert(services, b)
+		table.insert(list, a)
+	end
+	-- the replies of stat are counted too
+	local before = crossnode(services)
+	local stat = crossnode(services) - before
+	before = before + stat * 2
+	local running = #list
+	local co = coroutine.running()
+	local t = skynet.hpc()
+	for _, a in ipairs(list) do
+		skynet.fork(function()
+			skynet.call(a, "lua", "run", count)
+			running = running - 1
+			if running == 0 then
+				skynet.wakeup(co)
+			end
+		end)
+	end
+	skynet.wait(co)
+	local elapsed = (skynet.hpc() - t) / 1e9
+	-- one call is two messages
+	local msg = pairs_n * count * 2
+	local cross = crossnode(services) - before
+	skynet.error(string.format("%-6s %d pairs : %10.1f msg/s, cross node %d/%d (%.1f%%)",
+		name, pairs_n, msg / elapsed, cross, msg, cross / msg * 100))
+	for _, s in ipairs(services) do
+		skynet.kill(s)
+	end
+end
+
+skynet.start(function()
+	local nodes = numa_nodes()
+	skynet.error("numa nodes", nodes)
+	bench("local", nodes, function(i, n)
+		local node = i % n
+		return node, node
+	end)
+	bench("cross", nodes, function(i, n)
+		local node = i % n
+		return node, (node + 1) % n
+	end)
+	-- let the logger print the results before abort
+	skynet.sleep(10)
+	skynet.abort()
+end)
+
+end
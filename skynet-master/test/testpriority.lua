@@ -0,0 +1,83 @@
+local skynet = require "skynet.manager"	-- import skynet.priority, skynet.abort
+
+-- usage: testpriority [seconds]
+-- Keep the workers busy with the services of each priority class, check the high class is
+-- served more, but the background class isn't starved : every 16th pop of the global queue
+-- starts from the background class, see skynet_mq.c.
+
+local mode = ...
+
+if mode == "spin" then
+
+skynet.start(function()
+	local count = 0
+	local gap = 0
+	local last
+	local running = true
+	skynet.dispatch("lua", function(_, _, cmd)
+		if cmd == "spin" then
+			if running then
+				local now = skynet.hpc()
+				if last and now - last > gap then
+					gap = now - last
+				end
+				last = now
+				count = count + 1
+				skynet.send(skynet.self(), "lua", "spin")
+			end
+		else
+			running = false
+			skynet.ret(skynet.pack(count, gap / 1e9))
+		end
+	end)
+	skynet.send(skynet.self(), "lua", "spin")
+end)
+
+else
+
+local seconds = tonumber(mode) or 2
+-- the spinners of each class, more high ones to keep the high list non-empty
+local CLASSES = { high = 8, normal = 2, background = 2 }
+local ORDER = { "high", "normal", "background" }
+
+skynet.start(function()
+	local spinners = {}
+	for _, class in ipairs(ORDER) do
+		for _ = 1, CLASSES[class] do
+			local addr = skynet.newservice(SERVICE_NAME, "spin")
+			if class ~= "normal" then
+				assert(skynet.priority(addr, class) == "normal")
+			end
+			table.insert(spinners, { class = class, addr = addr })
+		end
+	end
+	skynet.sleep(seconds * 100)
+
+	local count = { high = 0, normal = 0, background = 0 }
+	local gap = { high = 0, normal = 0, background = 0 }
+	local total = 0
+	for _, s in ipairs(spinners) do
+		local n, g = skynet.call(s.addr, "lua", "stop")
+		count[s.class] = count[s.class] + n
+		gap[s.class] = math.max(gap[s.class], g)
+		total = total + n
+	end
+	for _, class in ipairs(ORDER) do
+		skynet.error(string.format("%-10s %8d messages %8.1f per service, max gap %.3fs",
+			class, count[class], count[class] / CLASSES[class], gap[class]))
+	end
+
+	local high = count.high / CLASSES.high
+	local background = count.background / CLASSES.background
+	assert(background > 0, "The background class is starved")
+	assert(high > background, "The high class isn't served first")
+	-- 1/16 of the pops start from the background class, allow half of it for the noise
+	assert(count.background >= total / 32, "The background class gets less than its share")
+	assert(gap.background < seconds / 2, "The background class waits too long")
+
+	skynet.error("priority ok")
+	skynet.sleep(10)
+	skynet.abort()
+end)
+
+end
@@ -0,0 +1,100 @@
+local skynet = require "skynet"
+local memory = require "skynet.memory"
+
+-- Send a shared payload to the subscribers directly and through a forwarder (skynet.forward_type),
+-- check each receiver gets the same content, and the payload is freed after the last receiver.
+
+local SIZE = 4 * 1024 * 1024
+local mode = ...
+
+local function payload(i)
+	return string.rep(string.char(i % 26 + 97), SIZE), { i, i + 1, i + 2 }
+end
+
+if mode == "sub" then
+
+skynet.start(function()
+	local count = 0
+	skynet.dispatch("lua", function (_,_, cmd, ...)
+		if cmd == "publish" then
+			local i, str, t = ...
+			local expect_str, expect_t = payload(i)
+			assert(str == expect_str, "Invalid shared payload")
+			assert(t[1] == expect_t[1] and t[3] == expect_t[3])
+			count = count + 1
+		elseif cmd == "check" then
+			-- drop the unpacked strings before the memory check
+			collectgarbage()
+			skynet.ret(skynet.pack(count))
+		else
+			assert(cmd == "exit")
+			skynet.exit()
+		end
+	end)
+end)
+
+elseif mode == "forward" then
+
+require "skynet.manager"	-- import skynet.forward_type
+local target = tonumber((select(2, ...)))
+
+skynet.register_protocol {
+	name = "system",
+	id = skynet.PTYPE_SYSTEM,
+	unpack = function (...) return ... end,
+}
+
+-- keep the lua messages and redirect them without copy, as clusterproxy does
+skynet.forward_type({ [skynet.PTYPE_LUA] = skynet.PTYPE_SYSTEM }, function()
+	skynet.dispatch("system", function (session, source, msg, sz)
+		-- the target responds to the source
+		skynet.ignoreret()
+		skynet.redirect(target, source, "lua", session, msg, sz)
+	end)
+end)
+
+else
+
+require "skynet.manager"	-- import skynet.abort
+
+local function total()
+	collectgarbage()
+	-- wait the workers to flush their memory deltas
+	skynet.sleep(20)
+	return memory.total()
+end
+
+skynet.start(function()
+	local subs = {}
+	local checks = {}
+	for i=1,10 do
+		subs[i] = skynet.newservice(SERVICE_NAME, "sub")
+		checks[i] = subs[i]
+	end
+	-- the forwarders keep the payload, and the subscribers behind them free it
+	for i=1,2 do
+		local sub = skynet.newservice(SERVICE_NAME, "sub")
+		table.insert(subs, sub)
+		table.insert(checks, skynet.newservice(SERVICE_NAME, "forward", sub))
+	end
+
+	local rounds = 4
+	local before = total()
+	for i = 1, rounds do
+		skynet.sendshared(checks, "lua", "publish", i, payload(i))
+	end
+	for _, addr in ipairs(checks) do
+		assert(skynet.call(addr, "lua", "check") == rounds)
+	end
+	local after = total()
+	skynet.error(string.format("memory before %d after %d", before, after))
+	-- a leaked payload is SIZE at least
+	assert(after - before < SIZE / 2, "The shared payload isn't freed")
+
+	skynet.sendshared(subs, "lua", "exit")
+	skynet.error("shared ok")
+	skynet.sleep(10)
+	skynet.abort()
+end)
+
+end
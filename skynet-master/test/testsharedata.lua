@@ -0,0 +1,86 @@
+local skynet = require "skynet"
+local sharedata = require "skynet.sharedata"
+local core = require "skynet.sharedata.core"
+local host = require "skynet.sharedata.corelib".host
+require "skynet.manager"	-- import skynet.abort
+
+-- Update one row of a sharedata object, check the readers get the new value, the cached proxies
+-- of the unchanged sub tables keep their objects, and a removed key raises an error.
+-- Then delete the old version, check the strings of the tables shared by the new version are alive.
+
+local function config(v)
+	return {
+		rows = {
+			{ name = "row1", value = v },
+			{ name = "row2", value = 2, tags = { "a", "b" } },
+		},
+		other = { name = "other", x = { 1, 2, 3 } },
+		removed = v == 1 and { k = 1 } or nil,
+	}
+end
+
+local function test_update()
+	sharedata.new("cfg", config(1))
+	local obj = sharedata.query "cfg"
+	local row1 = obj.rows[1]
+	local row2 = obj.rows[2]
+	local tags = row2.tags
+	local other = obj.other
+	local x = other.x
+	local removed = obj.removed
+	assert(row1.value == 1 and removed.k == 1)
+	local row2_obj, tags_obj, other_obj, x_obj = row2.__obj, tags.__obj, other.__obj, x.__obj
+
+	sharedata.update("cfg", config(100))
+	-- wait the reader receives the new version
+	skynet.sleep(10)
+	assert(obj.rows[1].value == 100)
+	assert(obj.rows[1] == row1 and row1.value == 100 and row1.name == "row1")
+
+	assert(obj.rows[2] == row2 and row2.__obj == row2_obj)
+	assert(row2.tags == tags and tags.__obj == tags_obj and tags[2] == "b")
+	assert(obj.other == other and other.__obj == other_obj)
+	assert(other.x == x and x.__obj == x_obj and #x == 3)
+
+	assert(obj.removed == nil)
+	local ok, err = pcall(function() return removed.k end)
+	assert(not ok and err:find "doesn't exist after update", err)
+	sharedata.delete "cfg"
+	print("sharedata update ok")
+end
+
+local function test_delete()
+	local t = {
+		shared = { name = "shared string", list = { "one", "two", "three" } },
+		v = 1,
+	}
+	local v1 = host.new(t)
+	t.v = 2
+	local v2 = host.new(t, v1)
+	local shared = core.index(v2, "shared")
+	assert(shared == core.index(v1, "shared"))
+	assert(core.index(v2, "v") == 2)
+
+	-- collectobj deletes the old version when no one refers it
+	host.markdirty(v1, v2)
+	assert(host.getref(v1) <= 0)
+	host.delete(v1)
+	-- reuse the freed memory
+	local garbage = {}
+	for i = 1, 10000 do
+		garbage[i] = string.rep(tostring(i), 8)
+	end
+	garbage = nil
+	collectgarbage()
+	assert(core.index(shared, "name") == "shared string")
+	assert(core.index(core.index(shared, "list"), 3) == "three")
+	host.delete(v2)
+	print("sharedata delete ok")
+end
+
+skynet.start(function()
+	test_update()
+	test_delete()
+	skynet.sleep(10)
+	skynet.abort()
+end)
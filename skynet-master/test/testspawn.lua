@@ -0,0 +1,50 @@
+local skynet = require "skynet"
+
+local mode, n = ...
+
+if mode == "child" then
+
+skynet.start(function()
+	skynet.dispatch("lua", function()
+		skynet.exit()
+	end)
+end)
+
+else
+
+-- benchmark for spawn latency and throughput, compare lua_statepool = 0 and lua_statepool = n in config
+local N = tonumber(mode) or 1000
+local CONCURRENT = tonumber(n) or 16
+
+skynet.start(function()
+	local services = {}
+	local latency = 0
+	local start = skynet.hpc()
+	local running = CONCURRENT
+	local index = 0
+	local wait = {}
+	for i = 1, CONCURRENT do
+		skynet.fork(function()
+			while index < N do
+				index = index + 1
+				local t = skynet.hpc()
+				table.insert(services, skynet.newservice(SERVICE_NAME, "child"))
+				latency = latency + skynet.hpc() - t
+			end
+			running = running - 1
+			if running == 0 then
+				skynet.wakeup(wait)
+			end
+		end)
+	end
+	skynet.wait(wait)
+	local elapsed = skynet.hpc() - start
+	skynet.error(string.format("spawn %d services in %.3f s : %.1f services/s, avg latency %.3f ms",
+		#services, elapsed / 1e9, #services / (elapsed / 1e9), latency / #services / 1e6))
+	for _, addr in ipairs(services) do
+		skynet.send(addr, "lua")
+	end
+	skynet.exit()
+end)
+
+end
@@ -0,0 +1,159 @@
+local skynet = require "skynet"
+local sproto = require "sproto"
+
+-- usage: testsproto [count]
+-- Check the compiled encoder/decoder against the callback one, and compare the messages/s.
+
+local count = tonumber((...)) or 100000
+
+local proto = [[
+.Item {
+	id 0 : integer
+	name 1 : string
+	count 2 : integer
+}
+
+.Vec {
+	x 0 : double
+	y 1 : double
+}
+
+.Player {
+	id 0 : integer
+	name 1 : string
+	level 2 : integer
+	online 3 : boolean
+	money 4 : integer(2)
+	pos 5 : Vec
+	items 6 : *Item(id)
+	skills 7 : *integer
+	tags 8 : *string
+	flags 9 : *boolean
+	attrs 10 : *Attr()
+	friends 12 : *Player
+	scores 13 : *double
+	big 14 : integer
+	raw 15 : binary
+}
+
+.Attr {
+	key 0 : string
+	value 1 : integer
+}
+
+.package {
+	type 0 : integer
+	session 1 : integer
+	ud 2 : string
+}
+
+login 1 {
+	request Player
+	response {
+		ok 0 : boolean
+	}
+}
+]]
+
+local sp = sproto.parse(proto)
+local cp = sproto.parse(proto):compile()
+
+local function deepeq(a, b)
+	if type(a) ~= type(b) then
+		return false
+	end
+	if type(a) ~= "table" then
+		return a == b
+	end
+	for k,v in pairs(a) do
+		if not deepeq(v, b[k]) then
+			return false
+		end
+	end
+	for k in pairs(b) do
+		if a[k] == nil then
+			return false
+		end
+	end
+	return true
+end
+
+local function player(i)
+	local skills = {}
+	for j=1,32 do
+		skills[j] = i * j
+	end
+	return {
+		id = i,
+		name = "player" .. i,
+		level = i % 100,
+		online = i % 2 == 0,
+		money = 12.34,
+		pos = { x = 1.5, y = -2.25 },
+		items = {
+			[1] = { id = 1, name = "sword", count = 1 },
+			[100000] = { id = 100000, name = "potion", count = 99 },
+		},
+		skills = skills,
+		tags = { "a", "bb", "ccc" },
+		flags = { true, false, true },
+		attrs = { hp = 100, mp = -1, atk = 0x12345678 },
+		friends = { { id = -1, name = "f1" }, { id = 0x7fff, skills = {} } },
+		scores = { 0.5, 1e100, -3 },
+		big = 0x123456789abc,
+		raw = "\0\1\2\3",
+	}
+end
+
+local function check()
+	local cases = {
+		{},
+		{ id = 0 },
+		{ id = 0x7ffe, level = 0x7fff, big = -1 },
+		{ skills = { 1, -1, 0x7fffffff, -0x80000000 } },
+		{ skills = { 1, 0x100000000, -2 } },
+		{ friends = {}, items = {}, attrs = {}, skills = {} },
+		player(1),
+		player(12345),
+	}
+	for i, obj in ipairs(cases) do
+		local a = sp:encode("Player", obj)
+		local b = cp:encode("Player", obj)
+		assert(a == b, "encode mismatch " .. i)
+		assert(deepeq(sp:decode("Player", a), cp:decode("Player", a)), "decode mismatch " .. i)
+		assert(sp:pencode("Player", obj) == cp:pencode("Player", obj))
+	end
+	local host = cp:host "package"
+	local request = host:attach(cp)
+	local t, name, args, response = host:dispatch(request("login", player(2), 1))
+	assert(t == "REQUEST" and name == "login" and deepeq(args, player(2)))
+	local t, session, result = host:dispatch(response { ok = true })
+	assert(t == "RESPONSE" and session == 1 and result.ok == true)
+	assert(not pcall(cp.encode, cp, "Player", { id = "x" }))
+	assert(not pcall(cp.decode, cp, "Player", "\1\0\0\0\9\0\0\0"))
+	print("compiled sproto check ok")
+end
+
+local function bench(name, obj, n)
+	local encode = name == "compiled" and cp or sp
+	local data = encode:encode("Player", obj)
+	local ti = skynet.hpc()
+	for i=1,n do
+		encode:encode("Player", obj)
+	end
+	local t1 = skynet.hpc()
+	for i=1,n do
+		encode:decode("Player", data)
+	end
+	local t2 = skynet.hpc()
+	print(string.format("%-8s encode %8.0f msg/s  decode %8.0f msg/s",
+		name, n / (t1 - ti) * 1e9, n / (t2 - t1) * 1e9))
+end
+
+skynet.start(function()
+	check()
+	local obj = player(100)
+	bench("callback", obj, count)
+	bench("compiled", obj, count)
+	skynet.exit()
+end)
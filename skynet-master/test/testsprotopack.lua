@@ -0,0 +1,104 @@
+local skynet = require "skynet"
+local core = require "sproto.core"
+
+-- usage: testsprotopack [rounds]
+-- Fuzz the SIMD 0-pack against the scalar version, and compare the MB/s.
+
+local rounds = tonumber((...)) or 2000
+
+local function randbytes(n, zero)
+	local t = {}
+	for i = 1, n do
+		if math.random() < zero then
+			t[i] = 0
+		else
+			t[i] = math.random(1, 255)
+		end
+	end
+	return string.char(table.unpack(t))
+end
+
+local function randstr(n, zero)
+	local t = {}
+	-- string.char has a limit of arguments
+	while n > 0 do
+		local c = math.min(n, 1024)
+		t[#t+1] = randbytes(c, zero)
+		n = n - c
+	end
+	return table.concat(t)
+end
+
+local function mode(simd, f, ...)
+	core.simd(simd)
+	return pcall(f, ...)
+end
+
+local function check(data)
+	local ok1, p1 = mode(false, core.pack, data)
+	local ok2, p2 = mode(true, core.pack, data)
+	assert(ok1 and ok2 and p1 == p2, "pack mismatch")
+	local u1 = select(2, mode(false, core.unpack, p1))
+	local u2 = select(2, mode(true, core.unpack, p1))
+	assert(u1 == u2, "unpack mismatch")
+	local pad = (8 - #data % 8) % 8
+	assert(u1 == data .. string.rep("\0", pad), "unpack error")
+	-- broken streams should fail (or not) in the same way
+	for _ = 1, 4 do
+		local cut = p1:sub(1, math.random(0, #p1))
+		local ok1, r1 = mode(false, core.unpack, cut)
+		local ok2, r2 = mode(true, core.unpack, cut)
+		assert(ok1 == ok2 and (not ok1 or r1 == r2), "unpack broken stream mismatch")
+	end
+	local noise = randstr(math.random(0, 64), 0.3)
+	local ok1, r1 = mode(false, core.unpack, noise)
+	local ok2, r2 = mode(true, core.unpack, noise)
+	assert(ok1 == ok2 and (not ok1 or r1 == r2), "unpack noise mismatch")
+end
+
+local function fuzz()
+	math.randomseed(0)
+	local zeros = { 0, 0.1, 0.3, 0.5, 0.7, 0.9, 1 }
+	for i = 1, rounds do
+		local n = math.random(0, i % 10 == 0 and 8192 or 300)
+		check(randstr(n, zeros[math.random(#zeros)]))
+	end
+	-- FF runs longer than 256 groups and mixed with 6 or 7 nonzero bytes
+	check(randstr(256 * 8 * 3 + 5, 0))
+	check(string.rep("\1\2\3\0\4\5\6\7", 300))
+	check(string.rep("\1\2\0\3\0\4\5\6", 300) .. randstr(100, 0))
+	print("sproto pack fuzz ok")
+end
+
+local function bench(name, data, n)
+	local packed = core.pack(data)
+	local mb = #data * n / 1024 / 1024
+	for _, simd in ipairs { false, true } do
+		core.simd(simd)
+		local ti = skynet.hpc()
+		for _ = 1, n do
+			core.pack(data)
+		end
+		local t1 = skynet.hpc()
+		for _ = 1, n do
+			core.unpack(packed)
+		end
+		local t2 = skynet.hpc()
+		print(string.format("%-8s %-6s pack %8.1f MB/s  unpack %8.1f MB/s", name, simd and "simd" or "scalar",
+			mb / ((t1 - ti) / 1e9), mb / ((t2 - t1) / 1e9)))
+	end
+end
+
+skynet.start(function()
+	local simd = core.simd()
+	print("SIMD support", simd)
+	if simd then
+		fuzz()
+	end
+	math.randomseed(1)
+	bench("zero50%", randstr(4096, 0.5), 20000)
+	bench("zero90%", randstr(4096, 0.9), 20000)
+	bench("dense", randstr(4096, 0.02), 20000)
+	core.simd(simd)
+	skynet.exit()
+end)
@@ -0,0 +1,76 @@
+local skynet = require "skynet"
+local stm = require "skynet.stm"
+
+-- usage: teststmbench [readers] [seconds]
+-- Many readers poll one stm object, and one writer updates it every tick.
+
+local mode, arg1, arg2 = ...
+
+if mode == "reader" then
+
+skynet.start(function()
+	skynet.dispatch("lua", function (_,_, copy, seconds)
+		local obj = stm.newcopy(copy)
+		local polls, updates = 0, 0
+		local stop = skynet.now() + seconds * 100
+		while skynet.now() < stop do
+			for i=1,1000 do
+				if obj(skynet.unpack) then
+					updates = updates + 1
+				end
+			end
+			polls = polls + 1000
+			skynet.yield()
+		end
+		skynet.ret(skynet.pack(polls, updates))
+		skynet.exit()
+	end)
+end)
+
+else
+
+local readers = tonumber(mode) or 16
+local seconds = tonumber(arg1) or 3
+
+skynet.start(function()
+	local obj = stm.new(skynet.pack(0))
+	local writes = 0
+	local running = true
+	skynet.fork(function()
+		while running do
+			skynet.sleep(1)
+			writes = writes + 1
+			obj(skynet.pack(writes))
+		end
+	end)
+	local response = {}
+	for i=1,readers do
+		local r = skynet.newservice(SERVICE_NAME, "reader")
+		table.insert(response, function()
+			return skynet.call(r, "lua", stm.copy(obj), seconds)
+		end)
+	end
+	local polls, updates = 0, 0
+	local n = readers
+	local co = coroutine.running()
+	local ti = skynet.hpc()
+	for _, f in ipairs(response) do
+		skynet.fork(function()
+			local p, u = f()
+			polls = polls + p
+			updates = updates + u
+			n = n - 1
+			if n == 0 then
+				skynet.wakeup(co)
+			end
+		end)
+	end
+	skynet.wait(co)
+	running = false
+	local elapsed = (skynet.hpc() - ti) / 1e9
+	skynet.error(string.format("readers=%d writes=%d polls=%d updates=%d polls/s=%.0f",
+		readers, writes, polls, updates, polls / elapsed))
+	skynet.exit()
+end)
+
+end
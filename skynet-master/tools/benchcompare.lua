@@ -0,0 +1,61 @@
+-- Compare two result files of the benchmark suite (test/testbench.lua, examples/config.bench)
+-- usage: 3rd/lua/lua tools/benchcompare.lua baseline.json current.json [threshold%]
+-- The rate (unit xxx/s) is better when higher, the others (latency) are better when lower.
+-- Exit with 1 when any case is worse than the threshold (default 10%), or a case of baseline is missing
+-- in current (the case failed or was removed).
+
+local baseline, current, threshold = ...
+if not baseline or not current then
+	print("usage: benchcompare.lua baseline.json current.json [threshold%]")
+	return
+end
+threshold = tonumber(threshold) or 10
+
+local function load(filename)
+	local f = assert(io.open(filename, "rb"))
+	local result = {}
+	local order = {}
+	for line in f:lines() do
+		local name, value, unit = line:match '^{"bench":"(.-)","value":([^,]+),"unit":"(.-)"}'
+		if name then
+			result[name] = { value = tonumber(value), unit = unit }
+			table.insert(order, name)
+		end
+	end
+	f:close()
+	return result, order
+end
+
+local base, base_order = load(baseline)
+local cur, order = load(current)
+
+local regression = 0
+print(string.format("%-20s %14s %14s %8s", "bench", "baseline", "current", "diff"))
+for _, name in ipairs(order) do
+	local c = cur[name]
+	local b = base[name]
+	if b == nil or b.unit ~= c.unit or b.value == 0 then
+		print(string.format("%-20s %14s %14.2f %8s  %s", name, "-", c.value, "-", c.unit))
+	else
+		local diff = (c.value - b.value) / b.value * 100
+		local worse = c.unit:find "/s$" and -diff or diff
+		local mark = ""
+		if worse > threshold then
+			mark = " *"
+			regression = regression + 1
+		end
+		print(string.format("%-20s %14.2f %14.2f %+7.1f%%  %s%s", name, b.value, c.value, diff, c.unit, mark))
+	end
+end
+for _, name in ipairs(base_order) do
+	local b = base[name]
+	if cur[name] == nil then
+		print(string.format("%-20s %14.2f %14s %8s  %s *", name, b.value, "missing", "-", b.unit))
+		regression = regression + 1
+	end
+end
+
+if regression > 0 then
+	print(string.format("%d case(s) worse than %g%% or missing", regression, threshold))
+	os.exit(1)
+end
@@ -0,0 +1,35 @@
+-- Build a datasheet file offline, load it by builder.load (see lualib/skynet/datasheet/builder.lua)
+-- usage: 3rd/lua/lua tools/mkdatasheet.lua source.lua output
+-- source.lua returns the table.
+-- The output is written to output.tmp and renamed to output, because the nodes which have loaded
+-- the old file keep it mapped. Always replace a datasheet file this way, never rewrite it in place.
+
+local source, output = ...
+if not source or not output then
+	print("usage: mkdatasheet.lua source.lua output")
+	return
+end
+
+local root = arg[0]:match "^(.-)tools[/\\][^/\\]*$" or "./"
+package.path = root .. "lualib/?.lua;" .. package.path
+
+local dump = require "skynet.datasheet.dump"
+
+local MAGIC = "SKYSHEET"
+local VERSION = 1
+
+local t = assert(loadfile(source))()
+assert(type(t) == "table", "source should return a table")
+local doc = dump.dump(t)
+
+local tmp = output .. ".tmp"
+local f = assert(io.open(tmp, "wb"))
+f:write(MAGIC, string.pack("<I4I4", VERSION, #doc), doc)
+f:close()
+local ok, err = os.rename(tmp, output)
+if not ok then
+	-- rename doesn't replace an existing file on windows
+	os.remove(output)
+	assert(os.rename(tmp, output))
+end
+print(string.format("%s : %d bytes", output, #doc + 16))
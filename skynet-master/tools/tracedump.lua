@@ -0,0 +1,61 @@
+-- Decode the message trace written by LOGON (see skynet-src/skynet_log.c)
+-- usage: 3rd/lua/lua tools/tracedump.lua xxxxxxxx.trace [maxhex]
+
+local filename, maxhex = ...
+if not filename then
+	print("usage: tracedump.lua xxxxxxxx.trace [maxhex]")
+	return
+end
+maxhex = tonumber(maxhex)
+
+local PTYPE_SOCKET = 6
+local PAD = 0x80000000
+local HEADER_SIZE = 64
+local RECORD_SIZE = 32
+
+local f = assert(io.open(filename, "rb"))
+local data = f:read "a"
+f:close()
+
+local magic, version, handle, starttime, opentime, closetime, size, payload, _, head, tail, count =
+	string.unpack("<c8I4I4I4I4I4I4I4I4I8I8I8", data)
+assert(magic == "SKYTRACE", "Invalid trace file")
+assert(version == 1, "Unsupported version " .. version)
+
+local function timestr(ti)
+	return os.date("%Y-%m-%d %H:%M:%S", starttime + ti // 100) .. string.format(".%02d", ti % 100)
+end
+
+local function hex(s)
+	if maxhex and #s > maxhex then
+		s = s:sub(1, maxhex)
+	end
+	return (s:gsub(".", function(c) return string.format("%02x", c:byte()) end))
+end
+
+print(string.format("handle :%08x open %s%s", handle, timestr(opentime),
+	closetime ~= 0 and (" close " .. timestr(closetime)) or ""))
+print(string.format("messages %d, dropped %d bytes, payload limit %d", count, tail, payload))
+
+local ring = HEADER_SIZE
+local pos = tail
+while pos < head do
+	local offset = ring + pos % size
+	local rsize, len, sz, source, session, type, ti = string.unpack("<I4I4I4I4i4i4I4", data, offset + 1)
+	if rsize & PAD ~= 0 then
+		pos = pos + (rsize & ~PAD)
+	else
+		local p = offset + RECORD_SIZE
+		local trunc = len < sz and string.format(" (%d/%d)", len, sz) or ""
+		if type == PTYPE_SOCKET then
+			local stype, id, ud = string.unpack("<i4i4i4", data, p + 1)
+			local msg = data:sub(p + 13, p + len)
+			trunc = len - 12 < sz and string.format(" (%d/%d)", len - 12, sz) or ""
+			print(string.format("%s [socket] %d %d %d %s%s", timestr(ti), stype, id, ud, hex(msg), trunc))
+		else
+			local msg = data:sub(p + 1, p + len)
+			print(string.format("%s :%08x %d %d %s%s", timestr(ti), source, type, session, hex(msg), trunc))
+		end
+		pos = pos + rsize
+	end
+end